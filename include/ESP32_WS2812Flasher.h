@@ -12,7 +12,7 @@
 */
 
 // only NEO_GRB + NEO_KHZ800 defines used for ESP32 WS2812 RGB LED e.g. ESP32 C3 etc
-// THIS CODE ASSUMES THERE IS ONLY ONE RGB LED IN THE STRIP
+// pixel 0 is the flashing status LED, the other pixels of a strip are set with setPixelColor(n,r,g,b) and show()
 /*!
   @file Adafruit_NeoPixel.h
 
@@ -62,8 +62,18 @@
 class ESP32_WS2812Flasher : public PinFlasher {
 
   public:
-    ESP32_WS2812Flasher( int16_t pin = -1, bool invert = false);
+    ESP32_WS2812Flasher( int16_t pin = -1, bool invert = false, uint16_t numPixels = 1);
     virtual void setColor(uint8_t r, uint8_t g, uint8_t b);
+#if defined(ESP32)
+    ~ESP32_WS2812Flasher();
+    uint16_t numPixels(); // may be less than asked for if the pixel buffer could not be allocated
+    /**
+      Set pixel n's colour, pixel 0 is overwritten by the flashing, call show() to send the changes
+    */
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void show(); // queue the pixels to be sent, does not wait
+    bool canShow(); // true if the last show() has been sent and latched
+#endif
 
     // inherited from PinFlasher
     /**
@@ -99,17 +109,15 @@ class ESP32_WS2812Flasher : public PinFlasher {
     // skip this if trying to compile under ESP8266
 #if defined(ESP32)    
     virtual void setOutput();
-    bool canShow();
-    void show();
-    void setPixelColor(uint8_t r, uint8_t g, uint8_t b);
+    void setPixelColor(uint8_t r, uint8_t g, uint8_t b); // pixel 0
     bool is800KHz; ///< true if 800 KHz pixels
+    uint16_t numLEDs;   ///< Number of RGB LEDs in strip
     uint16_t numBytes;  ///< Size of 'pixels' buffer below
-    uint8_t *pixels;    ///< Holds LED color values (3 or 4 bytes each)
-    uint8_t pixelArray[3]; // 4bytes x 1 led
+    uint8_t *pixels;    ///< Holds LED color values (3 bytes each), the RMT driver sends a copy
+    uint8_t pixelArray[3]; // 3bytes x 1 led, used when only one led so no heap is used
     uint8_t rOffset;    ///< Red index within each 3- or 4-byte pixel
     uint8_t gOffset;    ///< Index of green byte
     uint8_t bOffset;    ///< Index of blue byte
-    uint32_t endTime;   ///< Latch timing reference
     uint8_t red;
     uint8_t green;
     uint8_t blue;
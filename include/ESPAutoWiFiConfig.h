@@ -23,7 +23,10 @@
 #error "Only ESP8266 and ESP32 and ESP32 C3/S2/S3 etc boards supported"
 #endif
 
-// NOTE: ESPAutoWiFiConfig uses 148 bytes of EEPROM so if you are using your own make sure you allow enough if you call EEPROM.begin( ) in your code.
+// NOTE: ESPAutoWiFiConfig keeps its settings in configStore (/config.bin on LittleFS)
+// settings saved in EEPROM by earlier versions are moved to configStore on the first boot
+// the BSSID, channel and DHCP lease of the last connection are also cached, so a reboot can connect without a channel scan,
+// reusing the lease until its renew time if the clock has been kept across an ESP.restart(), else a full scan connect is used
 /* 
   For ESP8266 use 
   int ledPin = 0; for Adafruit ESP8266 HUZZAH - onboard Led connected to GPIO0
@@ -58,10 +61,10 @@
    // rest of setup
 */
 // if ESPAutoWiFiConfigSetup() returns true the in AP mode waiting for connection to set WiFi SSID/pw/ip settings
+// else it returns straight away and ESPAutoWiFiConfigLoop() connects in the background, retrying with backoff if that fails
+// the AP is only started by a double reboot, or if no WiFi settings have been saved yet
 // ledPin is the output that drives the indicator led, highForLedOn is true if +volts turns led on, else false if 0V out turns led on
-// EEPROM_offset 0 unless you are using EEPROM in your code in which case pass in the size of the EEPROM your code uses
-// and ESPAutoWiFiConfig will EEPROM addresses after that.
-// AutoConfig uses 148 bytes of EEPROM
+// EEPROM_offset is where earlier versions saved the settings in EEPROM, only used to move them to configStore
 bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset);
 
 /**
@@ -73,6 +76,7 @@ bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset)
    // rest of loop
 */
 // if ESPAutoWiFiConfigLoop() returns true the in AP mode processing setting WiFi SSID/pw/ip settings
+// returns false while connecting, use WiFi.status() to see when the connection is made
 bool ESPAutoWiFiConfigLoop();
 
 // set the RGB led colour on ESP32C OR other ESP32 board using ws2812 addressable RGB led on a GPIO pin
@@ -88,5 +92,12 @@ void ESPAutoWiFiConfig_setColor(uint8_t _red, uint8_t _green, uint8_t _blue);
 // call this to enable debug out for the ESPAutoWiFiConfig code
 void setESPAutoWiFiConfigDebugOut(Stream &out);
 
+// a lost connection is reconnected in place with exponential backoff, restarting the radio every few attempts,
+// the ESP is only restarted if still offline after 15mins, or at the end of config mode
+void setESPAutoWiFiConfigRestartCallback(void (*fn)()); // fn is called just before ESP.restart(), e.g. to save state
+// counts since boot, offline_s includes any current outage
+// dhcpRestarts counts reconnects that associated with the AP but had no DHCP address within 10sec, ESP32 only
+void getWiFiReconnectCounts(uint32_t& disconnects, uint32_t& reconnectAttempts, uint32_t& radioReinits, uint32_t& dhcpRestarts, uint32_t& offline_s);
+
 size_t getESPAutoWiFiConfigEEPROM_Size();
 #endif
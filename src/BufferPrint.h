@@ -0,0 +1,55 @@
+#ifndef BUFFER_PRINT_H
+#define BUFFER_PRINT_H
+/*
+   BufferPrint.h
+*/
+#include <Print.h>
+
+// Print into a caller supplied char buffer, no heap used
+// output that does not fit is dropped, the buffer is always '\0' terminated
+// e.g.
+//   char buf[20];
+//   BufferPrint bufOut(buf, sizeof(buf));
+//   bufOut.print(10); bufOut.print(':');
+class BufferPrint : public Print {
+  public:
+    BufferPrint(char* _buf, size_t _bufSize) : buf(_buf), bufSize(_bufSize), len(0), truncated(false) {
+      if (bufSize) {
+        buf[0] = '\0';
+      }
+    }
+    virtual size_t write(uint8_t c) {
+      if ((len + 1) >= bufSize) {
+        truncated = true;
+        return 0;
+      }
+      buf[len++] = (char)c;
+      buf[len] = '\0';
+      return 1;
+    }
+    size_t length() const {
+      return len;
+    }
+    bool isTruncated() const { // true if some output was dropped
+      return truncated;
+    }
+    const char* c_str() const {
+      return buf;
+    }
+    void clear() {
+      len = 0;
+      truncated = false;
+      if (bufSize) {
+        buf[0] = '\0';
+      }
+    }
+    using Print::write; // for write(const uint8_t *buffer, size_t size) etc
+
+  private:
+    char* buf;
+    size_t bufSize;
+    size_t len;
+    bool truncated;
+};
+
+#endif
@@ -16,8 +16,18 @@
 #include <BLEAdvertisedDevice.h>
 
 #include <WiFiClient.h>
+#include <lwip/sockets.h> // send() MSG_DONTWAIT for the telnet log
 #include <WebServer.h>
 #include "ntpSupport.h"
+#include "LittleFSsupport.h"
+#include "sightingLog.h"
+#include "configStore.h"
+#include "registrySnapshot.h"
+#include "taskStats.h"
+#include "heapStats.h"
+#include "latencyStats.h"
+#include "asyncLog.h"
+#include <millisDelay.h>
 
 static Stream *debugPtr = NULL;
 
@@ -25,11 +35,17 @@ static Stream *debugPtr = NULL;
 #define RGB_BUILTIN 7
 
 static bool firstLoop = true;
+static bool runSNTPserver = false; // set true to serve time to other devices on the LAN, SNTP on port 123
 
 static WebServer server(80);
 static void startWebServer();
 static void startTelnetServer();
 static void handleTelnetConnection();
+static void dumpHeapAlarmToTelnet();
+static void telnetLogSink(const char* line, size_t len);
+static SemaphoreHandle_t telnetMutex = NULL; // telnetServerClients are used by loop() and the asyncLog drain task
+static const unsigned long TELNET_MUTEX_WAIT_MS = 10; // neither side waits longer than this, the log sink only holds the lock to copy the clients
+static const uint16_t LOG_UDP_PORT = 0; // set non-zero to also broadcast the log lines as UDP packets to this port
 
 #include "ESPAutoWiFiConfig.h"
 #include "pfodLinkedPointerList.h" // iterable linked list of pointers to objects
@@ -39,60 +55,121 @@ static void handleTelnetConnection();
 
 // settings for the Auto WiFi connect
 static bool highForLedOn = false; // turns led OFF when WiFi connected
-static size_t eepromOffset = 40; // if you use EEPROM.begin(size) in your code add the size here so AutoWiFi data is written after your data
-// need to add ntpSupport getTimeZoneStorageSize() to this offset
+static size_t eepromOffset = 40; // where earlier versions saved the AutoWiFi data in EEPROM, now only used to move it to configStore
 
 static pfodLinkedPointerList<LastSeen> listOfLastSeen;
+// the advert task adds and updates devices while loop() reads them, hold this while using listOfLastSeen
+// pfodLinkedPointerList has a single shared iterator so reads need it too
+static SemaphoreHandle_t registryMutex = NULL;
+
+static const int64_t SIGHTING_LOG_INTERVAL_MS = 5 * 60 * 1000; // log each device at most every 5mins unless its advert changes
+
+static millisDelay registrySnapshotTimer;
+static const unsigned long REGISTRY_RESTART_SAVE_WAIT_MS = 500; // max wait for registryMutex in saveStateBeforeRestart()
+
+// call before the BLE task starts adding to listOfLastSeen
+// loads the registry snapshot and then only replays the log records written since the snapshot
+static void restoreSightings() {
+  setSightingLogDebug(debugPtr);
+  setRegistrySnapshotDebug(debugPtr);
+  restoreRegistry(listOfLastSeen);
+  registrySnapshotTimer.start(REGISTRY_SNAPSHOT_INTERVAL_MS);
+}
 
-// returns NULL if not found
-static LastSeen* getLastSeen(SafeString &name) {
-  LastSeen *devicePtr = listOfLastSeen.getFirst();
-  while (devicePtr) {
-    if (name.startsWith(devicePtr->getDeviceName())) {
-      return devicePtr;
-    } // else
-    devicePtr = listOfLastSeen.getNext();
+// called by ESPAutoWiFiConfig just before it restarts the ESP
+static void saveStateBeforeRestart() {
+  flushSightingLog();
+  // registryMutex is NULL in config AP mode, the registry was never restored so saving it would overwrite the snapshot with nothing
+  // a bounded wait so a restart is not held up, a skipped save only means more log records to replay at boot
+  saveRegistrySnapshot(listOfLastSeen, registryMutex, pdMS_TO_TICKS(REGISTRY_RESTART_SAVE_WAIT_MS));
+  configCommit();
+}
+
+// call from loop(), checkpoints the registry so a reboot only replays the newest log records
+static void processRegistrySnapshot() {
+  processRegistryRestore(listOfLastSeen, registryMutex); // keeps the restored devices' times when the clock is first set
+  if (registrySnapshotTimer.justFinished()) {
+    registrySnapshotTimer.start(REGISTRY_SNAPSHOT_INTERVAL_MS);
+    saveRegistrySnapshot(listOfLastSeen, registryMutex, portMAX_DELAY); // adverts queue up while the file is written
   }
-  return devicePtr; // null not found
 }
 
 static int scanTime = 2; //In seconds
 static BLEScan *pBLEScan;
 
+// Task layout, stack sizes in bytes, check the minFree column of /stats before changing them
+//  loop()          prio 1  Arduino loop task, web/telnet/NTP and flash writes (sighting log, snapshot, config)
+//  bleScannerTask  prio 1  restarts each scan, the BLE stack calls onResult() from its own task
+//  advertTask      prio 2  updates listOfLastSeen from advertQueue, above loop() so adverts are handled promptly
+static const uint32_t BLE_SCANNER_STACK_SIZE = 8192; // was 102400, only BLEDevice::init() and the scan results use this stack
+static const uint32_t ADVERT_TASK_STACK_SIZE = 4096;
+static const UBaseType_t BLE_SCANNER_PRIORITY = 1;
+static const UBaseType_t ADVERT_TASK_PRIORITY = 2;
+static const UBaseType_t ADVERT_QUEUE_SIZE = 16;
+
+struct advert_struct {
+  int64_t monotonic_ms; // when received
+  char name[SIGHTING_LOG_NAME_SIZE]; // full advertised name
+};
+static QueueHandle_t advertQueue = NULL;
+static volatile uint32_t advertsDropped = 0; // queue full
+
+static TaskHandle_t bleScannerHandle = NULL;
+static TaskHandle_t advertTaskHandle = NULL;
+
+// called from the BLE stack's task, just queue the advert, advertTask does the work
 class AdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
     void onResult(BLEAdvertisedDevice advertisedDevice) {
       if (advertisedDevice.haveName()) {
-        cSF(sfName, 50); // max 32
-        sfName = advertisedDevice.getName().c_str();
-        if (debugPtr) {
-          debugPtr->print("Device name: ");
-          debugPtr->println(sfName);
-        }
-        // only scan for == upto first ,
-        int idx = sfName.indexOf(',');
-        if (idx >= 0) {
-          sfName.substring(sfName, 0, idx);
-          sfName += ',';
+        struct advert_struct advert;
+        advert.monotonic_ms = getMonotonic_ms();
+        strlcpy(advert.name, advertisedDevice.getName().c_str(), sizeof(advert.name));
+        if (xQueueSend(advertQueue, &advert, 0) != pdTRUE) {
+          advertsDropped++;
         }
-
-        LastSeen *devicePtr = getLastSeen(sfName);
-        if (!devicePtr) {
-          // not  found add it upto first ,
-          if (debugPtr) {
-            debugPtr->print("Adding Device name: "); 
-            debugPtr->println(sfName);
-          }
-          devicePtr = new LastSeen(sfName.c_str()); // note MUST use new since pfodLinkedPointerList uses delete when remove() called
-          listOfLastSeen.add(devicePtr);
-        }
-        // update lastseen
-        devicePtr->updateLastSeen(millis());
-        devicePtr->setAdvertisedName(advertisedDevice.getName().c_str()); // save the full name
       }
     }
 };
 
-static TaskHandle_t bleScannerHandle = NULL;
+// call with registryMutex held
+static void processAdvert(const struct advert_struct& advert) {
+  cSF(sfName, 50); // max 32
+  sfName = advert.name;
+  LOG_D("Device name: %s", advert.name);
+  LastSeen *devicePtr = findOrAddLastSeen(listOfLastSeen, sfName);
+  // update lastseen
+  int64_t now_ms = advert.monotonic_ms;
+  devicePtr->updateLastSeen(now_ms);
+  bool advertChanged = (strcmp(devicePtr->getAdvertisedName(), advert.name) != 0);
+  devicePtr->setAdvertisedName(advert.name); // save the full name
+  if (advertChanged || (devicePtr->getLastLogged() == 0) || ((now_ms - devicePtr->getLastLogged()) >= SIGHTING_LOG_INTERVAL_MS)) {
+    if (logSighting(monotonicToEpoch_ms(now_ms), devicePtr->getAdvertisedName())) {
+      devicePtr->setLastLogged(now_ms);
+    }
+  }
+}
+
+// heap users listed when a heap alarm is raised
+static size_t registryHeapBytes() {
+  return listOfLastSeen.size() * (sizeof(LastSeen) + sizeof(pfodPointerListNode<LastSeen>));
+}
+
+static size_t taskHeapBytes() {
+  return ADVERT_TASK_STACK_SIZE + BLE_SCANNER_STACK_SIZE + ASYNC_LOG_TASK_STACK_SIZE + (ADVERT_QUEUE_SIZE * sizeof(struct advert_struct));
+}
+
+void advertTask(void * parameter) {
+  struct advert_struct advert;
+  for (;;) {
+    if (xQueueReceive(advertQueue, &advert, portMAX_DELAY) == pdTRUE) {
+      int64_t start_us = esp_timer_get_time();
+      xSemaphoreTake(registryMutex, portMAX_DELAY);
+      processAdvert(advert);
+      xSemaphoreGive(registryMutex);
+      addTaskWallTime_us(advertTaskHandle, (uint32_t)(esp_timer_get_time() - start_us)); // includes time preempted by the BLE task
+    }
+  }
+}
 
 void BLE_init() {
   BLEDevice::init("");
@@ -110,18 +187,15 @@ void bleScannerTask( void * parameter ) {
   for (;;) {
     pBLEScan->clearResults(); // delete results fromBLEScan buffer to release memory
     BLEScanResults foundDevices = pBLEScan->start(scanTime, false);
-    if (debugPtr) {
-      debugPtr->print("Devices found: ");
-      debugPtr->print(foundDevices.getCount());
-      debugPtr->print(" on ");
-      debugPtr->println(WiFi.localIP());
-    }
+    IPAddress ip = WiFi.localIP();
+    LOG_D("Devices found: %d on %u.%u.%u.%u", foundDevices.getCount(), ip[0], ip[1], ip[2], ip[3]);
     yield();
   }
   /* delete a task when finished, this will never happen because this is an infinite loop */
   vTaskDelete( NULL );
 }
 
+// the listeners only need the WiFi driver started, they work once the connection is made
 void setUpWiFiServices() {
   setNtpSupportDebug(debugPtr);
   initializeNtpSupport();
@@ -130,7 +204,45 @@ void setUpWiFiServices() {
   startTelnetServer();
 }
 
+// called from loop() on the first connection and again if a reconnect gets a different address, these need the LAN address
+void startConnectedServices() {
+  if (debugPtr) {
+    debugPtr->print("Starting LAN services on "); debugPtr->println(WiFi.localIP());
+  }
+  if (runSNTPserver) {
+    enableSNTPserver(false); // does nothing the first time, after a reconnect the listener is started again on the new address
+    enableSNTPserver(true);
+  }
+  if (LOG_UDP_PORT) {
+    setAsyncLogUdp(WiFi.broadcastIP(), LOG_UDP_PORT);
+  }
+}
+
 static uint32_t chipId = 0;
+static uint32_t connectedServicesIP = 0; // WiFi.localIP() when startConnectedServices() was last called, 0 if not yet
+
+// latency stage ids for each part of loop(), shown on /stats
+static int loopLatency = -1; // whole loop() including the yields
+static int sightingLogLatency = -1;
+static int autoWiFiLatency = -1;
+static int webServerLatency = -1; // all of handleClient(), the routes are also timed separately
+static int ntpLatency = -1;
+static int configStoreLatency = -1;
+static int snapshotLatency = -1;
+static int heapStatsLatency = -1;
+static int telnetLatency = -1;
+
+static void registerLoopLatencyStages() {
+  loopLatency = registerLatencyStage("loop");
+  sightingLogLatency = registerLatencyStage("processSightingLog");
+  autoWiFiLatency = registerLatencyStage("ESPAutoWiFiConfigLoop");
+  webServerLatency = registerLatencyStage("handleClient");
+  ntpLatency = registerLatencyStage("processNTP");
+  configStoreLatency = registerLatencyStage("processConfigStore");
+  snapshotLatency = registerLatencyStage("processRegistrySnapshot");
+  heapStatsLatency = registerLatencyStage("processHeapStats");
+  telnetLatency = registerLatencyStage("handleTelnetConnection");
+}
 
 void setup() {
   Serial.begin(115200);
@@ -140,6 +252,11 @@ void setup() {
   debugPtr = &Serial;
   debugPtr->println();
 #endif
+  initializeAsyncLog(debugPtr); // first so the LOG_x calls are not dropped
+  telnetMutex = xSemaphoreCreateMutex();
+  addAsyncLogSink(telnetLogSink);
+
+  registerLoopLatencyStages(); // before config mode so ESPAutoWiFiConfigLoop() is timed there too
 
   for(int i=0; i<17; i=i+8) 
   {
@@ -149,28 +266,55 @@ void setup() {
   /* Initialise wifi module */
 #ifdef DEBUG
   setESPAutoWiFiConfigDebugOut(Serial); // turns on debug output for the ESPAutoWiFiConfig code
+  setConfigStoreDebug(&Serial);
 #endif
   
+  setESPAutoWiFiConfigRestartCallback(saveStateBeforeRestart);
   if (ESPAutoWiFiConfigSetup(-RGB_BUILTIN, highForLedOn, eepromOffset)) { // check if we should start access point to configure WiFi settings
     return; // in config mode so skip rest of setup
   }
 
+  setHeapStatsDebug(debugPtr);
+  initializeHeapStats();
+  registerHeapUser("registry", registryHeapBytes);
+  registerHeapUser("tasks+advertQueue", taskHeapBytes);
+  restoreSightings(); // before the BLE task starts
   setUpWiFiServices(); // do this first. Get continual reboots if create BLE task first and then call this
 
+  registerTaskStats(xTaskGetCurrentTaskHandle(), "loop", getArduinoLoopTaskStackSize()); // stack only, loop() polls so is not timed
+  registryMutex = xSemaphoreCreateMutex();
+  advertQueue = xQueueCreate(ADVERT_QUEUE_SIZE, sizeof(struct advert_struct));
   BaseType_t err = xTaskCreate(
+                     advertTask,
+                     "advertTask",
+                     ADVERT_TASK_STACK_SIZE,
+                     NULL,
+                     ADVERT_TASK_PRIORITY,
+                     &advertTaskHandle);
+  if (err != pdPASS && debugPtr) {
+      debugPtr->print("xTaskCreate advertTask returned:");
+      debugPtr->println((int)err);
+  }
+  registerTaskStats(advertTaskHandle, "advertTask", ADVERT_TASK_STACK_SIZE);
+  // start scanning now, WiFi connects in the background, loop() calls startConnectedServices() once connected, and again if the address changes
+  err = xTaskCreate(
                      bleScannerTask,
                      "bleScannerTask",
-                     102400,
+                     BLE_SCANNER_STACK_SIZE,
                      NULL,
-                     1,
+                     BLE_SCANNER_PRIORITY,
                      &bleScannerHandle);
-  if (err != (BaseType_t)1 && debugPtr) {
-      debugPtr->print("xTaskCreatePinnedToCore returned:");
+  if (err != pdPASS && debugPtr) {
+      debugPtr->print("xTaskCreate bleScannerTask returned:");
       debugPtr->println((int)err);
   }
+  registerTaskStats(bleScannerHandle, "bleScannerTask", BLE_SCANNER_STACK_SIZE);
+  registerTaskStats(getAsyncLogTaskHandle(), "asyncLogTask", ASYNC_LOG_TASK_STACK_SIZE);
 }
 
 void loop() {
+  uint32_t loopStart = latencyStart();
+  uint32_t start;
 
   if (firstLoop && debugPtr) {
     debugPtr->printf("ESP32 Chip model = %s Rev %d\n", ESP.getChipModel(), ESP.getChipRevision());
@@ -180,16 +324,52 @@ void loop() {
     firstLoop = false;
   }
 
-  if (ESPAutoWiFiConfigLoop()) { 
+  start = latencyStart();
+  processSightingLog(); // sightings are saved while connecting and in config mode
+  latencyEnd(sightingLogLatency, start);
+  yield();
+  start = latencyStart();
+  bool inConfigMode = ESPAutoWiFiConfigLoop();
+  latencyEnd(autoWiFiLatency, start);
+  if (inConfigMode) {
+    latencyEnd(loopLatency, loopStart);
     return;
   }
 
+  bool connected = (WiFi.status() == WL_CONNECTED);
+  if (connected && ((uint32_t)WiFi.localIP() != connectedServicesIP)) {
+    // first connection, the BLE task has been collecting sightings since setup(), or a reconnect with a new DHCP address
+    connectedServicesIP = (uint32_t)WiFi.localIP();
+    startConnectedServices();
+  }
+  start = latencyStart();
   server.handleClient();
+  latencyEnd(webServerLatency, start);
+  yield();
+  if (connected) { // no NTP requests or server lookups while offline
+    start = latencyStart();
+    processNTP();
+    latencyEnd(ntpLatency, start);
+    yield();
+  }
+  start = latencyStart();
+  processConfigStore();
+  latencyEnd(configStoreLatency, start);
   yield();
-  processNTP();
+  start = latencyStart();
+  processRegistrySnapshot();
+  latencyEnd(snapshotLatency, start);
   yield();
+  start = latencyStart();
+  if (processHeapStats()) {
+    dumpHeapAlarmToTelnet();
+  }
+  latencyEnd(heapStatsLatency, start);
+  start = latencyStart();
   handleTelnetConnection();
+  latencyEnd(telnetLatency, start);
   yield();
+  latencyEnd(loopLatency, loopStart);
 }
 
 // ------------------ trival telnet server -------------------------
@@ -209,7 +389,87 @@ void startTelnetServer() {
   }
 }
 
+// heap alarms are also sent to any telnet clients
+void dumpHeapAlarmToTelnet() {
+  if (xSemaphoreTake(telnetMutex, pdMS_TO_TICKS(TELNET_MUTEX_WAIT_MS)) != pdTRUE) {
+    return; // the alarm is also on Serial
+  }
+  for (uint8_t i = 0; i < MAX_SRV_CLIENTS; i++) {
+    if (telnetServerClients[i] && telnetServerClients[i].connected()) {
+      streamHeapAlarmDump(telnetServerClients[i]);
+    }
+  }
+  xSemaphoreGive(telnetMutex);
+}
+
+// called from the asyncLog drain task
+// the clients are copied under the lock and written after it is released, with MSG_DONTWAIT, so a slow client never holds up
+// loop() or the drain task, if the client's socket buffer is full the line is cut short or dropped
+void telnetLogSink(const char* line, size_t len) {
+  WiFiClient clients[MAX_SRV_CLIENTS];
+  if (xSemaphoreTake(telnetMutex, pdMS_TO_TICKS(TELNET_MUTEX_WAIT_MS)) != pdTRUE) {
+    return; // loop() is accepting a client, skip this line for telnet
+  }
+  for (uint8_t i = 0; i < MAX_SRV_CLIENTS; i++) {
+    clients[i] = telnetServerClients[i]; // shares the socket, it stays open until this copy goes even if loop() stops the client
+  }
+  xSemaphoreGive(telnetMutex);
+  for (uint8_t i = 0; i < MAX_SRV_CLIENTS; i++) {
+    if (clients[i] && clients[i].connected() && (clients[i].fd() >= 0)) {
+      send(clients[i].fd(), line, len, MSG_DONTWAIT);
+    }
+  }
+}
+
+// telnet commands, anything else is passed to the UART
+//   heap                         prints the heap stats and top heap users
+//   heapalarm <minFree> <minLargestBlock>  sets the heap alarm thresholds, 0 disables a check
+// returns true if the client's input was a command
+bool handleTelnetCommand(WiFiClient& client) {
+  int c = client.peek();
+  if ((c != 'h') && (c != 'H')) {
+    return false;
+  }
+  cSF(sfCmd, 60);
+  while (client.available() && (!sfCmd.endsWith("\n"))) {
+    sfCmd += (char)client.read();
+  }
+  sfCmd.trim();
+  if (sfCmd.equalsIgnoreCase("heap")) {
+    streamHeapAlarmDump(client);
+    return true;
+  }
+  if (sfCmd.startsWithIgnoreCase("heapalarm")) {
+    cSF(sfField, 12);
+    uint32_t values[2];
+    int values_idx = 0;
+    int idx = sfCmd.stoken(sfField, 0, " "); // skip heapalarm
+    while ((values_idx < 2) && (idx >= 0)) {
+      idx = sfCmd.stoken(sfField, idx, " ");
+      long value;
+      if ((!sfField.isEmpty()) && sfField.toLong(value) && (value >= 0)) {
+        values[values_idx++] = (uint32_t)value;
+      }
+    }
+    if (values_idx == 2) {
+      setHeapAlarmThresholds(values[0], values[1]);
+    } else {
+      client.println("usage: heapalarm <minFree> <minLargestBlock>");
+    }
+    streamHeapStats(client);
+    return true;
+  }
+  // not a command, pass it on
+  Serial.println();
+  Serial.print(" >>>> Telnet:");
+  Serial.println(sfCmd);
+  return true;
+}
+
 void handleTelnetConnection() {
+  if (xSemaphoreTake(telnetMutex, pdMS_TO_TICKS(TELNET_MUTEX_WAIT_MS)) != pdTRUE) {
+    return; // try again next loop()
+  }
   //check if there are any new clients
   uint8_t i;
   if (telnetServer.hasClient()) {
@@ -240,6 +500,9 @@ void handleTelnetConnection() {
   for (i = 0; i < MAX_SRV_CLIENTS; i++) {
     if (telnetServerClients[i] && telnetServerClients[i].connected()) {
       if (telnetServerClients[i].available()) {
+        if (handleTelnetCommand(telnetServerClients[i])) {
+          continue;
+        }
 
         //get data from the telnet client and push it to the UART
         Serial.println();
@@ -268,16 +531,17 @@ void handleTelnetConnection() {
       }
     }
   }
+  xSemaphoreGive(telnetMutex);
 }
 
 void notFound() {
   server.send(404, "text/plain", "Not found");
 }
 
+static unsigned long firstResponse_ms = 0; // millis() from boot to the first page sent, 0 until then
+
 void handleRoot() {
-  if (debugPtr) {
-    debugPtr->println(">>> WebServer handleRoot");
-  }
+  LOG_D(">>> WebServer handleRoot");
   String msg = "<html>\
   <head>\
     <meta http-equiv='refresh' content='5'/>\
@@ -287,17 +551,19 @@ void handleRoot() {
     </style>\
   </head>\
   <body>";
-  time_t now;
   msg += "TimeZone: ";
   msg += getCurrentTZ();
   msg += "<br>";
   msg += getCurrentTZdescription();
   msg += "<p>At ";
-  now = time(nullptr); 
-  msg += ctime(&now);
+  char timeStr[TIME_ISO8601_STR_SIZE];
+  formatISO8601Local(time(nullptr), timeStr, sizeof(timeStr));
+  msg += timeStr;
   msg += "<br>";
   msg += "The BLE devices found were:-<br>";
   
+  xSemaphoreTake(registryMutex, portMAX_DELAY);
+  int64_t now_ms = getMonotonic_ms();
   LastSeen *devicePtr = listOfLastSeen.getFirst();
   msg += "<h1>";
   if (devicePtr == NULL) {
@@ -306,21 +572,167 @@ void handleRoot() {
     while (devicePtr != NULL) {
       msg += devicePtr->getAdvertisedName();
       msg += "<font size=\"-1\"> ";
-      msg += (millis() - devicePtr->getLastSeen()) / 1000.0;
+      int64_t age_ms = now_ms - devicePtr->getLastSeen();
+      if (age_ms < 0) {
+        age_ms = 0; // seen again by the BLE task since now_ms was read
+      }
+      uint32_t age_cs = (uint32_t)(age_ms / 10); // 1/100 sec
+      msg += age_cs / 100;
+      msg += '.';
+      if ((age_cs % 100) < 10) {
+        msg += '0';
+      }
+      msg += age_cs % 100;
       msg += " sec ago</font>";
       msg += "<br>";
       devicePtr = listOfLastSeen.getNext();
     }
   }
+  xSemaphoreGive(registryMutex);
   msg += "</h1>";
   msg += "</body></html>";
 
   server.send(200, "text/html", msg);
+  if (firstResponse_ms == 0) {
+    firstResponse_ms = millis(); // boot to online, includes the WiFi connect
+    if (debugPtr) {
+      debugPtr->print("Boot to first HTTP response "); debugPtr->print(firstResponse_ms); debugPtr->println("ms");
+    }
+  }
+}
+
+// collects Print output and sends it as HTTP chunks, call server.setContentLength(CONTENT_LENGTH_UNKNOWN) and server.send() first
+// and flush() at the end
+class WebChunkPrint : public Print {
+  public:
+    size_t write(uint8_t c) {
+      buf[len++] = c;
+      if (len >= sizeof(buf)) {
+        flush();
+      }
+      return 1;
+    }
+    using Print::write;
+    void flush() {
+      if (len) {
+        server.sendContent((const char*)buf, len);
+        len = 0;
+      }
+    }
+  private:
+    uint8_t buf[256];
+    size_t len = 0;
+};
+
+// /stats  task stack use and advertTask wall time, heap, loop and route latencies, queue and log counters as text
+// /stats?reset=latency  clears the latency histograms after showing them, e.g. to compare before and after a change
+void handleStats() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  WebChunkPrint out;
+  out.print("uptime_s "); out.println((uint32_t)(esp_timer_get_time() / 1000000));
+  out.println();
+  streamTaskStats(out);
+  out.println();
+  streamHeapStats(out);
+  out.println();
+  streamLatencyStats(out);
+  if (server.arg("reset") == "latency") {
+    resetLatencyStats();
+    out.println("latency stats reset");
+  }
+  out.println();
+  out.print("adverts queued "); out.print(uxQueueMessagesWaiting(advertQueue));
+  out.print(" dropped "); out.println(advertsDropped);
+  uint32_t logged, dropped, flushes;
+  getSightingLogCounts(logged, dropped, flushes);
+  out.print("sightings logged "); out.print(logged); out.print(" dropped "); out.print(dropped);
+  out.print(" flushes "); out.println(flushes);
+  uint32_t disconnects, reconnectAttempts, radioReinits, dhcpRestarts, offline_s;
+  getWiFiReconnectCounts(disconnects, reconnectAttempts, radioReinits, dhcpRestarts, offline_s);
+  out.print("wifi disconnects "); out.print(disconnects); out.print(" reconnects "); out.print(reconnectAttempts);
+  out.print(" radioReinits "); out.print(radioReinits); out.print(" dhcpRestarts "); out.print(dhcpRestarts);
+  out.print(" offline_s "); out.println(offline_s);
+  uint32_t logLines, logDropped, logTruncated;
+  getAsyncLogCounts(logLines, logDropped, logTruncated);
+  out.print("log lines "); out.print(logLines); out.print(" dropped "); out.print(logDropped);
+  out.print(" truncated "); out.println(logTruncated);
+  out.flush();
+  server.sendContent(""); // end chunked response
+}
+
+// /files?dir=/log  lists files and sizes as text
+void handleFiles() {
+  String dir = server.hasArg("dir") ? server.arg("dir") : String("/");
+  if (!isSafePath(dir.c_str())) {
+    server.send(400, "text/plain", "Bad dir");
+    return;
+  }
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  WebChunkPrint out;
+  if (streamDirListing(dir.c_str(), out) < 0) {
+    out.print("Not a directory\r\n");
+  }
+  out.flush();
+  server.sendContent(""); // end of chunks
+}
+
+// only the sighting log segments can be downloaded, never the config store, it holds the WiFi settings
+static bool isDownloadAllowed(const char* path) {
+  static const char logDirPrefix[] = SIGHTING_LOG_DIR "/";
+  if ((!isSafePath(path)) || isConfigStoreFile(path)) {
+    return false;
+  }
+  return (strncmp(path, logDirPrefix, sizeof(logDirPrefix) - 1) == 0) && (strstr(path, "//") == NULL);
+}
+
+// /download?file=/log/seg00000000.bin  sends the file straight from the FS in chunks
+void handleDownload() {
+  String path = server.arg("file");
+  if (!isSafePath(path.c_str())) {
+    server.send(400, "text/plain", "Bad file");
+    return;
+  }
+  if (!isDownloadAllowed(path.c_str())) {
+    server.send(403, "text/plain", "Forbidden");
+    return;
+  }
+  int32_t size = getFileSize(path.c_str());
+  if (size < 0) {
+    notFound();
+    return;
+  }
+  server.setContentLength(size);
+  server.send(200, "application/octet-stream", "");
+  WiFiClient client = server.client();
+  int32_t sent = streamFile(path.c_str(), client);
+  if ((sent != size) && debugPtr) {
+    debugPtr->print("download "); debugPtr->print(path); debugPtr->print(" sent "); debugPtr->print(sent); debugPtr->print(" of "); debugPtr->println(size);
+  }
+}
+
+// registers the handler for uri and times it into a latency stage named uri
+static void onTimed(const char* uri, WebServer::THandlerFunction handler) {
+  int stageId = registerLatencyStage(uri);
+  server.on(uri, [stageId, handler]() {
+    uint32_t start = latencyStart();
+    handler();
+    latencyEnd(stageId, start);
+  });
 }
 
 void startWebServer() {
-  server.on("/", handleRoot);
-  server.onNotFound(notFound);
+  onTimed("/", handleRoot);
+  onTimed("/files", handleFiles);
+  onTimed("/stats", handleStats);
+  onTimed("/download", handleDownload);
+  int notFoundStage = registerLatencyStage("notFound");
+  server.onNotFound([notFoundStage]() {
+    uint32_t start = latencyStart();
+    notFound();
+    latencyEnd(notFoundStage, start);
+  });
   server.begin();
   if (debugPtr) {
     debugPtr->println("webserver started");
@@ -60,7 +60,7 @@
 #if defined(ESP8266)
 
 // just use normal PinFlasher if a -ve pin passed in to ESPAutoWiFiConfig
-ESP32_WS2812Flasher::ESP32_WS2812Flasher(int16_t p, bool invert)
+ESP32_WS2812Flasher::ESP32_WS2812Flasher(int16_t p, bool invert, uint16_t numPixels)
   : PinFlasher(p,invert) {
 }
 
@@ -73,22 +73,42 @@ ESP32_WS2812Flasher::ESP32_WS2812Flasher(int16_t p, bool invert)
 
 /*!
   @param   p  Arduino pin number which will drive the NeoPixel data in.
+  @param   numPixels  Number of NeoPixels in the strip, pixel 0 flashes
 */
-ESP32_WS2812Flasher::ESP32_WS2812Flasher(int16_t p, bool invert)
-  : PinFlasher(p), is800KHz(true), endTime(0) {
+ESP32_WS2812Flasher::ESP32_WS2812Flasher(int16_t p, bool invert, uint16_t numPixels)
+  : PinFlasher(p), is800KHz(true) {
   outputInverted = invert; // for ws2812 inverted output means PIN_OFF leave led on
   //updateType(NEO_GRB + NEO_KHZ800);
   rOffset = (NEO_GRB >> 4) & 0b11; // regarding R/G/B/W offsets
   gOffset = (NEO_GRB >> 2) & 0b11;
   bOffset = NEO_GRB & 0b11;
   pixels = pixelArray;
-  numBytes = 3;
+  numLEDs = 1;
+  if (numPixels > 1) {
+    pixels = (uint8_t *)malloc(numPixels * 3);
+    if (pixels) {
+      numLEDs = numPixels;
+    } else {
+      pixels = pixelArray; // just drive the first led
+    }
+  }
+  numBytes = numLEDs * 3;
+  memset(pixels, 0, numBytes);
   // set light green default
   red = 0;
   green = 128;
   blue = 0;
 }
 
+ESP32_WS2812Flasher::~ESP32_WS2812Flasher() {
+  if (pixels != pixelArray) {
+    free(pixels);
+  }
+}
+
+uint16_t ESP32_WS2812Flasher::numPixels() {
+  return numLEDs;
+}
 
 /**
    set the output based on io_pin, io_pin_on and outputInverted.
@@ -116,69 +136,36 @@ void ESP32_WS2812Flasher::setOutput() { // uses class vars io_pin and io_pin_on
 
 
 // ESP32 show() is external to enforce ICACHE_RAM_ATTR execution
+// espShow() copies the pixels and returns, the RMT driver sends them and enforces the latch time
 extern "C" IRAM_ATTR void espShow(uint16_t io_pin, uint8_t *pixels, uint32_t numBytes, uint8_t type);
+extern "C" bool espShowBusy(void);
+// the RMT channel stays installed between show() calls, call this to free it for other uses
+extern "C" void espShowRelease(void);
 
 /*!
-  @brief   Check whether a call to show() will start sending data
-           immediately or will 'block' for a required interval. NeoPixels
+  @brief   Check whether the last show() has finished. NeoPixels
            require a short quiet time (about 300 microseconds) after the
            last bit is received before the data 'latches' and new data can
-           start being received. Usually one's sketch is implicitly using
-           this time to generate a new frame of animation...but if it
-           finishes very quickly, this function could be used to see if
-           there's some idle time available for some low-priority
-           concurrent task.
-  @return  1 or true if show() will start sending immediately, 0 or false
-           if show() would block (meaning some idle time is available).
+           start being received. show() never waits for this, a frame
+           shown while busy is sent once the latch time has passed and
+           replaces any earlier frame still waiting.
+  @return  1 or true if the last frame has been sent and latched, 0 or false
+           if it is still being sent or waiting to be sent.
 */
 bool ESP32_WS2812Flasher::canShow(void) {
-  // It's normal and possible for endTime to exceed micros() if the
-  // 32-bit clock counter has rolled over (about every 70 minutes).
-  // Since both are uint32_t, a negative delta correctly maps back to
-  // positive space, and it would seem like the subtraction below would
-  // suffice. But a problem arises if code invokes show() very
-  // infrequently...the micros() counter may roll over MULTIPLE times in
-  // that interval, the delta calculation is no longer correct and the
-  // next update may stall for a very long time. The check below resets
-  // the latch counter if a rollover has occurred. This can cause an
-  // extra delay of up to 300 microseconds in the rare case where a
-  // show() call happens precisely around the rollover, but that's
-  // neither likely nor especially harmful, vs. other code that might
-  // stall for 30+ minutes, or having to document and frequently remind
-  // and/or provide tech support explaining an unintuitive need for
-  // show() calls at least once an hour.
-  uint32_t now = micros();
-  if (endTime > now) {
-    endTime = now;
-  }
-  return (now - endTime) >= 300L;
+  return !espShowBusy();
 }
 
 
 /*!
-  @brief   Transmit pixel data in RAM to NeoPixels.
+  @brief   Queue the pixel data in RAM to be sent to the NeoPixels.
+           Returns immediately, so LED changes do not hold up loop()
 */
 void ESP32_WS2812Flasher::show(void) {
   if (io_pin < 0) {
     return;
   }
-  // Data latch = 300+ microsecond pause in the output stream. Rather than
-  // put a delay at the end of the function, the ending time is noted and
-  // the function will simply hold off (if needed) on issuing the
-  // subsequent round of data until the latch time has elapsed. This
-  // allows the mainline code to start generating the next frame of data
-  // rather than stalling for the latch.
-  while (!canShow()) {
-    ;
-  }
-  // ESP8266 ----------------------------------------------------------------
-
-  // ESP8266 show() is external to enforce ICACHE_RAM_ATTR execution
   espShow(io_pin, pixels, numBytes, is800KHz);
-
-  // END ARCHITECTURE SELECT ------------------------------------------------
-
-  endTime = micros(); // Save EOD time for latch on next call
 }
 
 
@@ -197,16 +184,29 @@ void ESP32_WS2812Flasher::setColor(uint8_t r, uint8_t g, uint8_t b) {
 }
 
 /*!
-  @brief   Set a pixel's color using separate red, green and blue
-           components. If using RGBW pixels, white will be set to 0.
+  @brief   Set the first pixel's color, the one that flashes
   @param   r  Red brightness, 0 = minimum (off), 255 = maximum.
   @param   g  Green brightness, 0 = minimum (off), 255 = maximum.
   @param   b  Blue brightness, 0 = minimum (off), 255 = maximum.
 */
 void ESP32_WS2812Flasher::setPixelColor(uint8_t _r, uint8_t _g,  uint8_t _b) {
-  // size_t n = 0; // only handle one led
+  setPixelColor(0, _r, _g, _b);
+}
+
+/*!
+  @brief   Set a pixel's color using separate red, green and blue
+           components. Call show() to send the changes.
+  @param   n  Pixel index, starting from 0, ignored if >= numPixels()
+  @param   r  Red brightness, 0 = minimum (off), 255 = maximum.
+  @param   g  Green brightness, 0 = minimum (off), 255 = maximum.
+  @param   b  Blue brightness, 0 = minimum (off), 255 = maximum.
+*/
+void ESP32_WS2812Flasher::setPixelColor(uint16_t n, uint8_t _r, uint8_t _g,  uint8_t _b) {
+  if (n >= numLEDs) {
+    return;
+  }
   uint8_t *p;
-  p = &pixels[0 * 3];     // 3 bytes per pixel  n is always 0 here
+  p = &pixels[n * 3];     // 3 bytes per pixel
   p[rOffset] = _r; // R,G,B always stored
   p[gOffset] = _g;
   p[bOffset] = _b;
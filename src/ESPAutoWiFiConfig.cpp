@@ -12,11 +12,15 @@
 */
 
 #include "ESPAutoWiFiConfig.h"
-#include <EEPROM.h>
+#include <EEPROM.h> // only used to move settings saved by earlier versions to configStore
+#include "configStore.h"
 
 #ifdef ESP_PLATFORM   // ESP32
 #include <WiFi.h>
 #include <WebServer.h>
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/dhcp.h"
 #else  // ESP8266
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
@@ -53,7 +57,7 @@ static char wifiWebConfigPASSWORD[] = "12345678";
 static IPAddress dns1(8, 8, 8, 8);
 static IPAddress dns2(8, 8, 8, 4);
 
-// ============== EEPROM addresses used  =======================
+// ============== settings, kept in configStore  =======================
 static const int MAX_SSID_LEN_CONFIG = 32;
 static const int MAX_PASSWORD_LEN_CONFIG = 64;
 static const int MAX_STATICIP_LEN_CONFIG = 40;
@@ -64,14 +68,32 @@ struct WiFi_CONFIG_storage_struct {
   char staticIP[MAX_STATICIP_LEN_CONFIG + 1]; // staticIP, if empty use DHCP + null
 };
 
+// cached from the last successful connection, used to skip the channel scan, and DHCP while the lease is still valid
+struct WiFi_FAST_CONNECT_struct {
+  char ssid[MAX_SSID_LEN_CONFIG + 1]; // only used if this is still the configured ssid
+  uint8_t bssid[6];
+  int32_t channel; // 0 => nothing cached
+  uint32_t ip; // DHCP lease, ip == 0 if none, e.g. static IP
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns1;
+  uint32_t dns2;
+  int64_t leaseStart_s; // time() when the lease was obtained, 0 if the clock was not set
+  uint32_t leaseRenew_s; // DHCP T1, the lease is only reused before leaseStart_s + leaseRenew_s
+};
+
+static const char wifiConfigKey[] = "wifi"; // configStore keys
+static const char rebootFlagKey[] = "reboot";
+static const char wifiFastConnectKey[] = "wifiFast";
+// earlier versions used EEPROM at these addresses
 static const size_t wifiConfigFileAddress = 8;  // binary data , added to eepromOffset with a little padding
 static size_t rebootDetectionFileAddress; // sizeof(WiFi_CONFIG_storage_struct) rounded up, added to eepromOffset
 static const uint8_t REBOOT_ACTIVE = 21;   // 0b010101
 static const uint8_t REBOOT_INACTIVE = 42; // 0b101010
 
-//======== EEPROM methods ========
+//======== config methods ========
 static size_t eepromOffset = 0; // default
-static void startEEPROM(); // start 512 size eeprom way  more then is needed
+static void startConfig(); // loads settings, moving them from EEPROM the first time
 static bool checkValidRebootFlag();
 static void writeRebootFlag();
 static void clearRebootFlag();
@@ -91,8 +113,38 @@ static const unsigned long RESTART_AFTER_CONFIG_MS = 30ul * 1000; // 30 sec afte
 static millisDelay doubleRebootTimer; // timer for double reboot, two reboots within 10sec starts config AccessPoint
 static const unsigned long DOUBLE_REBOOT_MS = 10UL * 1000; // 10 sec
 
-static millisDelay lostConnectionRebootTimer; // timer for when connect to AP lost, after 30sec reboot to clear state and try from scratch again
-static const unsigned long LOST_CONNECTION_REBOOT_MS = 30UL * 1000; // 10 sec
+// when the connection is lost, reconnect in place with exponential backoff, every RECONNECTS_PER_RADIO_REINIT'th
+// attempt stops and restarts the radio and does a full scan connect, only restart if still offline after WEDGE_RESTART_MS
+static millisDelay reconnectTimer; // next reconnect attempt
+static millisDelay wedgeRestartTimer; // offline this long => wedged, restart from scratch
+static millisDelay dhcpWaitTimer; // associated with the AP but no DHCP address
+static const unsigned long RECONNECT_FIRST_MS = 2UL * 1000; // doubles each attempt
+static const unsigned long RECONNECT_MAX_MS = 60UL * 1000;
+static const uint32_t RECONNECTS_PER_RADIO_REINIT = 4;
+static const unsigned long WEDGE_RESTART_MS = 15UL * 60 * 1000; // 15mins
+static const unsigned long DHCP_WAIT_MS = 10UL * 1000;
+static bool offline = false;
+static unsigned long offlineStart_ms = 0;
+static uint32_t reconnectStep = 0; // attempts in this outage
+static uint32_t disconnectCount = 0;
+static uint32_t reconnectAttemptCount = 0;
+static uint32_t radioReinitCount = 0;
+static uint32_t dhcpRestartCount = 0;
+// set by the STA_CONNECTED/STA_DISCONNECTED events, WiFi.status() is not WL_CONNECTED until STA_GOT_IP so it cannot see "associated but no IP"
+static volatile bool staAssociated = false;
+static volatile uint32_t staAssociationCount = 0;
+static uint32_t dhcpWaitAssociation = 0; // staAssociationCount the DHCP wait was started for
+static bool dhcpRestarted = false; // DHCP restarted for this association
+static uint32_t offlineTotal_ms = 0; // finished outages, see getWiFiReconnectCounts()
+static void (*restartCallback)() = NULL;
+
+static const unsigned long CONNECT_MS = 30UL * 1000; // full scan connect
+static const unsigned long FAST_CONNECT_MS = 5UL * 1000; // cached BSSID/channel connect, then fall back to a full scan
+static const int64_t MIN_VALID_TIME_S = 1577836800; // 2020-01-01, time() less than this => clock not set
+static const uint32_t MAX_LEASE_REUSE_S = 24UL * 60 * 60; // never reuse a lease for longer than this
+static millisDelay leaseRenewTimer; // running while using a reused DHCP lease, restart DHCP before the lease needs renewing
+static bool saveLeaseWhenBound = false; // set when DHCP restarted, cache the new lease once it is bound
+static struct WiFi_FAST_CONNECT_struct fastConnect;
 
 static struct WiFi_CONFIG_storage_struct storage; // the gobal wifi config
 
@@ -100,8 +152,20 @@ static void saveWiFiConfig(); // returns pointer to wifi config storage or defau
 static void loadWiFiConfig(); // returns pointer to wifi config storage or default values (if any)
 static void printWifConfig(Stream *out);
 
-static bool tryToConnectToConfiguredWiFiNetwork();
+static void startConnecting();
+static bool processConnecting();
+static void saveFastConnect(bool saveLease);
+static void processLeaseRenew();
+static void processReconnect();
+static void processConnected();
+static bool processDhcpWait();
+#ifdef ESP_PLATFORM
+static void onStaConnected(arduino_event_id_t event);
+static void onStaDisconnected(arduino_event_id_t event);
+#endif
+static void restartNow();
 static void setupAP();
+static void processAPScan();
 
 // save colours here until ESPAutoWiFiConfigSetup called
 static uint8_t red = 0;
@@ -145,10 +209,11 @@ bool defaultNetworkSettings() {
    // rest of setup
 */
 // if ESPAutoWiFiConfigSetup() returns true the in AP mode waiting for connection to set WiFi SSID/pw/ip settings
+// else it returns straight away and ESPAutoWiFiConfigLoop() connects in the background, retrying with backoff if that fails
+// the AP is only started by a double reboot, or if no WiFi settings have been saved yet
 // ledPin is the output that drives the indicator led, 
 // highForLedOn is true if +volts turns led on, else false if 0V out turns led on
-// EEPROM_offset 0 unless you are using EEPROM in your code in which case pass in the size of the EEPROM your code uses
-// and ESPAutoWiFiConfig will EEPROM addresses after that.
+// EEPROM_offset is where earlier versions saved the settings in EEPROM, only used to move them to configStore
 // Normally the led will turn OFF once the WiFi connects
 // NOTE: if you want the led to stay ON, pass in the opposite value for highForLedOn, 
 //  i.e.  highForLedOn = false true if +volts turns led on, highForLedOn = true if 0V out turns led on 
@@ -156,7 +221,7 @@ bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset)
   bool outputInverted = !highForLedOn; // normal is highForOn
   eepromOffset = EEPROM_offset; 
   rebootDetectionFileAddress = (sizeof(WiFi_CONFIG_storage_struct) + 3) & (~3); // rounded up
-  startEEPROM(); // uses eepromOffset and getESPAutoWiFiConfigEEPROM_Size()
+  startConfig(); // uses eepromOffset and getESPAutoWiFiConfigEEPROM_Size() to find old settings
   if (ledPin < 0) {
 #if defined(ESP32)
     ledPin = -ledPin;
@@ -184,12 +249,22 @@ bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset)
   WiFi.mode(WIFI_OFF); // force begin
   WiFi.setAutoConnect(false); // does not work for static ip see https://github.com/esp8266/Arduino/issues/2735
   WiFi.setAutoReconnect(true); // try to reconnect if we loose the connection
+#ifdef ESP_PLATFORM
+  WiFi.onEvent(onStaConnected, ARDUINO_EVENT_WIFI_STA_CONNECTED);
+  WiFi.onEvent(onStaDisconnected, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+#endif
   if ((!checkValidRebootFlag()) || rebootFlagExists()) {
     // double reboot so start wifi config
     clearRebootFlag();
     setupAP(); // sets inConfigMode
     return true;
   }
+  loadWiFiConfig();
+  if (storage.ssid[0] == '\0') {
+    // never configured, nothing to retry, the AP is the only way to set the WiFi
+    setupAP(); // sets inConfigMode
+    return true;
+  }
   // else  continue and try to connect
   // create reboot file now
   if (debugPtr) {
@@ -198,22 +273,8 @@ bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset)
   writeRebootFlag();
   doubleRebootTimer.start(DOUBLE_REBOOT_MS);
 
-  if (tryToConnectToConfiguredWiFiNetwork()) {
-    if (debugPtr) {
-      debugPtr->println(" connected to ");
-      printWifConfig(debugPtr);
-    }
-    return false; // ok connected
-  }
-
-  // else
-  if (debugPtr) {
-    debugPtr->println(" did not connect to ");
-    printWifConfig(debugPtr);
-  }
-
-  setupAP();
-  return true; // in AP mode
+  startConnecting(); // ESPAutoWiFiConfigLoop() finishes connecting, and keeps retrying if that fails
+  return false;
 }
 
 /**
@@ -225,6 +286,7 @@ bool ESPAutoWiFiConfigSetup(int ledPin, bool highForLedOn, size_t EEPROM_offset)
    // rest of loop
 */
 // if ESPAutoWiFiConfigLoop() returns true the in AP mode processing setting WiFi SSID/pw/ip settings
+// returns false while connecting, use WiFi.status() to see when the connection is made
 bool ESPAutoWiFiConfigLoop() {
   if (!inConfigMode) {
     // check if should delete reboot file
@@ -235,39 +297,60 @@ bool ESPAutoWiFiConfigLoop() {
       }
       clearRebootFlag();
     }
+    if (!processConnecting()) {
+      flasherPtr->update();
+      return inConfigMode; // still connecting, or just started the AP
+    }
     if (WiFi.status() != WL_CONNECTED) {
       flasherPtr->setOnOff(SLOW_FLASH_WHILE_CONNECTING); // ignored if already flashing at 100ms
-      if (!lostConnectionRebootTimer.isRunning()) {
-      	lostConnectionRebootTimer.start(LOST_CONNECTION_REBOOT_MS);
-      }
+      processReconnect();
     } else {// (WiFi.status() == WL_CONNECTED)
       // so all OK so turn led OFF
-      lostConnectionRebootTimer.stop();
       flasherPtr->setOnOff(PIN_OFF); // ignored if already OFF
+      processConnected();
     }
-    if(lostConnectionRebootTimer.justFinished()) {
-    	// did not auto reconnect after 30 sec start from scratch again
-    	clearRebootFlag(); // should not be needed but..
-    	ESP.restart(); // see https://github.com/esp8266/Arduino/issues/1017  seems to work here
-    }    	
+    processLeaseRenew();
     flasherPtr->update();
     return false; // not doing wifi config so just ignore this call
   }
 
   // else in config mode
-  lostConnectionRebootTimer.stop();
   flasherPtr->update();
+  processAPScan();
   dnsServer.processNextRequest();
   accessPointWebServer.handleClient();
   if (endConfigTimer.justFinished()) {
-    ESP.restart(); // see https://github.com/esp8266/Arduino/issues/1017  seems to work here
+    restartNow();
   }
   if (restartTimer.justFinished()) {
-    ESP.restart(); // see https://github.com/esp8266/Arduino/issues/1017  seems to work here
+    restartNow();
   }
   return true;
 }
 
+void setESPAutoWiFiConfigRestartCallback(void (*fn)()) {
+  restartCallback = fn;
+}
+
+void getWiFiReconnectCounts(uint32_t& disconnects, uint32_t& reconnectAttempts, uint32_t& radioReinits, uint32_t& dhcpRestarts, uint32_t& offline_s) {
+  disconnects = disconnectCount;
+  reconnectAttempts = reconnectAttemptCount;
+  radioReinits = radioReinitCount;
+  dhcpRestarts = dhcpRestartCount;
+  uint32_t total_ms = offlineTotal_ms;
+  if (offline) {
+    total_ms += millis() - offlineStart_ms;
+  }
+  offline_s = total_ms / 1000;
+}
+
+static void restartNow() {
+  if (restartCallback) {
+    restartCallback(); // e.g. save state
+  }
+  ESP.restart(); // see https://github.com/esp8266/Arduino/issues/1017  seems to work here
+}
+
 // set the RGB led colour on ESP32C OR other ESP32 board using ws2812 addressable RGB led on a GPIO pin
 // ESP32C uses GPIO8 see ESP32C_RGB_LED above
 /** Set RGB value for the WS2812 LED
@@ -286,12 +369,129 @@ void ESPAutoWiFiConfig_setColor(uint8_t _red, uint8_t _green, uint8_t _blue) {
 }
 
 
-// returns false if fails to connect in 30 sec;
-static bool tryToConnectToConfiguredWiFiNetwork() {
-  loadWiFiConfig();
-  // ======================= connect to router ===================
-  WiFi.mode(WIFI_STA);
-  WiFi.setTxPower(WIFI_POWER_8_5dBm);
+#ifdef ESP_PLATFORM
+// called from the WiFi event task
+static void onStaConnected(arduino_event_id_t event) {
+  (void)event;
+  staAssociationCount++;
+  staAssociated = true;
+}
+
+static void onStaDisconnected(arduino_event_id_t event) {
+  (void)event;
+  staAssociated = false;
+}
+#endif
+
+// DHCP renew time (T1) in sec of the current lease, 0 if not known
+static uint32_t getDhcpRenewSecs() {
+#ifdef ESP_PLATFORM
+  esp_netif_t* netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  if (!netif) {
+    return 0;
+  }
+  struct netif* lwipNetif = (struct netif*)esp_netif_get_netif_impl(netif);
+  if (!lwipNetif) {
+    return 0;
+  }
+  struct dhcp* dhcp = netif_dhcp_data(lwipNetif);
+  if ((!dhcp) || (dhcp->state != DHCP_STATE_BOUND)) {
+    return 0;
+  }
+  return dhcp->offered_t1_renew;
+#else
+  return 0; // ESP8266 always uses DHCP
+#endif
+}
+
+// returns true if there is a cache for the configured ssid
+static bool loadFastConnect() {
+  if ((!configGet(wifiFastConnectKey, &fastConnect, sizeof(fastConnect))) || (fastConnect.channel <= 0)) {
+    memset(&fastConnect, 0, sizeof(fastConnect));
+    return false;
+  }
+  fastConnect.ssid[sizeof(fastConnect.ssid) - 1] = '\0';
+  return (strcmp(fastConnect.ssid, storage.ssid) == 0);
+}
+
+static void clearFastConnect() {
+  memset(&fastConnect, 0, sizeof(fastConnect));
+  configRemove(wifiFastConnectKey);
+}
+
+// use the cached lease as a static IP if the clock, kept across ESP.restart(), says it has not reached T1
+// returns true if it was applied
+static bool applyCachedLease() {
+  int64_t now_s = time(nullptr);
+  if ((fastConnect.ip == 0) || (fastConnect.leaseStart_s < MIN_VALID_TIME_S) || (now_s < fastConnect.leaseStart_s)
+      || ((now_s - fastConnect.leaseStart_s) >= (int64_t)fastConnect.leaseRenew_s)) {
+    return false;
+  }
+  WiFi.config(IPAddress(fastConnect.ip), IPAddress(fastConnect.gateway), IPAddress(fastConnect.subnet),
+              IPAddress(fastConnect.dns1), IPAddress(fastConnect.dns2));
+  // go back to DHCP before T1 so the lease is never used after the DHCP server could give it away
+  leaseRenewTimer.start((unsigned long)(fastConnect.leaseRenew_s - (now_s - fastConnect.leaseStart_s)) * 1000);
+  return true;
+}
+
+// saves the BSSID and channel, and the lease if saveLease, configPut only writes if they changed
+static void saveFastConnect(bool saveLease) {
+  struct WiFi_FAST_CONNECT_struct newFastConnect;
+  memcpy(&newFastConnect, &fastConnect, sizeof(newFastConnect)); // keep the reused lease if not saveLease
+  cSFA(sfSSID, newFastConnect.ssid);
+  sfSSID = storage.ssid;
+  uint8_t* bssid = WiFi.BSSID();
+  if (bssid) {
+    memcpy(newFastConnect.bssid, bssid, sizeof(newFastConnect.bssid));
+  }
+  newFastConnect.channel = WiFi.channel();
+  if (saveLease) {
+    uint32_t renew_s = getDhcpRenewSecs();
+    int64_t now_s = time(nullptr);
+    if (renew_s > MAX_LEASE_REUSE_S) {
+      renew_s = MAX_LEASE_REUSE_S; // e.g. infinite leases
+    }
+    if ((renew_s > 0) && (now_s >= MIN_VALID_TIME_S)) {
+      newFastConnect.ip = (uint32_t)WiFi.localIP();
+      newFastConnect.gateway = (uint32_t)WiFi.gatewayIP();
+      newFastConnect.subnet = (uint32_t)WiFi.subnetMask();
+      newFastConnect.dns1 = (uint32_t)WiFi.dnsIP(0);
+      newFastConnect.dns2 = (uint32_t)WiFi.dnsIP(1);
+      newFastConnect.leaseStart_s = now_s;
+      newFastConnect.leaseRenew_s = renew_s;
+    } else {
+      newFastConnect.ip = 0; // cannot tell when the lease runs out
+    }
+  }
+  memcpy(&fastConnect, &newFastConnect, sizeof(fastConnect));
+  configPut(wifiFastConnectKey, &fastConnect, sizeof(fastConnect)); // processConfigStore() saves it
+}
+
+// call from loop(), when a reused lease reaches T1 go back to DHCP and cache the new lease
+static void processLeaseRenew() {
+  if (leaseRenewTimer.justFinished()) {
+    if (debugPtr) {
+      debugPtr->println("Reused DHCP lease at renew time, restarting DHCP");
+    }
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // starts the DHCP client
+    saveLeaseWhenBound = true;
+  }
+  if (saveLeaseWhenBound && (WiFi.status() == WL_CONNECTED) && (getDhcpRenewSecs() > 0)) {
+    saveLeaseWhenBound = false;
+    saveFastConnect(true);
+  }
+}
+
+// connecting state machine, run from ESPAutoWiFiConfigLoop() so setup() and loop() are never blocked
+enum connectState_enum { CONNECT_FAST, CONNECT_SCAN, CONNECT_DONE };
+static connectState_enum connectState = CONNECT_DONE;
+static millisDelay connectTimer;
+static unsigned long connectStart_ms = 0;
+static bool connectUseDHCP = true;
+static bool leaseReused = false;
+
+// returns false if DHCP is to be used
+static bool configureStaticIP() {
   if (storage.staticIP[0] != '\0') {
     IPAddress ip;
     bool validIp = ip.fromString(storage.staticIP);
@@ -299,66 +499,231 @@ static bool tryToConnectToConfiguredWiFiNetwork() {
       IPAddress gateway(ip[0], ip[1], ip[2], 1); // set gatway to ... 1
       IPAddress subnet_ip = IPAddress(255, 255, 255, 0);
       WiFi.config(ip, gateway, subnet_ip, dns1, dns2);
+      return true;
     } else {
       if (debugPtr) {
         debugPtr->print("Using DHCP, staticIP is invalid: "); debugPtr->println(storage.staticIP);
       }
     }
   } // else leave as DHCP
+  return false;
+}
 
-  if (WiFi.status() != WL_CONNECTED) {
-    WiFi.begin(storage.ssid, storage.password);
-    WiFi.setTxPower(WIFI_POWER_8_5dBm);
-    flasherPtr->setOnOff(SLOW_FLASH_WHILE_CONNECTING);
-    if (debugPtr) {
-      debugPtr->println("   Connecting to WiFi");
-    }
-  } else {
-    flasherPtr->setOnOff(PIN_OFF);
+static void beginScanConnect() {
+  WiFi.begin(storage.ssid, storage.password);
+  WiFi.setTxPower(WIFI_POWER_8_5dBm);
+  if (debugPtr) {
+    debugPtr->println("   Connecting to WiFi");
+  }
+  connectState = CONNECT_SCAN;
+  connectTimer.start(CONNECT_MS);
+}
+
+// starts connecting, tries the BSSID and channel of the last connection first
+static void startConnecting() {
+  connectStart_ms = millis(); // storage loaded by ESPAutoWiFiConfigSetup()
+  // ======================= connect to router ===================
+  WiFi.mode(WIFI_STA);
+  WiFi.setTxPower(WIFI_POWER_8_5dBm);
+  leaseReused = false;
+  connectUseDHCP = !configureStaticIP();
+
+  if (WiFi.status() == WL_CONNECTED) {
     if (debugPtr) {
       debugPtr->println("   Already connected to WiFi");
     }
+    connectState = CONNECT_SCAN; // processConnecting() finishes up
+    return;
   }
-  // Wait for connection for 30sec
-  unsigned long pulseCounter = 0;
-  unsigned long delay_ms = 100;
-  unsigned long maxCount = (30 * 1000) / delay_ms; // delay below
-  while ((WiFi.status() != WL_CONNECTED) && (pulseCounter < maxCount)) {
-    pulseCounter++;
-    delay(delay_ms); // short delay to call flasher.update() often also prevents WDT timing out
-    flasherPtr->update();
+  flasherPtr->setOnOff(SLOW_FLASH_WHILE_CONNECTING);
+  if (loadFastConnect()) {
+    leaseReused = connectUseDHCP && applyCachedLease();
     if (debugPtr) {
-      if ((pulseCounter % 10) == 0) {
-        debugPtr->print(".");
-      }
-    }
-    // check if should delete reboot file
-    if (doubleRebootTimer.justFinished()) {
-      // did not reboot in 10 sec so delete reboot file
-      if (debugPtr) {
-        debugPtr->println("Double reboot timed out clear flag ");
-      }
-      clearRebootFlag();
+      debugPtr->print("   Fast connecting to WiFi on channel "); debugPtr->print(fastConnect.channel);
+      debugPtr->println(leaseReused ? " reusing DHCP lease" : "");
     }
+    WiFi.begin(storage.ssid, storage.password, fastConnect.channel, fastConnect.bssid);
+    WiFi.setTxPower(WIFI_POWER_8_5dBm);
+    connectState = CONNECT_FAST;
+    connectTimer.start(FAST_CONNECT_MS);
+  } else {
+    beginScanConnect();
   }
-  if (debugPtr) {
-    debugPtr->println();
+}
+
+// starts the reconnect backoff, processReconnect() makes the attempts
+static void startReconnecting(unsigned long since_ms) {
+  offline = true;
+  offlineStart_ms = since_ms;
+  reconnectStep = 0;
+  dhcpWaitTimer.stop();
+  reconnectTimer.start(RECONNECT_FIRST_MS); // give the driver's auto reconnect a chance first
+  wedgeRestartTimer.start(WEDGE_RESTART_MS);
+}
+
+// returns true once connected or once the first connect has timed out, then processReconnect() keeps trying
+// returns false while still connecting
+static bool processConnecting() {
+  if (connectState == CONNECT_DONE) {
+    return true;
   }
-  if (pulseCounter >= maxCount) {
+  if (WiFi.status() != WL_CONNECTED) {
+    if (!connectTimer.justFinished()) {
+      return false; // keep waiting
+    }
+    if (connectState == CONNECT_FAST) {
+      // AP moved or changed channel, forget it and scan
+      WiFi.disconnect();
+      clearFastConnect();
+      if (leaseReused) {
+        leaseRenewTimer.stop();
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // back to DHCP
+        leaseReused = false;
+      }
+      beginScanConnect();
+      return false;
+    }
+    // else CONNECT_SCAN timed out, keep trying in the background, the BLE scanning carries on
+    // the config AP is only started by a double reboot, a router that is down must not leave the device in AP mode
+    connectState = CONNECT_DONE;
+    if (debugPtr) {
+      debugPtr->println(" did not connect to ");
+      printWifConfig(debugPtr);
+    }
+    startReconnecting(connectStart_ms);
+    saveLeaseWhenBound = connectUseDHCP; // cache the lease if a retry connects
     return false;
-  } // else
+  }
 
+  // else connected
+  bool fastPath = (connectState == CONNECT_FAST);
+  connectState = CONNECT_DONE;
+  connectTimer.stop();
+  if (connectUseDHCP && (!leaseReused)) {
+    saveLeaseWhenBound = true; // processLeaseRenew() caches the lease once DHCP has bound
+  }
+  saveFastConnect(false);
   flasherPtr->setOnOff(PIN_OFF);
   if (debugPtr) {
     debugPtr->println("");
     debugPtr->print("Connected to ");
-    debugPtr->println(storage.ssid);
+    debugPtr->print(storage.ssid);
+    debugPtr->print(fastPath ? " using cached channel in " : " in ");
+    debugPtr->print(millis() - connectStart_ms);
+    debugPtr->println("ms");
     debugPtr->print("IP address: ");
     debugPtr->println(WiFi.localIP());
   }
   return true;
 }
 
+// stop and restart the radio, then a full scan connect, clears any driver state left by the lost connection
+static void reinitRadio() {
+  radioReinitCount++;
+  if (leaseReused) {
+    // the AP may have changed, get a fresh lease
+    leaseRenewTimer.stop();
+    leaseReused = false;
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  WiFi.mode(WIFI_STA);
+  WiFi.setTxPower(WIFI_POWER_8_5dBm);
+  if (configureStaticIP()) {
+    saveLeaseWhenBound = false;
+  } else {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // DHCP
+    saveLeaseWhenBound = true;
+  }
+  WiFi.begin(storage.ssid, storage.password);
+  WiFi.setTxPower(WIFI_POWER_8_5dBm);
+}
+
+// call from loop() while not connected, after the first connection or the first connect timed out
+static void processReconnect() {
+  if (!offline) {
+    disconnectCount++;
+    startReconnecting(millis());
+    if (debugPtr) {
+      debugPtr->println("WiFi connection lost");
+    }
+    return;
+  }
+  if (processDhcpWait()) {
+    return; // associated, give DHCP time before the next reconnect attempt drops the association
+  }
+  if (wedgeRestartTimer.justFinished()) {
+    // reconnecting in place has not worked, start from scratch again
+    if (debugPtr) {
+      debugPtr->println("WiFi still offline, restarting");
+    }
+    clearRebootFlag(); // should not be needed but..
+    restartNow();
+  }
+  if (reconnectTimer.justFinished()) {
+    reconnectAttemptCount++;
+    reconnectStep++;
+    if ((reconnectStep % RECONNECTS_PER_RADIO_REINIT) == 0) {
+      reinitRadio();
+    } else {
+      WiFi.reconnect();
+    }
+    unsigned long backoff_ms = RECONNECT_FIRST_MS << ((reconnectStep < 5) ? reconnectStep : 5);
+    if (backoff_ms > RECONNECT_MAX_MS) {
+      backoff_ms = RECONNECT_MAX_MS;
+    }
+    reconnectTimer.start(backoff_ms);
+    if (debugPtr) {
+      debugPtr->print("WiFi reconnect attempt "); debugPtr->print(reconnectStep);
+      debugPtr->println(((reconnectStep % RECONNECTS_PER_RADIO_REINIT) == 0) ? " radio reinit" : "");
+    }
+  }
+}
+
+// call from processReconnect(), associated with the AP but no DHCP address yet
+// restarts DHCP once per association if no address within DHCP_WAIT_MS, then lets the reconnect backoff carry on
+// returns true while waiting for DHCP
+static bool processDhcpWait() {
+  if ((!staAssociated) || (!connectUseDHCP) || leaseReused) {
+    dhcpWaitTimer.stop();
+    return false;
+  }
+  uint32_t association = staAssociationCount;
+  if (association != dhcpWaitAssociation) {
+    dhcpWaitAssociation = association;
+    dhcpRestarted = false;
+    dhcpWaitTimer.start(DHCP_WAIT_MS);
+  }
+  if (dhcpWaitTimer.justFinished() && (!dhcpRestarted)) {
+    dhcpRestartCount++;
+    dhcpRestarted = true;
+    if (debugPtr) {
+      debugPtr->println("Associated but no DHCP address, restarting DHCP");
+    }
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // restarts the DHCP client
+    saveLeaseWhenBound = true;
+    dhcpWaitTimer.start(DHCP_WAIT_MS);
+  }
+  return dhcpWaitTimer.isRunning();
+}
+
+// call from loop() while connected, finishes an outage
+static void processConnected() {
+  if (offline) {
+    offline = false;
+    unsigned long outage_ms = millis() - offlineStart_ms;
+    offlineTotal_ms += outage_ms;
+    reconnectTimer.stop();
+    wedgeRestartTimer.stop();
+    saveFastConnect(false); // may have joined a different AP
+    if (debugPtr) {
+      debugPtr->print("WiFi reconnected after "); debugPtr->print(outage_ms); debugPtr->print("ms, ");
+      debugPtr->print(reconnectStep); debugPtr->println(" attempts");
+    }
+  }
+  dhcpWaitTimer.stop();
+}
+
 void printWifConfig(Stream *out) {
   if (out == NULL) {
     return;
@@ -384,13 +749,13 @@ cSF(sfStrongestAP, MAX_SSID_LEN_CONFIG);
 
 
 
+static bool apScanRunning = false;
+
 /**
-   will return name of AP with strongest signal found or return empty string if none found
+   sets result to the name of AP with strongest signal from the n scan results, or empty string if none found
 */
-static void scanForStrongestAP(SafeString & result) {
+static void pickStrongestAP(SafeString & result, int16_t n) {
   result.clear();
-  // WiFi.scanNetworks will return the number of networks found
-  int8_t n = WiFi.scanNetworks();
   if (n <= 0) {
     if (debugPtr) {
       debugPtr->println("WiFi network scan failed");
@@ -402,7 +767,7 @@ static void scanForStrongestAP(SafeString & result) {
     debugPtr->print("Found ");   debugPtr->print(n);    debugPtr->println(" networks");
   }
   int32_t maxRSSI = -10000;
-  for (int8_t i = 0; i < n; ++i) {
+  for (int16_t i = 0; i < n; ++i) {
     //const char * ssid_scan = WiFi.SSID_charPtr(i);
     int32_t rssi_scan = WiFi.RSSI(i);
     if (rssi_scan > maxRSSI) {
@@ -419,6 +784,20 @@ static void scanForStrongestAP(SafeString & result) {
   }
 }
 
+// call from loop() while in config mode, picks up the async scan results started by setupAP()
+static void processAPScan() {
+  if (!apScanRunning) {
+    return;
+  }
+  int16_t n = WiFi.scanComplete();
+  if (n == WIFI_SCAN_RUNNING) {
+    return;
+  }
+  apScanRunning = false;
+  pickStrongestAP(sfStrongestAP, n);
+  WiFi.scanDelete(); // free the results
+}
+
 
 /**
    sets up AP and loads current wifi settings
@@ -441,7 +820,6 @@ static void setupAP() {
   }
   // connect to temporary wifi network for setup
 
-  scanForStrongestAP(sfStrongestAP);
   if (debugPtr) {
     debugPtr->print(F("configure ")); debugPtr->println(wifiWebConfigAP);
   }
@@ -472,6 +850,9 @@ static void setupAP() {
   if (debugPtr) {
     debugPtr->println ( "HTTP accessPointWebServer started" );
   }
+  // scan in the background, processAPScan() fills in sfStrongestAP for the config page
+  sfStrongestAP.clear();
+  apScanRunning = (WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING);
   endConfigTimer.start(END_CONFIG_MS);
 }
 
@@ -682,7 +1063,7 @@ void setESPAutoWiFiConfigDebugOut(Stream &out) {
   debugPtr = &out;
 }
 
-// =============== EEPROM methods ====================
+// =============== config methods ====================
 size_t getESPAutoWiFiConfigEEPROM_Size() {
   size_t rebootDetectionFileAddress = (sizeof(WiFi_CONFIG_storage_struct) + 3) & (~3); // rounded up
   size_t configSize = rebootDetectionFileAddress + 1 ; // rounded up storage + byte for reboot
@@ -690,11 +1071,33 @@ size_t getESPAutoWiFiConfigEEPROM_Size() {
   return configSize;
 }	
 
-void startEEPROM() {
+// copy settings saved in EEPROM by earlier versions into configStore, returns false if none
+static bool migrateEEPROMconfig() {
   EEPROM.begin(eepromOffset + getESPAutoWiFiConfigEEPROM_Size());
+  uint8_t flag = EEPROM.read(rebootDetectionFileAddress + eepromOffset);
+  bool found = ((flag == REBOOT_ACTIVE) || (flag == REBOOT_INACTIVE));
+  if (found) {
+    EEPROM.get(wifiConfigFileAddress + eepromOffset, storage);
+    configPut(wifiConfigKey, &storage, sizeof(storage));
+    configPut(rebootFlagKey, &flag, sizeof(flag));
+    configCommit();
+    if (debugPtr) {
+      debugPtr->println("moved wificonfig from EEPROM");
+    }
+  }
+  EEPROM.end();
+  return found;
+}
+
+void startConfig() {
+  initializeConfigStore();
+  uint8_t flag = 0;
+  if (!configGet(rebootFlagKey, &flag, sizeof(flag))) {
+    migrateEEPROMconfig();
+  }
   if (!checkValidRebootFlag()) {
     if (debugPtr) {
-      debugPtr->println("EEPROM invalid clear wificonfig");
+      debugPtr->println("config invalid clear wificonfig");
     }
     printWifConfig(debugPtr);
     deleteWiFiConfigurationSettings();
@@ -702,7 +1105,8 @@ void startEEPROM() {
 }
 
 static bool checkValidRebootFlag() {
-  uint8_t flag = EEPROM.read(rebootDetectionFileAddress + eepromOffset);
+  uint8_t flag = 0;
+  configGet(rebootFlagKey, &flag, sizeof(flag));
   if ((flag == REBOOT_ACTIVE) || (flag == REBOOT_INACTIVE)) {
     return true;
   }
@@ -710,18 +1114,22 @@ static bool checkValidRebootFlag() {
   return defaultNetworkSettings(); // false if none
 }
 
+// the reboot flag is committed immediately, double reboot detection needs it on flash
 static void writeRebootFlag() {
-  EEPROM.write(rebootDetectionFileAddress + eepromOffset, REBOOT_ACTIVE);
-  EEPROM.commit();
+  uint8_t flag = REBOOT_ACTIVE;
+  configPut(rebootFlagKey, &flag, sizeof(flag));
+  configCommit();
 }
 
 static void clearRebootFlag() {
-  EEPROM.write(rebootDetectionFileAddress + eepromOffset, REBOOT_INACTIVE);
-  EEPROM.commit();
+  uint8_t flag = REBOOT_INACTIVE;
+  configPut(rebootFlagKey, &flag, sizeof(flag));
+  configCommit();
 }
 
 static bool rebootFlagExists() {
-  uint8_t flag = EEPROM.read(rebootDetectionFileAddress + eepromOffset);
+  uint8_t flag = 0;
+  configGet(rebootFlagKey, &flag, sizeof(flag));
   if (flag == REBOOT_ACTIVE) {
     return true;
   }
@@ -730,8 +1138,8 @@ static bool rebootFlagExists() {
 }
 
 static void saveWiFiConfig() {
-  EEPROM.put(wifiConfigFileAddress + eepromOffset, storage);
-  EEPROM.commit();
+  configPut(wifiConfigKey, &storage, sizeof(storage));
+  configCommit();
   if (debugPtr) {
     debugPtr->println("saved config");
     printWifConfig(debugPtr);
@@ -739,7 +1147,9 @@ static void saveWiFiConfig() {
 }
 
 static void loadWiFiConfig() {
-  EEPROM.get(wifiConfigFileAddress + eepromOffset, storage);
+  if (!configGet(wifiConfigKey, &storage, sizeof(storage))) {
+    memset(&storage, 0, sizeof(storage));
+  }
   // clean it up cSFA makes sure there is terminating '\0'
   cSFA(sfSSID, storage.ssid);
   cSFA(sfPW, storage.password);
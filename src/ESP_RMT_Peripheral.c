@@ -24,6 +24,7 @@
 
 #include <Arduino.h>
 #include "driver/rmt.h"
+#include "esp_timer.h"
 
 #if defined(ESP_IDF_VERSION)
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 0, 0)
@@ -44,6 +45,9 @@
 #define WS2811_T1H_NS (1200)
 #define WS2811_T1L_NS (1300)
 
+#define WS2812_LATCH_US (300) // quiet time after a frame before the next one can start
+#define WS2812_MAX_BYTES (3 * 256) // 256 RGB leds, larger frames are cut short
+
 static uint32_t t0h_ticks = 0;
 static uint32_t t1h_ticks = 0;
 static uint32_t t0l_ticks = 0;
@@ -59,6 +63,20 @@ static uint32_t t1l_ticks = 0;
 
 bool rmt_reserved_channels[ADAFRUIT_RMT_CHANNEL_MAX];
 
+// RMT items for each 4 bit nibble, MSB first, rebuilt when the tick timings change
+// in DRAM so the translator can use it from the RMT ISR while the flash cache is disabled
+static DRAM_ATTR rmt_item32_t nibbleItems[16][4];
+
+static void buildNibbleItems(void) {
+  const rmt_item32_t bit0 = {{{ t0h_ticks, 1, t0l_ticks, 0 }}}; //Logical 0
+  const rmt_item32_t bit1 = {{{ t1h_ticks, 1, t1l_ticks, 0 }}}; //Logical 1
+  for (int n = 0; n < 16; n++) {
+    for (int i = 0; i < 4; i++) {
+      nibbleItems[n][i].val = (n & (0x08 >> i)) ? bit1.val : bit0.val;
+    }
+  }
+}
+
 static void IRAM_ATTR ws2812_rmt_adapter(const void *src, rmt_item32_t *dest, size_t src_size,
     size_t wanted_num, size_t *translated_size, size_t *item_num)
 {
@@ -67,23 +85,24 @@ static void IRAM_ATTR ws2812_rmt_adapter(const void *src, rmt_item32_t *dest, si
     *item_num = 0;
     return;
   }
-  const rmt_item32_t bit0 = {{{ t0h_ticks, 1, t0l_ticks, 0 }}}; //Logical 0
-  const rmt_item32_t bit1 = {{{ t1h_ticks, 1, t1l_ticks, 0 }}}; //Logical 1
   size_t size = 0;
   size_t num = 0;
-  uint8_t *psrc = (uint8_t *)src;
+  const uint8_t *psrc = (const uint8_t *)src;
   rmt_item32_t *pdest = dest;
   while (size < src_size && num < wanted_num) {
-    for (int i = 0; i < 8; i++) {
-      // MSB first
-      if (*psrc & (1 << (7 - i))) {
-        pdest->val =  bit1.val;
-      } else {
-        pdest->val =  bit0.val;
-      }
-      num++;
-      pdest++;
-    }
+    // two table lookups per byte instead of testing each bit
+    const rmt_item32_t *hi = nibbleItems[*psrc >> 4];
+    const rmt_item32_t *lo = nibbleItems[*psrc & 0x0F];
+    pdest[0].val = hi[0].val;
+    pdest[1].val = hi[1].val;
+    pdest[2].val = hi[2].val;
+    pdest[3].val = hi[3].val;
+    pdest[4].val = lo[0].val;
+    pdest[5].val = lo[1].val;
+    pdest[6].val = lo[2].val;
+    pdest[7].val = lo[3].val;
+    num += 8;
+    pdest += 8;
     size++;
     psrc++;
   }
@@ -91,7 +110,176 @@ static void IRAM_ATTR ws2812_rmt_adapter(const void *src, rmt_item32_t *dest, si
   *item_num = num;
 }
 
-IRAM_ATTR void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean is800KHz) {
+// The RMT channel is installed on the first espShow() and then kept, so each show() is just the transmit.
+// It is only re-installed if the pin, the 800KHz/400KHz type changes or the frame gets larger.
+static rmt_channel_t showChannel = ADAFRUIT_RMT_CHANNEL_MAX; // ADAFRUIT_RMT_CHANNEL_MAX => not installed
+static uint8_t showPin = 0;
+static boolean showIs800KHz = true;
+
+// espShow() does not wait. The frame is copied to pendingBuffer and sent from txBuffer, which the RMT
+// driver reads from its ISR until the tx end callback. If a frame is still being sent or the latch time
+// has not passed, latchTimer sends the newest pending frame later. Older pending frames are dropped.
+// Both buffers are allocated at install for the frame size, a larger frame re-installs the channel
+static uint8_t *txBuffer = NULL;
+static uint8_t *pendingBuffer = NULL;
+static size_t bufferSize = 0;
+static size_t txBytes = 0;
+static size_t pendingBytes = 0;
+static volatile bool txBusy = false; // set when the transmit starts, cleared by the tx end callback
+static volatile bool framePending = false;
+static volatile bool latchCallbackRunning = false; // latchTimerCallback() is in startPendingFrame()
+static volatile bool showReleasing = false; // espShowRelease() is tearing down, latchTimerCallback() must not start
+static volatile int64_t txEnd_us = 0; // esp_timer_get_time() at the end of the last frame
+static esp_timer_handle_t latchTimer = NULL;
+static portMUX_TYPE showMux = portMUX_INITIALIZER_UNLOCKED;
+
+// called from the RMT ISR
+static void IRAM_ATTR showTxEnd(rmt_channel_t channel, void *arg) {
+  (void)arg;
+  if (channel != showChannel) {
+    return;
+  }
+  portENTER_CRITICAL_ISR(&showMux);
+  txBusy = false;
+  txEnd_us = esp_timer_get_time();
+  portEXIT_CRITICAL_ISR(&showMux);
+}
+
+// bits take 1.25us at 800KHz and 2.5us at 400KHz
+static uint32_t frameTime_us(size_t bytes) {
+  return (uint32_t)(bytes * 8 * (showIs800KHz ? 5 : 10) / 4) + 1;
+}
+
+// starts the pending frame if the channel is free, else arms latchTimer to try again
+// called from espShow() and the esp_timer task
+static void startPendingFrame(void) {
+  bool start = false;
+  uint32_t wait_us = 0;
+  int64_t now_us = esp_timer_get_time();
+  portENTER_CRITICAL(&showMux);
+  if (framePending && (showChannel != ADAFRUIT_RMT_CHANNEL_MAX)) {
+    if (txBusy) {
+      wait_us = frameTime_us(txBytes) + WS2812_LATCH_US;
+    } else if ((now_us - txEnd_us) < WS2812_LATCH_US) {
+      wait_us = (uint32_t)(WS2812_LATCH_US - (now_us - txEnd_us));
+    } else {
+      memcpy(txBuffer, pendingBuffer, pendingBytes);
+      txBytes = pendingBytes;
+      framePending = false;
+      txBusy = true; // claims txBuffer
+      start = true;
+    }
+  }
+  portEXIT_CRITICAL(&showMux);
+  if (start) {
+    if (rmt_write_sample(showChannel, txBuffer, txBytes, false) != ESP_OK) {
+      portENTER_CRITICAL(&showMux);
+      txBusy = false;
+      txEnd_us = now_us;
+      portEXIT_CRITICAL(&showMux);
+    }
+  } else if (wait_us) {
+    esp_timer_stop(latchTimer); // returns an error if not running, that is OK
+    esp_timer_start_once(latchTimer, wait_us);
+  }
+}
+
+// runs in the esp_timer task, espShowRelease() waits for it to finish before freeing the channel and buffers
+static void latchTimerCallback(void *arg) {
+  (void)arg;
+  portENTER_CRITICAL(&showMux);
+  bool releasing = showReleasing;
+  if (!releasing) {
+    latchCallbackRunning = true;
+  }
+  portEXIT_CRITICAL(&showMux);
+  if (releasing) {
+    return;
+  }
+  startPendingFrame();
+  portENTER_CRITICAL(&showMux);
+  latchCallbackRunning = false;
+  portEXIT_CRITICAL(&showMux);
+}
+
+// true while a frame is being sent, waiting to be sent or the latch time has not passed
+bool espShowBusy(void) {
+  portENTER_CRITICAL(&showMux);
+  bool busy = txBusy || framePending || ((esp_timer_get_time() - txEnd_us) < WS2812_LATCH_US);
+  portEXIT_CRITICAL(&showMux);
+  return busy;
+}
+
+// convert ns to RMT ticks, integer only, truncates like the float ratio it replaced
+static uint32_t nsToTicks(uint32_t counter_clk_hz, uint32_t ns) {
+  return (uint32_t)(((uint64_t)counter_clk_hz * ns) / 1000000000ULL);
+}
+
+static void freeShowBuffers(void) {
+  free(txBuffer);
+  free(pendingBuffer);
+  txBuffer = NULL;
+  pendingBuffer = NULL;
+  bufferSize = 0;
+}
+
+// free the channel so it can be used for something else, the next espShow() installs it again
+void espShowRelease(void) {
+  if (showChannel == ADAFRUIT_RMT_CHANNEL_MAX) {
+    return;
+  }
+  // stop new latch callbacks, then wait for one already running, it may re-arm the timer before it sees showReleasing
+  portENTER_CRITICAL(&showMux);
+  showReleasing = true;
+  framePending = false;
+  portEXIT_CRITICAL(&showMux);
+  for (;;) {
+    esp_timer_stop(latchTimer); // returns an error if not running, that is OK
+    portENTER_CRITICAL(&showMux);
+    bool running = latchCallbackRunning;
+    portEXIT_CRITICAL(&showMux);
+    if (!running) {
+      break;
+    }
+    vTaskDelay(1);
+  }
+  esp_timer_delete(latchTimer); // espShowInstall() creates it again
+  latchTimer = NULL;
+  rmt_wait_tx_done(showChannel, pdMS_TO_TICKS(100));
+  rmt_register_tx_end_callback(NULL, NULL);
+  rmt_driver_uninstall(showChannel);
+  portENTER_CRITICAL(&showMux);
+  txBusy = false;
+  framePending = false;
+  portEXIT_CRITICAL(&showMux);
+  freeShowBuffers();
+  showReleasing = false; // after the buffers are gone, nothing can start until espShowInstall()
+  rmt_reserved_channels[showChannel] = false;
+  showChannel = ADAFRUIT_RMT_CHANNEL_MAX;
+  gpio_set_direction(showPin, GPIO_MODE_OUTPUT);
+}
+
+// returns false if no channel is free or the driver install failed
+static bool espShowInstall(uint8_t pin, boolean is800KHz, size_t numBytes) {
+  if (!latchTimer) {
+    const esp_timer_create_args_t timerArgs = {
+      .callback = latchTimerCallback,
+      .arg = NULL,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "ws2812Latch",
+    };
+    if (esp_timer_create(&timerArgs, &latchTimer) != ESP_OK) {
+      return false;
+    }
+  }
+  txBuffer = (uint8_t *)malloc(numBytes);
+  pendingBuffer = (uint8_t *)malloc(numBytes);
+  if ((!txBuffer) || (!pendingBuffer)) {
+    freeShowBuffers();
+    return false;
+  }
+  bufferSize = numBytes;
+
   // Reserve channel
   rmt_channel_t channel = ADAFRUIT_RMT_CHANNEL_MAX;
   for (size_t i = 0; i < ADAFRUIT_RMT_CHANNEL_MAX; i++) {
@@ -103,7 +291,8 @@ IRAM_ATTR void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean
   }
   if (channel == ADAFRUIT_RMT_CHANNEL_MAX) {
     // Ran out of channels!
-    return;
+    freeShowBuffers();
+    return false;
   }
 
 #if defined(HAS_ESP_IDF_4)
@@ -128,8 +317,11 @@ IRAM_ATTR void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean
     }
   };
 #endif
-  rmt_config(&config);
-  rmt_driver_install(config.channel, 0, 0);
+  if ((rmt_config(&config) != ESP_OK) || (rmt_driver_install(config.channel, 0, 0) != ESP_OK)) {
+    rmt_reserved_channels[channel] = false;
+    freeShowBuffers();
+    return false;
+  }
 
   // Convert NS timings to ticks
   uint32_t counter_clk_hz = 0;
@@ -149,35 +341,53 @@ IRAM_ATTR void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean
   }
 #endif
 
-  // NS to tick converter
-  float ratio = (float)counter_clk_hz / 1e9;
-
   if (is800KHz) {
-    t0h_ticks = (uint32_t)(ratio * WS2812_T0H_NS);
-    t0l_ticks = (uint32_t)(ratio * WS2812_T0L_NS);
-    t1h_ticks = (uint32_t)(ratio * WS2812_T1H_NS);
-    t1l_ticks = (uint32_t)(ratio * WS2812_T1L_NS);
+    t0h_ticks = nsToTicks(counter_clk_hz, WS2812_T0H_NS);
+    t0l_ticks = nsToTicks(counter_clk_hz, WS2812_T0L_NS);
+    t1h_ticks = nsToTicks(counter_clk_hz, WS2812_T1H_NS);
+    t1l_ticks = nsToTicks(counter_clk_hz, WS2812_T1L_NS);
   } else {
-    t0h_ticks = (uint32_t)(ratio * WS2811_T0H_NS);
-    t0l_ticks = (uint32_t)(ratio * WS2811_T0L_NS);
-    t1h_ticks = (uint32_t)(ratio * WS2811_T1H_NS);
-    t1l_ticks = (uint32_t)(ratio * WS2811_T1L_NS);
+    t0h_ticks = nsToTicks(counter_clk_hz, WS2811_T0H_NS);
+    t0l_ticks = nsToTicks(counter_clk_hz, WS2811_T0L_NS);
+    t1h_ticks = nsToTicks(counter_clk_hz, WS2811_T1H_NS);
+    t1l_ticks = nsToTicks(counter_clk_hz, WS2811_T1L_NS);
   }
 
+  buildNibbleItems();
+
   // Initialize automatic timing translator
   rmt_translator_init(config.channel, ws2812_rmt_adapter);
+  // the RMT driver has one tx end callback for all channels, showTxEnd() ignores other channels
+  rmt_register_tx_end_callback(showTxEnd, NULL);
 
-  // Write and wait to finish
-  rmt_write_sample(config.channel, pixels, (size_t)numBytes, true);
-  rmt_wait_tx_done(config.channel, pdMS_TO_TICKS(100));
-
-  // Free channel again
-  rmt_driver_uninstall(config.channel);
-  rmt_reserved_channels[channel] = false;
+  showChannel = channel;
+  showPin = pin;
+  showIs800KHz = is800KHz;
+  return true;
+}
 
-  gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+// queues a copy of pixels and returns without waiting for the transmit or the latch time
+IRAM_ATTR void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean is800KHz) {
+  if (numBytes == 0) {
+    return;
+  }
+  if (numBytes > WS2812_MAX_BYTES) {
+    numBytes = WS2812_MAX_BYTES;
+  }
+  if ((showChannel != ADAFRUIT_RMT_CHANNEL_MAX) && ((pin != showPin) || (is800KHz != showIs800KHz) || (numBytes > bufferSize))) {
+    espShowRelease(); // settings changed
+  }
+  if ((showChannel == ADAFRUIT_RMT_CHANNEL_MAX) && (!espShowInstall(pin, is800KHz, numBytes))) {
+    return;
+  }
+  portENTER_CRITICAL(&showMux);
+  memcpy(pendingBuffer, pixels, numBytes);
+  pendingBytes = numBytes;
+  framePending = true; // replaces any frame not yet started
+  portEXIT_CRITICAL(&showMux);
+  startPendingFrame();
 }
 
-#elif
+#else
 #error "Only ESP8266 and ESP32 and ESP32 C3/S2/S3 etc boards supported"
 #endif
@@ -15,6 +15,7 @@ LastSeen::LastSeen(const char* name) {
   deviceName[0] = '\0'; // memory not initialized by new
   advertisedName[0] = '\0';
   lastTimeScanned = 0; // not seen yet
+  lastTimeLogged = 0; // not logged yet
   cSFA(sfDeviceName, deviceName);
   sfDeviceName = name;
 }
@@ -33,10 +34,18 @@ void LastSeen::setAdvertisedName(const char* advName) {
   sfAdvertisedName = advName;
 }
 
-void LastSeen::updateLastSeen(unsigned long t) {
-  lastTimeScanned = t;
+void LastSeen::updateLastSeen(int64_t monotonic_ms) {
+  lastTimeScanned = monotonic_ms;
 }
 
-unsigned long LastSeen::getLastSeen() {
+int64_t LastSeen::getLastSeen() {
   return lastTimeScanned;
 }
+
+void LastSeen::setLastLogged(int64_t monotonic_ms) {
+  lastTimeLogged = monotonic_ms;
+}
+
+int64_t LastSeen::getLastLogged() {
+  return lastTimeLogged;
+}
@@ -11,19 +11,23 @@
 */
 
 // LastSeen.h
+#include <stdint.h>
 
 class LastSeen {
   public:
     LastSeen(const char*name);
     void setAdvertisedName(const char* advName);
-    void updateLastSeen(unsigned long t);
-    unsigned long getLastSeen();
+    void updateLastSeen(int64_t monotonic_ms); // from getMonotonic_ms()
+    int64_t getLastSeen(); // getMonotonic_ms() when last seen, use monotonicToEpoch_ms() for Unix time
     const char* getDeviceName();
     const char* getAdvertisedName(); // full advert data
+    void setLastLogged(int64_t monotonic_ms); // when last written to the sighting log
+    int64_t getLastLogged(); // 0 if never logged
   private:
     char deviceName[33]; // max length 32 + null
     char advertisedName[33]; // max length 32 + null
-    unsigned long lastTimeScanned; // when was this last seen
+    int64_t lastTimeScanned; // when was this last seen, 64bit ms since boot so does not wrap
+    int64_t lastTimeLogged; // getMonotonic_ms() when last logged
 };
 
 
@@ -87,6 +87,121 @@ void listDir(const char * dirname,  Stream& out) {
   }
 }
 
+// CRC-32 (IEEE), can be called in pieces, crc32Update(crc32Update(0, a, aLen), b, bLen)
+// 4 bits at a time, a 16 entry table is a fair trade of speed for flash
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t crcTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+    crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+bool isSafePath(const char * path) {
+  if ((!path) || (path[0] != '/')) {
+    return false;
+  }
+  return (strstr(path, "..") == NULL);
+}
+
+static int streamDirListing(File& dir, Print& out, uint8_t depth) {
+  int count = 0;
+  File file = dir.openNextFile();
+  while (file) {
+    out.print(file.path());
+    if (file.isDirectory()) {
+      out.print("/\t-\r\n");
+      count++;
+      if (depth > 0) {
+        int subCount = streamDirListing(file, out, depth - 1);
+        if (subCount > 0) {
+          count += subCount;
+        }
+      }
+    } else {
+      out.print('\t');
+      out.print(file.size());
+      out.print("\r\n");
+      count++;
+    }
+    file = dir.openNextFile();
+  }
+  return count;
+}
+
+int streamDirListing(const char * dirname, Print& out, uint8_t maxDepth) {
+  if (!FS_initialized) {
+    if (debugPtr) {
+      debugPtr->println("FS not initialized yet");
+    }
+    return -1;
+  }
+  File root = LittleFS.open(dirname);
+  if ((!root) || (!root.isDirectory())) {
+    if (debugPtr) {
+      debugPtr->printf("streamDirListing %s not a directory\n", dirname);
+    }
+    return -1;
+  }
+  return streamDirListing(root, out, maxDepth);
+}
+
+int32_t getFileSize(const char * path) {
+  if ((!FS_initialized) || (!LittleFS.exists(path))) {
+    return -1;
+  }
+  File file = LittleFS.open(path, "r");
+  if ((!file) || file.isDirectory()) {
+    return -1;
+  }
+  return (int32_t)file.size();
+}
+
+// copies the file in chunks through a stack buffer
+int32_t streamFile(const char * path, Print& out, uint32_t offset, uint32_t maxLen) {
+  if ((!FS_initialized) || (!LittleFS.exists(path))) {
+    return -1;
+  }
+  File file = LittleFS.open(path, "r");
+  if ((!file) || file.isDirectory()) {
+    if (debugPtr) {
+      debugPtr->printf("streamFile failed to open %s\n", path);
+    }
+    return -1;
+  }
+  if ((offset > 0) && (!file.seek(offset))) {
+    return 0; // past end
+  }
+  uint8_t buf[FS_STREAM_CHUNK_SIZE];
+  uint32_t sent = 0;
+  while (sent < maxLen) {
+    size_t toRead = sizeof(buf);
+    if ((maxLen - sent) < toRead) {
+      toRead = maxLen - sent;
+    }
+    size_t len = file.read(buf, toRead);
+    if (len == 0) {
+      break; // EOF
+    }
+    size_t written = out.write(buf, len);
+    sent += written;
+    if (written < len) {
+      if (debugPtr) {
+        debugPtr->printf("streamFile %s client stopped after %u bytes\n", path, (unsigned int)sent);
+      }
+      break;
+    }
+    yield();
+  }
+  return (int32_t)sent;
+}
+
 // ESP8266
 //void listDir(const char * dirname, Stream& out) {
 //  if (!FS_initialized) {
@@ -30,6 +30,14 @@ bool deleteFile(const char * path); // returns false if fails
 void listDir(const char * dirname); // list to debugOut
 void listDir(const char * dirname, Stream& out); // list to out Stream
 
+// file service for HTTP/TCP clients, data is sent in FS_STREAM_CHUNK_SIZE chunks so files are never loaded into RAM
+#define FS_STREAM_CHUNK_SIZE 512
+int streamDirListing(const char * dirname, Print& out, uint8_t maxDepth = 4); // one "path\tsize\r\n" line per file, dirs as "path/\t-\r\n", returns number of entries or -1
+int32_t streamFile(const char * path, Print& out, uint32_t offset = 0, uint32_t maxLen = UINT32_MAX); // returns bytes sent or -1 if not opened, stops if out stops accepting data
+int32_t getFileSize(const char * path); // returns -1 if not found or a directory
+bool isSafePath(const char * path); // absolute and no .. so client supplied paths stay in the FS
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len); // CRC-32 for file checks, start with crc 0
+
 void setLittleFSDebug(Stream* debugOutPtr); // for debug output
 
 
@@ -0,0 +1,190 @@
+/*
+   asyncLog.cpp
+*/
+#include "asyncLog.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <atomic>
+
+#if ((ASYNC_LOG_SLOTS & (ASYNC_LOG_SLOTS - 1)) != 0)
+#error ASYNC_LOG_SLOTS must be a power of 2
+#endif
+
+// a slot is free for the producer at position pos when sequence == pos
+// and holds a message for the consumer at position pos when sequence == pos + 1
+struct logSlot_struct {
+  std::atomic<uint32_t> sequence;
+  uint32_t ms; // millis() when logged
+  uint8_t level;
+  char text[ASYNC_LOG_MSG_SIZE];
+};
+
+static struct logSlot_struct slots[ASYNC_LOG_SLOTS];
+static std::atomic<uint32_t> enqueuePos(0);
+static std::atomic<uint32_t> dequeuePos(0);
+static std::atomic<uint32_t> loggedCount(0);
+static std::atomic<uint32_t> droppedCount(0);
+static std::atomic<uint32_t> truncatedCount(0);
+static volatile bool ringReady = false; // slot sequences set
+
+// only used by the drain task, apart from setup
+static Print* serialPtr = NULL;
+static asyncLogSinkFn sinks[ASYNC_LOG_MAX_SINKS];
+static volatile size_t sinkCount = 0;
+static WiFiUDP logUdp;
+static IPAddress udpIP;
+static uint16_t udpPort = 0;
+static portMUX_TYPE udpMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t drainTaskHandle = NULL;
+
+static const char levelChars[] = "-EWID"; // indexed by LOG_LEVEL_x
+
+void asyncLogf(uint8_t level, const char* fmt, ...) {
+  if (!ringReady) {
+    droppedCount.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // claim a free slot
+  struct logSlot_struct* slot;
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    slot = &slots[pos & (ASYNC_LOG_SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break; // this slot is ours
+      }
+      // pos reloaded by the failed compare, try again
+    } else if (diff < 0) {
+      droppedCount.fetch_add(1, std::memory_order_relaxed); // full, the drain task has not emptied this slot yet
+      return;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed); // another producer took it
+    }
+  }
+  // format straight into the slot, the consumer does not read it until the sequence is published
+  slot->ms = millis();
+  slot->level = (level <= LOG_LEVEL_DEBUG) ? level : LOG_LEVEL_DEBUG;
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+  va_end(args);
+  if (len < 0) {
+    slot->text[0] = '\0';
+  } else if ((size_t)len >= sizeof(slot->text)) {
+    truncatedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  loggedCount.fetch_add(1, std::memory_order_relaxed);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+// copies the oldest message into line as "ms L text\n", returns its length, 0 if the ring is empty
+static size_t takeLine(char* line, size_t lineSize) {
+  struct logSlot_struct* slot;
+  uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    slot = &slots[pos & (ASYNC_LOG_SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - (pos + 1));
+    if (diff == 0) {
+      if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return 0; // empty, or the next producer is still formatting
+    } else {
+      pos = dequeuePos.load(std::memory_order_relaxed);
+    }
+  }
+  int len = snprintf(line, lineSize, "%lu %c %s\n", (unsigned long)slot->ms, levelChars[slot->level], slot->text);
+  slot->sequence.store(pos + ASYNC_LOG_SLOTS, std::memory_order_release); // free for the producer one lap later
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len >= lineSize) { // keep the '\n'
+    len = lineSize - 1;
+    line[len - 1] = '\n';
+  }
+  return (size_t)len;
+}
+
+static void writeLine(const char* line, size_t len) {
+  if (serialPtr) {
+    serialPtr->write((const uint8_t*)line, len);
+  }
+  for (size_t i = 0; i < sinkCount; i++) {
+    sinks[i](line, len);
+  }
+  portENTER_CRITICAL(&udpMux);
+  IPAddress ip = udpIP;
+  uint16_t port = udpPort;
+  portEXIT_CRITICAL(&udpMux);
+  if ((port != 0) && (WiFi.status() == WL_CONNECTED)) {
+    logUdp.beginPacket(ip, port);
+    logUdp.write((const uint8_t*)line, len);
+    logUdp.endPacket();
+  }
+}
+
+static void asyncLogTask(void* parameter) {
+  char line[ASYNC_LOG_MSG_SIZE + 16]; // + millis and level
+  for (;;) {
+    size_t len = takeLine(line, sizeof(line));
+    if (len == 0) {
+      vTaskDelay(pdMS_TO_TICKS(ASYNC_LOG_DRAIN_MS));
+      continue;
+    }
+    writeLine(line, len);
+  }
+}
+
+bool initializeAsyncLog(Print* serialOutPtr) {
+  if (drainTaskHandle) {
+    return true;
+  }
+  serialPtr = serialOutPtr;
+  for (uint32_t i = 0; i < ASYNC_LOG_SLOTS; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  ringReady = true;
+  BaseType_t err = xTaskCreate(
+                     asyncLogTask,
+                     "asyncLogTask",
+                     ASYNC_LOG_TASK_STACK_SIZE,
+                     NULL,
+                     ASYNC_LOG_TASK_PRIORITY,
+                     &drainTaskHandle);
+  if (err != pdPASS) {
+    if (serialPtr) {
+      serialPtr->print("xTaskCreate asyncLogTask returned:"); serialPtr->println((int)err);
+    }
+    drainTaskHandle = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool addAsyncLogSink(asyncLogSinkFn fn) {
+  if ((!fn) || (sinkCount >= ASYNC_LOG_MAX_SINKS)) {
+    return false;
+  }
+  sinks[sinkCount] = fn;
+  sinkCount++; // after the fn is set, the drain task only reads up to sinkCount
+  return true;
+}
+
+void setAsyncLogUdp(const IPAddress& ip, uint16_t port) {
+  portENTER_CRITICAL(&udpMux);
+  udpIP = ip;
+  udpPort = port;
+  portEXIT_CRITICAL(&udpMux);
+}
+
+TaskHandle_t getAsyncLogTaskHandle() {
+  return drainTaskHandle;
+}
+
+void getAsyncLogCounts(uint32_t& logged, uint32_t& dropped, uint32_t& truncated) {
+  logged = loggedCount.load(std::memory_order_relaxed);
+  dropped = droppedCount.load(std::memory_order_relaxed);
+  truncated = truncatedCount.load(std::memory_order_relaxed);
+}
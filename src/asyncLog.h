@@ -0,0 +1,68 @@
+#ifndef _ASYNC_LOG_H
+#define _ASYNC_LOG_H
+/*
+   asyncLog.h
+*/
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Non-blocking log for the hot paths, e.g. the advert task, where a debugPtr->print() at 115200 baud blocks for ms
+// LOG_E/LOG_W/LOG_I/LOG_D(fmt, ...) format into a fixed ring of ASYNC_LOG_SLOTS messages and return, they never wait
+// if the ring is full the message is dropped and counted, messages longer than ASYNC_LOG_MSG_SIZE-1 are cut short and counted
+// a low priority drain task writes the messages to Serial, to the added sinks (e.g. telnet) and to UDP if set
+// levels above LOG_LEVEL are removed at compile time, LOG_LEVEL defaults to LOG_LEVEL_DEBUG if DEBUG is defined else LOG_LEVEL_INFO
+// the ring is a bounded multi producer multi consumer queue, slots are claimed with an atomic compare and swap, no mutex
+// safe from any task, not from ISRs
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define ASYNC_LOG_SLOTS 32 // must be a power of 2
+#define ASYNC_LOG_MSG_SIZE 96 // including the '\0'
+#define ASYNC_LOG_MAX_SINKS 3
+#define ASYNC_LOG_TASK_STACK_SIZE 3072
+#define ASYNC_LOG_TASK_PRIORITY 1 // same as loop(), only runs when there are messages
+#define ASYNC_LOG_DRAIN_MS 20 // how often the drain task checks an empty ring
+
+void asyncLogf(uint8_t level, const char* fmt, ...) __attribute__((format(printf, 2, 3))); // use the LOG_x macros instead
+
+#if (LOG_LEVEL >= LOG_LEVEL_ERROR)
+#define LOG_E(...) asyncLogf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) do {} while (0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_WARN)
+#define LOG_W(...) asyncLogf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) do {} while (0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_INFO)
+#define LOG_I(...) asyncLogf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) do {} while (0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
+#define LOG_D(...) asyncLogf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) do {} while (0)
+#endif
+
+bool initializeAsyncLog(Print* serialOutPtr); // call first in setup(), starts the drain task, serialOutPtr may be NULL, returns false if the task failed
+typedef void (*asyncLogSinkFn)(const char* line, size_t len); // called from the drain task with one '\n' terminated line
+bool addAsyncLogSink(asyncLogSinkFn fn); // returns false if no room
+void setAsyncLogUdp(const IPAddress& ip, uint16_t port); // also send each line as a UDP packet, port 0 stops it
+TaskHandle_t getAsyncLogTaskHandle(); // for registerTaskStats()
+
+void getAsyncLogCounts(uint32_t& logged, uint32_t& dropped, uint32_t& truncated); // ring full => dropped
+
+#endif
@@ -0,0 +1,260 @@
+/*
+   configStore.cpp
+*/
+#include "configStore.h"
+#include "LittleFSsupport.h"
+#include <millisDelay.h>
+
+static Stream* debugPtr = NULL;  // local to this file
+
+void setConfigStoreDebug(Stream* debugOutPtr) {
+  debugPtr = debugOutPtr;
+}
+
+static const char configFileName[] = "/config.bin";
+static const char configTempFileName[] = "/config.tmp";
+bool isConfigStoreFile(const char* path) {
+  if (!path) {
+    return false;
+  }
+  while (*path == '/') { // LittleFS treats //config.bin as /config.bin
+    path++;
+  }
+  return (strcmp(path, configFileName + 1) == 0) || (strcmp(path, configTempFileName + 1) == 0);
+}
+
+static const uint32_t CONFIG_STORE_MAGIC = 0x43464731; // CFG1
+static const unsigned long CONFIG_STORE_RETRY_MS = 30000; // retry a failed save
+
+// file is header followed by count entries of keyLen(1), key, valueLen(2), value
+struct configHeader_struct {
+  uint32_t magic;
+  uint16_t count;
+  uint16_t reserved;
+  uint32_t length; // bytes of entries after the header
+  uint32_t crc; // CRC-32 of the entries
+};
+
+struct configEntry_struct {
+  char key[CONFIG_STORE_MAX_KEY_LEN + 1];
+  uint16_t len;
+  uint8_t value[CONFIG_STORE_MAX_VALUE_SIZE];
+};
+
+static struct configEntry_struct entries[CONFIG_STORE_MAX_KEYS];
+static size_t entryCount = 0;
+static bool storeLoaded = false;
+static bool storeDirty = false;
+static millisDelay commitTimer;
+
+static struct configEntry_struct* findEntry(const char* key) {
+  for (size_t i = 0; i < entryCount; i++) {
+    if (strcmp(entries[i].key, key) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+// reads and checks the whole file before replacing the RAM copy
+static bool loadConfigFile(const char* fileName) {
+  if (!LittleFS.exists(fileName)) {
+    return false;
+  }
+  File f = LittleFS.open(fileName, "r");
+  if (!f) {
+    return false;
+  }
+  struct configHeader_struct header;
+  if ((f.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) || (header.magic != CONFIG_STORE_MAGIC)
+      || (header.count > CONFIG_STORE_MAX_KEYS) || (header.length != (f.size() - sizeof(header)))) {
+    if (debugPtr) {
+      debugPtr->print(fileName); debugPtr->println(" bad header");
+    }
+    return false;
+  }
+  static struct configEntry_struct loaded[CONFIG_STORE_MAX_KEYS]; // static to keep it off the stack
+  uint32_t crc = 0;
+  for (size_t i = 0; i < header.count; i++) {
+    uint8_t keyLen = 0;
+    uint16_t len = 0;
+    memset(&loaded[i], 0, sizeof(loaded[i]));
+    if ((f.read(&keyLen, 1) != 1) || (keyLen > CONFIG_STORE_MAX_KEY_LEN) || (f.read((uint8_t*)loaded[i].key, keyLen) != keyLen)
+        || (f.read((uint8_t*)&len, sizeof(len)) != sizeof(len)) || (len > CONFIG_STORE_MAX_VALUE_SIZE)
+        || (f.read(loaded[i].value, len) != len)) {
+      if (debugPtr) {
+        debugPtr->print(fileName); debugPtr->println(" bad entry");
+      }
+      return false;
+    }
+    loaded[i].len = len;
+    crc = crc32Update(crc, &keyLen, 1);
+    crc = crc32Update(crc, (const uint8_t*)loaded[i].key, keyLen);
+    crc = crc32Update(crc, (const uint8_t*)&len, sizeof(len));
+    crc = crc32Update(crc, loaded[i].value, len);
+  }
+  if (crc != header.crc) {
+    if (debugPtr) {
+      debugPtr->print(fileName); debugPtr->println(" bad crc");
+    }
+    return false;
+  }
+  memcpy(entries, loaded, header.count * sizeof(entries[0]));
+  entryCount = header.count;
+  return true;
+}
+
+bool initializeConfigStore() {
+  if (storeLoaded) {
+    return true;
+  }
+  if (!initializeFS()) {
+    return false;
+  }
+  storeLoaded = true;
+  if (loadConfigFile(configFileName)) {
+    if (debugPtr) {
+      debugPtr->print("configStore loaded "); debugPtr->print(entryCount); debugPtr->println(" keys");
+    }
+  } else if (loadConfigFile(configTempFileName)) {
+    // power lost between writing the temp file and the rename
+    if (debugPtr) {
+      debugPtr->println("configStore recovered from temp file");
+    }
+    storeDirty = true;
+    configCommit();
+  } else {
+    entryCount = 0;
+  }
+  return true;
+}
+
+bool configGet(const char* key, void* value, size_t valueSize) {
+  if (!initializeConfigStore()) {
+    return false;
+  }
+  struct configEntry_struct* entry = findEntry(key);
+  if ((!entry) || (entry->len != valueSize)) {
+    return false;
+  }
+  memcpy(value, entry->value, valueSize);
+  return true;
+}
+
+bool configPut(const char* key, const void* value, size_t valueSize) {
+  if ((strlen(key) > CONFIG_STORE_MAX_KEY_LEN) || (valueSize > CONFIG_STORE_MAX_VALUE_SIZE)) {
+    if (debugPtr) {
+      debugPtr->print("configPut "); debugPtr->print(key); debugPtr->println(" too large");
+    }
+    return false;
+  }
+  initializeConfigStore();
+  struct configEntry_struct* entry = findEntry(key);
+  if (entry) {
+    if ((entry->len == valueSize) && (memcmp(entry->value, value, valueSize) == 0)) {
+      return true; // unchanged, nothing to write
+    }
+  } else {
+    if (entryCount >= CONFIG_STORE_MAX_KEYS) {
+      if (debugPtr) {
+        debugPtr->print("configPut no room for "); debugPtr->println(key);
+      }
+      return false;
+    }
+    entry = &entries[entryCount++];
+    memset(entry, 0, sizeof(*entry));
+    strlcpy(entry->key, key, sizeof(entry->key));
+  }
+  memcpy(entry->value, value, valueSize);
+  entry->len = valueSize;
+  storeDirty = true;
+  commitTimer.start(CONFIG_STORE_COMMIT_DELAY_MS); // restart on each change so a burst is one write
+  return true;
+}
+
+bool configRemove(const char* key) {
+  initializeConfigStore();
+  struct configEntry_struct* entry = findEntry(key);
+  if (!entry) {
+    return false;
+  }
+  size_t idx = entry - entries;
+  memmove(&entries[idx], &entries[idx + 1], (entryCount - idx - 1) * sizeof(entries[0]));
+  entryCount--;
+  storeDirty = true;
+  commitTimer.start(CONFIG_STORE_COMMIT_DELAY_MS);
+  return true;
+}
+
+static bool writeEntries(File& f, uint32_t* crcPtr, size_t* lengthPtr) {
+  uint32_t crc = 0;
+  size_t length = 0;
+  for (size_t i = 0; i < entryCount; i++) {
+    uint8_t keyLen = (uint8_t)strlen(entries[i].key);
+    uint16_t len = entries[i].len;
+    crc = crc32Update(crc, &keyLen, 1);
+    crc = crc32Update(crc, (const uint8_t*)entries[i].key, keyLen);
+    crc = crc32Update(crc, (const uint8_t*)&len, sizeof(len));
+    crc = crc32Update(crc, entries[i].value, len);
+    length += 1 + keyLen + sizeof(len) + len;
+    if (f) {
+      if ((f.write(&keyLen, 1) != 1) || (f.write((const uint8_t*)entries[i].key, keyLen) != keyLen)
+          || (f.write((const uint8_t*)&len, sizeof(len)) != sizeof(len)) || (f.write(entries[i].value, len) != len)) {
+        return false;
+      }
+    }
+  }
+  *crcPtr = crc;
+  *lengthPtr = length;
+  return true;
+}
+
+bool configCommit() {
+  commitTimer.stop();
+  if (!storeDirty) {
+    return true;
+  }
+  if (!initializeFS()) {
+    return false;
+  }
+  struct configHeader_struct header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CONFIG_STORE_MAGIC;
+  header.count = entryCount;
+  File noFile;
+  size_t length = 0;
+  writeEntries(noFile, &header.crc, &length); // just calculate crc and length
+  header.length = length;
+
+  File f = LittleFS.open(configTempFileName, "w");
+  if (!f) {
+    if (debugPtr) {
+      debugPtr->print(configTempFileName); debugPtr->println(" did not open for write.");
+    }
+    commitTimer.start(CONFIG_STORE_RETRY_MS);
+    return false;
+  }
+  uint32_t crc;
+  bool ok = (f.write((const uint8_t*)&header, sizeof(header)) == sizeof(header)) && writeEntries(f, &crc, &length);
+  f.close();
+  // LittleFS rename replaces the old file atomically
+  if ((!ok) || (!LittleFS.rename(configTempFileName, configFileName))) {
+    if (debugPtr) {
+      debugPtr->println("configStore save failed");
+    }
+    LittleFS.remove(configTempFileName);
+    commitTimer.start(CONFIG_STORE_RETRY_MS);
+    return false;
+  }
+  storeDirty = false;
+  if (debugPtr) {
+    debugPtr->print("configStore saved "); debugPtr->print(entryCount); debugPtr->println(" keys");
+  }
+  return true;
+}
+
+void processConfigStore() {
+  if (commitTimer.justFinished()) {
+    configCommit();
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef _CONFIG_STORE_H
+#define _CONFIG_STORE_H
+/*
+   configStore.h
+*/
+#include <Arduino.h>
+
+// Key/value config settings held in RAM and saved as one CRC checked file on LittleFS
+// saves write /config.tmp and then rename it over /config.bin, so a power loss leaves either the old or the new settings
+// configPut() only marks the store dirty if the value changed, processConfigStore() then saves once the changes stop for
+// CONFIG_STORE_COMMIT_DELAY_MS, so a burst of changes is one flash write
+// Only call these from setup()/loop(), they are not thread safe
+#define CONFIG_STORE_MAX_KEYS 8
+#define CONFIG_STORE_MAX_KEY_LEN 15
+#define CONFIG_STORE_MAX_VALUE_SIZE 160
+#define CONFIG_STORE_COMMIT_DELAY_MS 2000
+
+bool initializeConfigStore(); // loads the settings, only reads the FS the first time it is called, returns false if FS failed
+bool configGet(const char* key, void* value, size_t valueSize); // returns false if key missing or stored size != valueSize
+bool configPut(const char* key, const void* value, size_t valueSize); // returns false if no room or too large
+bool configRemove(const char* key); // returns false if key missing
+bool configCommit(); // save now if dirty, returns false if the save failed
+bool isConfigStoreFile(const char* path); // true for /config.bin and /config.tmp, file services must refuse these
+void processConfigStore(); // call each loop(), saves dirty settings after CONFIG_STORE_COMMIT_DELAY_MS
+
+void setConfigStoreDebug(Stream* debugOutPtr); // for debug output
+
+#endif
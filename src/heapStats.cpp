@@ -0,0 +1,179 @@
+/*
+   heapStats.cpp
+*/
+#include "heapStats.h"
+#include "configStore.h"
+#include <millisDelay.h>
+#include <esp_heap_caps.h>
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+#include <esp_heap_trace.h>
+#endif
+
+static Stream* debugPtr = NULL;  // local to this file
+
+void setHeapStatsDebug(Stream* debugOutPtr) {
+  debugPtr = debugOutPtr;
+}
+
+static const char heapAlarmConfigKey[] = "heapAlarm"; // configStore key
+
+struct heapAlarm_struct {
+  uint32_t minFree; // 0 => not checked
+  uint32_t minLargestBlock; // 0 => not checked
+};
+
+struct heapUser_struct {
+  const char* name;
+  heapUserBytesFn fn;
+};
+
+// only used from setup()/loop()
+static struct heapAlarm_struct alarmThresholds = {HEAP_ALARM_DEFAULT_MIN_FREE, HEAP_ALARM_DEFAULT_MIN_LARGEST};
+static struct heapUser_struct heapUsers[HEAP_STATS_MAX_USERS];
+static size_t heapUserCount = 0;
+static multi_heap_info_t lastSample;
+static uint32_t lowestLargestBlock = 0; // smallest largest free block seen at a sample
+static uint32_t samples = 0;
+static uint32_t alarmCount = 0;
+static bool alarmActive = false;
+static millisDelay sampleTimer;
+
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+#define HEAP_TRACE_RECORDS 100
+static heap_trace_record_t traceRecords[HEAP_TRACE_RECORDS]; // outstanding allocations, oldest are dropped when full
+#endif
+
+static void takeSample() {
+  heap_caps_get_info(&lastSample, MALLOC_CAP_8BIT);
+  if ((samples == 0) || (lastSample.largest_free_block < lowestLargestBlock)) {
+    lowestLargestBlock = lastSample.largest_free_block;
+  }
+  samples++;
+}
+
+void initializeHeapStats() {
+  struct heapAlarm_struct saved;
+  if (configGet(heapAlarmConfigKey, &saved, sizeof(saved))) {
+    alarmThresholds = saved;
+  }
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+  if ((heap_trace_init_standalone(traceRecords, HEAP_TRACE_RECORDS) == ESP_OK) && (heap_trace_start(HEAP_TRACE_LEAKS) == ESP_OK)) {
+    if (debugPtr) {
+      debugPtr->println("heapStats heap tracing started");
+    }
+  }
+#endif
+  takeSample();
+  sampleTimer.start(HEAP_STATS_SAMPLE_MS);
+  if (debugPtr) {
+    debugPtr->print("heapStats free "); debugPtr->print(lastSample.total_free_bytes);
+    debugPtr->print(" largest "); debugPtr->print(lastSample.largest_free_block);
+    debugPtr->print(" alarm below "); debugPtr->print(alarmThresholds.minFree);
+    debugPtr->print(" / "); debugPtr->println(alarmThresholds.minLargestBlock);
+  }
+}
+
+static bool isBelow(uint32_t value, uint32_t threshold) {
+  return (threshold != 0) && (value < threshold);
+}
+
+static bool isRecovered(uint32_t value, uint32_t threshold) {
+  return (threshold == 0) || (value >= (threshold + HEAP_ALARM_HYSTERESIS));
+}
+
+bool processHeapStats() {
+  if (!sampleTimer.justFinished()) {
+    return false;
+  }
+  sampleTimer.start(HEAP_STATS_SAMPLE_MS);
+  takeSample();
+  uint32_t freeBytes = lastSample.total_free_bytes;
+  uint32_t largest = lastSample.largest_free_block;
+  if (alarmActive) {
+    if (isRecovered(freeBytes, alarmThresholds.minFree) && isRecovered(largest, alarmThresholds.minLargestBlock)) {
+      alarmActive = false;
+      if (debugPtr) {
+        debugPtr->println("heapStats alarm cleared");
+      }
+    }
+    return false;
+  }
+  if (isBelow(freeBytes, alarmThresholds.minFree) || isBelow(largest, alarmThresholds.minLargestBlock)) {
+    alarmActive = true;
+    alarmCount++;
+    if (debugPtr) {
+      streamHeapAlarmDump(*debugPtr);
+    }
+    return true;
+  }
+  return false;
+}
+
+void setHeapAlarmThresholds(uint32_t minFree, uint32_t minLargestBlock) {
+  alarmThresholds.minFree = minFree;
+  alarmThresholds.minLargestBlock = minLargestBlock;
+  alarmActive = false; // check again at the next sample
+  configPut(heapAlarmConfigKey, &alarmThresholds, sizeof(alarmThresholds)); // processConfigStore() saves it
+}
+
+void getHeapAlarmThresholds(uint32_t& minFree, uint32_t& minLargestBlock) {
+  minFree = alarmThresholds.minFree;
+  minLargestBlock = alarmThresholds.minLargestBlock;
+}
+
+bool registerHeapUser(const char* name, heapUserBytesFn fn) {
+  if ((!fn) || (heapUserCount >= HEAP_STATS_MAX_USERS)) {
+    return false;
+  }
+  heapUsers[heapUserCount].name = name;
+  heapUsers[heapUserCount].fn = fn;
+  heapUserCount++;
+  return true;
+}
+
+void streamHeapStats(Print& out) {
+  out.print("heap free "); out.print(lastSample.total_free_bytes);
+  out.print(" largest "); out.print(lastSample.largest_free_block);
+  out.print(" minFree "); out.print(heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT)); // lowest ever, not just at samples
+  out.print(" minLargest "); out.println(lowestLargestBlock);
+  out.print("heap allocated "); out.print(lastSample.total_allocated_bytes);
+  out.print(" blocks "); out.print(lastSample.allocated_blocks);
+  out.print(" free blocks "); out.println(lastSample.free_blocks);
+  out.print("heap samples "); out.print(samples);
+  out.print(" alarms "); out.print(alarmCount); out.print(alarmActive ? " active" : "");
+  out.print(" alarm below "); out.print(alarmThresholds.minFree);
+  out.print(" / "); out.println(alarmThresholds.minLargestBlock);
+}
+
+void streamHeapAlarmDump(Print& out) {
+  out.println("heap alarm");
+  streamHeapStats(out);
+  // top users, largest first
+  size_t bytes[HEAP_STATS_MAX_USERS];
+  bool listed[HEAP_STATS_MAX_USERS];
+  for (size_t i = 0; i < heapUserCount; i++) {
+    bytes[i] = heapUsers[i].fn();
+    listed[i] = false;
+  }
+  for (size_t n = 0; n < heapUserCount; n++) {
+    size_t top = heapUserCount;
+    for (size_t i = 0; i < heapUserCount; i++) {
+      if ((!listed[i]) && ((top == heapUserCount) || (bytes[i] > bytes[top]))) {
+        top = i;
+      }
+    }
+    listed[top] = true;
+    out.print("  "); out.print(heapUsers[top].name); out.print(' '); out.println(bytes[top]);
+  }
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+  // outstanding allocations, with the address of the caller that made them
+  size_t count = heap_trace_get_count();
+  out.print("heap trace outstanding "); out.println(count);
+  for (size_t i = 0; i < count; i++) {
+    heap_trace_record_t record;
+    if ((heap_trace_get(i, &record) == ESP_OK) && (record.size >= 256)) { // skip the small stuff
+      out.print("  "); out.print(record.size); out.print(" by 0x"); out.println((uint32_t)record.alloced_by[0], HEX);
+    }
+  }
+#endif
+}
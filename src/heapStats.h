@@ -0,0 +1,33 @@
+#ifndef _HEAP_STATS_H
+#define _HEAP_STATS_H
+/*
+   heapStats.h
+*/
+#include <Arduino.h>
+
+// Heap telemetry, samples the 8bit heap every HEAP_STATS_SAMPLE_MS from loop()
+// records free bytes, largest free block (fragmentation), the minimum ever free and the allocated/free block counts
+// an alarm is raised when free or largest block drops below its threshold, it re-arms once both recover by HEAP_ALARM_HYSTERESIS
+// the thresholds are saved in configStore
+// modules that hold heap register a bytes function with registerHeapUser() so the alarm dump can list the top users
+// if heap tracing is enabled in sdkconfig (CONFIG_HEAP_TRACING_STANDALONE) the dump also includes the outstanding allocations
+#define HEAP_STATS_SAMPLE_MS 10000
+#define HEAP_ALARM_DEFAULT_MIN_FREE 24000
+#define HEAP_ALARM_DEFAULT_MIN_LARGEST 8000
+#define HEAP_ALARM_HYSTERESIS 4096
+#define HEAP_STATS_MAX_USERS 8
+
+void initializeHeapStats(); // call from setup() after initializeConfigStore(), loads the thresholds and takes the first sample
+bool processHeapStats(); // call each loop(), returns true when an alarm is first raised, then call streamHeapAlarmDump()
+void setHeapAlarmThresholds(uint32_t minFree, uint32_t minLargestBlock); // 0 disables that check, saved via configStore
+void getHeapAlarmThresholds(uint32_t& minFree, uint32_t& minLargestBlock);
+
+typedef size_t (*heapUserBytesFn)(); // returns bytes of heap currently held
+bool registerHeapUser(const char* name, heapUserBytesFn fn); // returns false if no room, name must be a static string
+
+void streamHeapStats(Print& out); // latest sample and counters, a few lines
+void streamHeapAlarmDump(Print& out); // heap stats, top heap users largest first, and the heap trace if enabled
+
+void setHeapStatsDebug(Stream* debugOutPtr); // for debug output
+
+#endif
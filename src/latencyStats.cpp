@@ -0,0 +1,82 @@
+/*
+   latencyStats.cpp
+*/
+#include "latencyStats.h"
+
+struct latencyStage_struct {
+  const char* name;
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t total_us;
+  uint32_t buckets[LATENCY_BUCKETS];
+};
+
+static struct latencyStage_struct stages[LATENCY_MAX_STAGES];
+static int stageCount = 0;
+static uint32_t cyclesPerUs = 0; // set on first registerLatencyStage()
+
+int registerLatencyStage(const char* name) {
+  if (stageCount >= LATENCY_MAX_STAGES) {
+    return -1;
+  }
+  if (cyclesPerUs == 0) {
+    cyclesPerUs = ESP.getCpuFreqMHz();
+  }
+  memset(&stages[stageCount], 0, sizeof(stages[stageCount]));
+  stages[stageCount].name = name;
+  return stageCount++;
+}
+
+static int bucketFor(uint32_t us) {
+  int bucket = 0;
+  while ((us > 1) && (bucket < (LATENCY_BUCKETS - 1))) { // floor(log2(us))
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void latencyEnd(int stageId, uint32_t startCycles) {
+  if ((stageId < 0) || (stageId >= stageCount)) {
+    return;
+  }
+  uint32_t us = (ESP.getCycleCount() - startCycles) / cyclesPerUs; // unsigned subtract handles one wrap
+  struct latencyStage_struct& stage = stages[stageId];
+  stage.count++;
+  stage.total_us += us;
+  if (us > stage.max_us) {
+    stage.max_us = us;
+  }
+  stage.buckets[bucketFor(us)]++;
+}
+
+void resetLatencyStats() {
+  for (int i = 0; i < stageCount; i++) {
+    const char* name = stages[i].name;
+    memset(&stages[i], 0, sizeof(stages[i]));
+    stages[i].name = name;
+  }
+}
+
+void streamLatencyStats(Print& out) {
+  out.println("stage count mean_us max_us <bucket_us:count");
+  for (int i = 0; i < stageCount; i++) {
+    const struct latencyStage_struct& stage = stages[i];
+    out.print(stage.name); out.print(' ');
+    out.print(stage.count); out.print(' ');
+    out.print(stage.count ? (uint32_t)(stage.total_us / stage.count) : 0); out.print(' ');
+    out.print(stage.max_us);
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+      if (stage.buckets[b]) {
+        out.print(' ');
+        if (b == (LATENCY_BUCKETS - 1)) {
+          out.print(">="); out.print(1UL << b); // open ended
+        } else {
+          out.print('<'); out.print(2UL << b);
+        }
+        out.print(':'); out.print(stage.buckets[b]);
+      }
+    }
+    out.println();
+  }
+}
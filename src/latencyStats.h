@@ -0,0 +1,24 @@
+#ifndef _LATENCY_STATS_H
+#define _LATENCY_STATS_H
+/*
+   latencyStats.h
+*/
+#include <Arduino.h>
+
+// Latency histograms for the stages of loop() and the web server routes, to find which one stalls loop()
+// timed with the CPU cycle counter, no heap used, each stage has LATENCY_BUCKETS log2 buckets
+// bucket 0 counts < 2us, bucket n counts 2^n to 2^(n+1)-1 us, the last bucket also counts anything longer
+// the cycle counter wraps every 2^32 / CPU clock, about 26sec at 160MHz, so a single stall longer than that is under reported
+// Only call these from setup()/loop(), they are not thread safe
+#define LATENCY_MAX_STAGES 16
+#define LATENCY_BUCKETS 24 // last bucket is >= 8.4sec
+
+int registerLatencyStage(const char* name); // returns the stage id, or -1 if no room, name must be a static string
+inline uint32_t latencyStart() { // pass the result to latencyEnd()
+  return ESP.getCycleCount();
+}
+void latencyEnd(int stageId, uint32_t startCycles); // adds the time since latencyStart() to the stage's histogram, ignores id -1
+void resetLatencyStats(); // clears the counts, keeps the stages
+void streamLatencyStats(Print& out); // one line per stage, "name count mean_us max_us <bucket_us:count ..."
+
+#endif
@@ -23,35 +23,124 @@
 #include "ntpSupport.h"
 #include "tzPosix.h"
 #include <millisDelay.h>
-#include <time.h>                       // time() ctime()
+#include <time.h>                       // time() localtime_r()
 #include <sys/time.h>                   // struct timeval
 #include "millisDelay.h"
 #include "LittleFSsupport.h"
+#include "configStore.h"
+#include "BufferPrint.h"
 
 #include <WiFi.h>
 
-#include "WiFiUdp.h"
+#include "AsyncUDP.h"
+#include "lwip/dns.h"
+#include "lwip/tcpip.h"
+#include "esp_timer.h"  // esp_timer_get_time() 64bit us since boot, not affected by setTime()
 // A UDP instance to let us send and receive packets over UDP
-static WiFiUDP udp;
+// replies are received by a callback in the lwIP task as soon as they arrive, see onNTPpacket()
+static AsyncUDP udp;
 static bool udpRunning = false;
 static unsigned int localPort = 8888;       // local port to listen for UDP packets
-static const char timeServer[] = "pool.ntp.org";//"time.nist.gov"; // time.nist.gov NTP server
+// NTP servers are used in rotation, one request per server per burst, so one bad server is out voted by the others
+// use setNTPservers() to replace this list
+static const char* const defaultTimeServers[] = {"0.pool.ntp.org", "1.pool.ntp.org", "time.google.com"};//"time.nist.gov";
+static const char* const *timeServers = defaultTimeServers;
+static size_t numTimeServers = sizeof(defaultTimeServers) / sizeof(defaultTimeServers[0]);
+static size_t nextTimeServerIdx = 0; // next server to send a request to
+static const size_t MAX_NTP_SERVERS = 8; // extra servers passed to setNTPservers() are ignored
+
+// resolved server addresses, looked up in the background by lwIP so processNTP() never waits for DNS
+// if a lookup fails the last known good address continues to be used
+struct ntpServerAddr_struct {
+  const char* name;
+  volatile uint32_t ip; // last known good IPv4 address, 0 if never resolved
+  volatile unsigned long resolved_ms; // millis() when ip was last resolved
+  unsigned long lookup_ms; // millis() when the last lookup was started
+  volatile bool lookupPending; // cleared by ntpDnsFound()
+};
+static struct ntpServerAddr_struct ntpServerAddrs[MAX_NTP_SERVERS];
+static const unsigned long DNS_CACHE_TTL_MS = 60ul * 60 * 1000; // re-resolve after 60mins, lwIP's own cache handles shorter record TTLs
+static const unsigned long DNS_RETRY_MS = 60ul * 1000; // retry a failed lookup after 60sec
+static const unsigned long DNS_WAIT_MS = 100; // on startup wait in 100ms steps for the first address
 static const int NTP_PACKET_SIZE = 48; // NTP time stamp is in the first 48 bytes of the message
 static byte packetBuffer[NTP_PACKET_SIZE]; //buffer to hold incoming and outgoing packets
 static millisDelay updateTimer; // time between update requests initially 20sec and then 60min get time from sntp_update_delay_MS_rfc_not_less_than_15000()
-static millisDelay responseTimer; // wait upto 10sec for a response if this is running then a request has been made.
+static millisDelay responseTimer; // wait upto 10sec after the last request for the replies, if this is running then a request has been made.
 static const unsigned long UDP_ResponseTime = 10ul * 1000; // 10sec
-static const unsigned long responseTimer_ms = 500; // 0.5sec
-static const unsigned int MAX_ResponseCounter = UDP_ResponseTime / responseTimer_ms; // count in 0.5sec intervals
-static unsigned int responseCounter = 0;
 
-static void sendNTPpacket(const char * address);
+// each update sends a burst of requests, 2sec apart as for NTP iburst, and then uses the best of the replies
+static const unsigned int NTP_BURST_SIZE = 4; // requests per update
+static const unsigned long NTP_BURST_SPACING_MS = 2000; // 2sec between requests
+static millisDelay burstTimer; // time to send the next request of the burst
+static const unsigned long MAX_ResponseTime = (NTP_BURST_SIZE - 1) * NTP_BURST_SPACING_MS + UDP_ResponseTime;
+static const int64_t MAX_NTP_DELAY_US = 1000000; // ignore replies that took more than 1sec round trip
+static const int64_t NTP_OUTLIER_US = 128000; // 128ms, NTP step threshold, servers further than this from the median are ignored
+
+// one per request sent in the burst
+struct ntpRequest_struct {
+  int64_t sent_us; // esp_timer_get_time() when sent, also sent as the transmit timestamp and echoed back by the server
+  uint8_t serverIdx;
+  bool replied;
+};
+static struct ntpRequest_struct ntpRequests[NTP_BURST_SIZE];
+static unsigned int numRequestsSent = 0;
+
+// one per valid reply
+struct ntpSample_struct {
+  int64_t epochAtBoot_us; // Unix time in us when esp_timer_get_time() was 0, i.e. Unix time = esp_timer_get_time() + epochAtBoot_us
+  int64_t delay_us; // round trip delay less server processing time
+  uint32_t rootDelay; // server's root delay, NTP short format, 16.16 secs
+  uint32_t rootDispersion; // server's root dispersion, NTP short format
+  uint32_t serverIp;
+  uint8_t stratum;
+  uint8_t leapIndicator; // server's LI, 0 none, 1 last minute has 61 secs, 2 last minute has 59 secs
+  uint8_t serverIdx;
+};
+static struct ntpSample_struct ntpSamples[NTP_BURST_SIZE];
+static unsigned int numSamples = 0;
+
+// ------------ local SNTP server, see enableSNTPserver() ---------------
+static AsyncUDP sntpServerUdp;
+static bool sntpServerRunning = false;
+static const uint16_t SNTP_SERVER_PORT = 123;
+static const unsigned int MAX_SNTP_REQUESTS_PER_SEC = 20; // requests over this in any one second are dropped
+static unsigned long sntpRateLimitSec = 0; // millis()/1000 of the current rate limit period
+static unsigned int sntpRequestsThisSec = 0;
+static uint32_t sntpRequestsServed = 0;
+static uint32_t sntpRequestsDropped = 0;
+// copy of the last selected sample, read by the SNTP server in the lwIP task
+struct sntpRefData_struct {
+  bool synchronized;
+  uint8_t stratum; // our stratum, upstream + 1
+  uint8_t leapIndicator; // passed on from the upstream server
+  uint32_t refId; // upstream server IPv4 address
+  int64_t refTime_us; // Unix time in us of the last update
+  uint32_t rootDelay; // NTP short format
+  uint32_t rootDispersion; // NTP short format
+};
+static struct sntpRefData_struct sntpRefData = {false, 0, 0, 0, 0, 0, 0};
+static portMUX_TYPE sntpServerMux = portMUX_INITIALIZER_UNLOCKED;
+
+// replies are queued here by onNTPpacket() and processed by processNTP()
+struct ntpReply_struct {
+  int64_t received_us; // esp_timer_get_time() when the reply arrived
+  int size;
+  byte data[NTP_PACKET_SIZE];
+};
+static const unsigned int NTP_REPLY_QUEUE_SIZE = NTP_BURST_SIZE;
+static struct ntpReply_struct ntpReplyQueue[NTP_REPLY_QUEUE_SIZE];
+static unsigned int ntpReplyHead = 0; // next free slot, only updated by onNTPpacket()
+static unsigned int ntpReplyTail = 0; // next reply to process, only updated by processNTP()
+static portMUX_TYPE ntpReplyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void sendNTPpacket(const IPAddress& address, int64_t sent_us);
 
 // define a weak getDefaultTZ method that can be defined elsewhere if you want to set a default TZ
+// returns an IANA zone name, e.g. "Europe/Berlin", or a POSIX TZ string if the name is not in tzIanaTable.h
 const char* get_ntpSupport_DefaultTZ() __attribute__((weak));
 
 const char* get_ntpSupport_DefaultTZ() {
-  return "AEST-10AEDT-11,M10.1.0/2,M4.1.0/3";
+  return "Australia/Sydney";
 }
 
 static bool ntpSupportInitialized = false;
@@ -98,7 +187,8 @@ static bool needToSaveConfigFlag = false;
 
 static void showTimeDebug();
 
-static const char timeZoneConfigFileName[] = "/timeZoneCfg.bin";  // binary file
+static const char timeZoneConfigFileName[] = "/timeZoneCfg.bin";  // binary file, only read to migrate it to configStore
+static const char timeZoneConfigKey[] = "tz"; // configStore key
 
 extern "C" int clock_gettime(clockid_t unused, struct timespec *tp);
 static bool saveTimeZoneConfig(struct timeZoneConfig_struct& timeZoneConfig);
@@ -122,6 +212,7 @@ bool saveTZconfigIfNeeded() { // saves any TZ config changes
   bool rtn = false;
   if (needToSaveConfigFlag) {
     saveTimeZoneConfig(timeZoneConfig);
+    configCommit();
     rtn = true;
     needToSaveConfigFlag = false;
   }
@@ -136,22 +227,122 @@ static void setUTCconfigTime() {
 
 extern "C" void tzset(); // esp32
 
+// the current TZ parsed, built by setTZ() and copied in under tzTableMux so readers on other tasks never see half of it
+struct tzCache_struct {
+  struct posix_tz_data_struct posixData;
+  char str[POSIX_TZ_STR_SIZE]; // TZ env str, "none" if TZ not set
+  char description[TZ_DESCRIPTION_SIZE]; // human readable
+};
+static struct tzCache_struct tzCache;
+static bool tzCacheValid = false; // false until the first setTZ()
+static uint32_t tzGeneration = 0; // incremented by setTZ(), so a table built from an older TZ is not kept
+
+// DST start/end for one year calculated from tzCache.posixData, so converting UTC to local time is a compare and an add
+// rebuilt by utcToLocal() when the TZ changes or the time moves outside the year
+static bool tzTableValid = false;
+static int64_t tzTableFromUtc = 0; // table is valid for UTC times from here
+static int64_t tzTableToUtc = 0; // up to, but not including, here
+static bool tzTableHasDst = false;
+static int64_t tzTableDstStartUtc = 0;
+static int64_t tzTableDstEndUtc = 0;
+static int tzTableOffset_min = 0; // copies of tzCache.posixData offsets so readers get a consistent set under tzTableMux
+static int tzTableDstOffset_min = 0;
+static portMUX_TYPE tzTableMux = portMUX_INITIALIZER_UNLOCKED; // guards tzCache, tzCacheValid, tzGeneration and the table
+
+static void buildTZcache(const char* tz_str, struct tzCache_struct& cache) {
+  if (!tz_str) {
+    strlcpy(cache.str, "none", sizeof(cache.str));
+    posixTZDataFromStr("", 0, cache.posixData);
+  } else {
+    strlcpy(cache.str, tz_str, sizeof(cache.str));
+    posixTZDataFromStr(tz_str, strlen(tz_str), cache.posixData);
+  }
+  buildPOSIXdescription(cache.posixData, cache.description, sizeof(cache.description));
+}
+
 // for esp32 add this
+// only called from setup()/loop()
 static void setTZ(const char* tz_str) {
   setenv("TZ", tz_str, 1);
   tzset();
+  static struct tzCache_struct newCache; // static to keep it off the stack
+  buildTZcache(tz_str, newCache); // parse outside the lock
+  portENTER_CRITICAL(&tzTableMux);
+  tzCache = newCache;
+  tzCacheValid = true;
+  tzGeneration++;
+  tzTableValid = false;
+  portEXIT_CRITICAL(&tzTableMux);
 }
 
+// copy of the current TZ, before the first setTZ() it is parsed from the TZ env into cache without touching tzCache
+static void getTZcache(struct tzCache_struct& cache) {
+  portENTER_CRITICAL(&tzTableMux);
+  bool valid = tzCacheValid;
+  if (valid) {
+    cache = tzCache;
+  }
+  portEXIT_CRITICAL(&tzTableMux);
+  if (!valid) {
+    buildTZcache(getenv("TZ"), cache);
+  }
+}
+
+// Unix time in ms when getMonotonic_ms() was 0, updated each time the clock is set
+// seeded from the system clock on first use, after ESP.restart() the clock keeps running so the mapping is valid before NTP
+static int64_t epochAtBoot_ms = 0;
+static bool epochMappingSet = false;
+static portMUX_TYPE epochMappingMux = portMUX_INITIALIZER_UNLOCKED; // 64bit read/write not atomic
+
 void setTime(long epochSecs, int us) {
   struct timeval tv;
   tv.tv_sec = epochSecs;  // epoch time (seconds)
   tv.tv_usec = us;    // microseconds
+  int64_t monotonic_ms = getMonotonic_ms();
   settimeofday(&tv, NULL);
+  portENTER_CRITICAL(&epochMappingMux);
+  epochAtBoot_ms = (int64_t)epochSecs * 1000 + us / 1000 - monotonic_ms;
+  epochMappingSet = true;
+  portEXIT_CRITICAL(&epochMappingMux);
+}
+
+int64_t getMonotonic_ms() {
+  return esp_timer_get_time() / 1000;
+}
+
+static int64_t getEpochAtBoot_ms() {
+  portENTER_CRITICAL(&epochMappingMux);
+  bool isSet = epochMappingSet;
+  int64_t rtn = epochAtBoot_ms;
+  portEXIT_CRITICAL(&epochMappingMux);
+  if (isSet) {
+    return rtn;
+  }
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t seed_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - getMonotonic_ms();
+  portENTER_CRITICAL(&epochMappingMux);
+  if (!epochMappingSet) { // setTime() may have run since
+    epochAtBoot_ms = seed_ms;
+    epochMappingSet = true;
+  }
+  rtn = epochAtBoot_ms;
+  portEXIT_CRITICAL(&epochMappingMux);
+  return rtn;
+}
+
+int64_t monotonicToEpoch_ms(int64_t monotonic_ms) {
+  return monotonic_ms + getEpochAtBoot_ms();
+}
+
+int64_t epochToMonotonic_ms(int64_t epoch_ms) {
+  return epoch_ms - getEpochAtBoot_ms();
 }
 
 
 // send an NTP request to the time server at the given address
-static void sendNTPpacket(const char * address) {
+// sent_us is sent as the transmit timestamp, the server returns it as the originate timestamp so the reply can be matched to this request
+static void sendNTPpacket(const IPAddress& address, int64_t sent_us) {
   // set all bytes in the buffer to 0
   memset(packetBuffer, 0, NTP_PACKET_SIZE);
   // Initialize values needed to form NTP request
@@ -165,17 +356,130 @@ static void sendNTPpacket(const char * address) {
   packetBuffer[13]  = 0x4E;
   packetBuffer[14]  = 49;
   packetBuffer[15]  = 52;
+  // transmit timestamp, bytes 40 to 47
+  for (int i = 0; i < 8; i++) {
+    packetBuffer[47 - i] = (byte)(((uint64_t)sent_us) >> (8 * i));
+  }
 
   // all NTP fields have been given values, now
   // you can send a packet requesting a timestamp:
-  udp.beginPacket(address, 123); // NTP requests are to port 123
-  udp.write(packetBuffer, NTP_PACKET_SIZE);
-  udp.endPacket();
-  if (debugPtr) {
-    debugPtr->println("Sent NTP UDP request");
+  udp.writeTo(packetBuffer, NTP_PACKET_SIZE, address, 123); // NTP requests are to port 123
+}
+
+// called from the lwIP task, so just timestamp and queue the reply for processNTP()
+static void onNTPpacket(AsyncUDPPacket& packet) {
+  int64_t received_us = esp_timer_get_time();
+  size_t size = packet.length();
+  if (size > NTP_PACKET_SIZE) {
+    size = NTP_PACKET_SIZE; // only need the first 48 bytes
+  }
+  portENTER_CRITICAL(&ntpReplyMux);
+  if ((ntpReplyHead - ntpReplyTail) < NTP_REPLY_QUEUE_SIZE) {
+    struct ntpReply_struct& reply = ntpReplyQueue[ntpReplyHead % NTP_REPLY_QUEUE_SIZE];
+    reply.received_us = received_us;
+    reply.size = packet.length();
+    memcpy(reply.data, packet.data(), size);
+    ntpReplyHead++;
+  } // else queue full drop this one
+  portEXIT_CRITICAL(&ntpReplyMux);
+}
+
+// returns false if no reply queued
+static bool getNextNTPreply(int& size, int64_t& received_us) {
+  bool rtn = false;
+  portENTER_CRITICAL(&ntpReplyMux);
+  if (ntpReplyTail != ntpReplyHead) {
+    struct ntpReply_struct& reply = ntpReplyQueue[ntpReplyTail % NTP_REPLY_QUEUE_SIZE];
+    received_us = reply.received_us;
+    size = reply.size;
+    memcpy(packetBuffer, reply.data, NTP_PACKET_SIZE);
+    ntpReplyTail++;
+    rtn = true;
+  }
+  portEXIT_CRITICAL(&ntpReplyMux);
+  return rtn;
+}
+
+void setNTPservers(const char* const servers[], size_t numServers) {
+  if ((servers == NULL) || (numServers == 0)) {
+    timeServers = defaultTimeServers;
+    numTimeServers = sizeof(defaultTimeServers) / sizeof(defaultTimeServers[0]);
+  } else {
+    timeServers = servers;
+    numTimeServers = numServers;
+    if (numTimeServers > MAX_NTP_SERVERS) {
+      numTimeServers = MAX_NTP_SERVERS;
+    }
+  }
+  nextTimeServerIdx = 0;
+  for (size_t i = 0; i < MAX_NTP_SERVERS; i++) {
+    ntpServerAddrs[i].name = (i < numTimeServers) ? timeServers[i] : NULL;
+    ntpServerAddrs[i].ip = 0;
+    ntpServerAddrs[i].resolved_ms = 0;
+  }
+}
+
+// called by lwIP in the tcpip thread when a lookup completes, ipaddr is NULL if it failed
+static void ntpDnsFound(const char *name, const ip_addr_t *ipaddr, void *arg) {
+  struct ntpServerAddr_struct* addrPtr = (struct ntpServerAddr_struct*)arg;
+  if (ipaddr && IP_IS_V4(ipaddr) && (addrPtr->name) && (strcmp(name, addrPtr->name) == 0)) {
+    addrPtr->ip = ip_2_ip4(ipaddr)->addr;
+    addrPtr->resolved_ms = millis();
+  } // else keep last known good address
+  addrPtr->lookupPending = false;
+}
+
+// runs in the tcpip thread, lwIP dns calls are not thread safe
+static void ntpDnsLookup(void *arg) {
+  struct ntpServerAddr_struct* addrPtr = (struct ntpServerAddr_struct*)arg;
+  ip_addr_t addr;
+  err_t err = ERR_ARG;
+  if (addrPtr->name) {
+    err = dns_gethostbyname(addrPtr->name, &addr, ntpDnsFound, addrPtr);
+  }
+  if (err == ERR_OK) { // was in lwIP's cache
+    ntpDnsFound(addrPtr->name, &addr, addrPtr);
+  } else if (err != ERR_INPROGRESS) {
+    ntpDnsFound(addrPtr->name, NULL, addrPtr);
+  } // else ntpDnsFound() called when the lookup completes
+}
+
+// start a background lookup for any server with no address or whose address is older than DNS_CACHE_TTL_MS
+static void refreshNTPserverAddresses() {
+  if (!WiFi.isConnected()) {
+    return;
+  }
+  unsigned long now_ms = millis();
+  for (size_t i = 0; i < numTimeServers; i++) {
+    struct ntpServerAddr_struct& addr = ntpServerAddrs[i];
+    if (addr.lookupPending) {
+      continue;
+    }
+    if ((addr.lookup_ms != 0) && ((now_ms - addr.lookup_ms) < DNS_RETRY_MS)) {
+      continue; // tried recently
+    }
+    if ((addr.ip != 0) && ((now_ms - addr.resolved_ms) < DNS_CACHE_TTL_MS)) {
+      continue; // still current
+    }
+    addr.lookupPending = true;
+    addr.lookup_ms = now_ms | 1; // never 0
+    if (tcpip_callback(ntpDnsLookup, &addr) != ERR_OK) {
+      addr.lookupPending = false;
+    }
   }
 }
 
+// returns false if waiting for the first lookup of any server to complete
+static bool haveNTPserverAddress() {
+  bool pending = false;
+  for (size_t i = 0; i < numTimeServers; i++) {
+    if (ntpServerAddrs[i].ip != 0) {
+      return true;
+    }
+    pending = pending || ntpServerAddrs[i].lookupPending;
+  }
+  return !pending; // nothing to wait for
+}
 
 // call cleanUpfirst
 void setTZfromPOSIXstr(const char* tz_str) {
@@ -189,6 +493,20 @@ void setTZfromPOSIXstr(const char* tz_str) {
   needToSaveConfigFlag = true;
 }
 
+// look up the IANA zone name, e.g. "Australia/Sydney", returns false and leaves the TZ unchanged if not found
+// the tzdata POSIX strings are already valid so no cleanUp needed
+bool setTZfromIANAname(const char* ianaName) {
+  const char* posixTZ = ianaToPosixTZ(ianaName);
+  if (!posixTZ) {
+    if (debugPtr) {
+      debugPtr->print("setTZfromIANAname unknown zone:"); debugPtr->println(ianaName ? ianaName : "NULL");
+    }
+    return false;
+  }
+  setTZfromPOSIXstr(posixTZ);
+  return true;
+}
+
 
 
 static uint32_t sntp_update_delay_MS_rfc_not_less_than_15000() {
@@ -199,24 +517,28 @@ static uint32_t sntp_update_delay_MS_rfc_not_less_than_15000() {
   }
 }
 
+// the cleaned up POSIX string for get_ntpSupport_DefaultTZ(), looked up as an IANA zone name first
+// falls back to treating it as a POSIX string, "" => GMT0 if get_ntpSupport_DefaultTZ() is not defined
+static void getDefaultPOSIXstr(char* tzStr, size_t tzStrSize) {
+  tzStr[0] = '\0';
+  if (get_ntpSupport_DefaultTZ) {
+    const char* defaultTZ = get_ntpSupport_DefaultTZ();
+    const char* posixTZ = ianaToPosixTZ(defaultTZ);
+    strlcpy(tzStr, posixTZ ? posixTZ : (defaultTZ ? defaultTZ : ""), tzStrSize);
+  }
+  cleanUpPosixTZStr(tzStr, tzStrSize);
+}
+
 // used when timeZoneConfigFileName file does not exist or is invalid
 static void setInitialTimeZoneConfig() {
   timeZoneConfig.utcTime = 0;
-  timeZoneConfig.tzStr[0] = '\0'; // => GMT0 after cleanup
-  if (get_ntpSupport_DefaultTZ) {
-    strlcpy(timeZoneConfig.tzStr, get_ntpSupport_DefaultTZ(), sizeof(timeZoneConfig.tzStr));
-  }
-  // clean up
-  cleanUpPosixTZStr(timeZoneConfig.tzStr, sizeof(timeZoneConfig.tzStr));
+  getDefaultPOSIXstr(timeZoneConfig.tzStr, sizeof(timeZoneConfig.tzStr));
 }
 
 void resetDefaultTZstr() {
   char tzStr[sizeof(timeZoneConfig.tzStr)];
-  tzStr[0] = '\0';
-  if (get_ntpSupport_DefaultTZ) {
-    strlcpy(tzStr, get_ntpSupport_DefaultTZ(), sizeof(tzStr));
-  }
-  setTZfromPOSIXstr(tzStr); // cleans up and set save flag as well
+  getDefaultPOSIXstr(tzStr, sizeof(tzStr));
+  setTZfromPOSIXstr(tzStr); // sets save flag as well
   saveTZconfigIfNeeded(); // force save
 }
 
@@ -234,50 +556,49 @@ static void printTimeZoneConfig(struct timeZoneConfig_struct & timeZoneConfig, S
 
 // load the last time saved before shutdown/reboot
 // returns pointer to timeZoneConfig
-static struct timeZoneConfig_struct* loadTimeZoneConfig() {
-  setInitialTimeZoneConfig();
-  if (!initializeFS()) {
-    if (debugPtr) {
-      debugPtr->println("FS failed to initialize");
-    }
-    return &timeZoneConfig; // returns default if cannot open FS
-  }
+// reads the pre configStore /timeZoneCfg.bin once, then deletes it
+static bool migrateTimeZoneConfigFile() {
   if (!LittleFS.exists(timeZoneConfigFileName)) {
-    if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->println(" missing.");
-    }
-    saveTimeZoneConfig(timeZoneConfig);
-    return &timeZoneConfig; // returns default if missing
+    return false;
   }
-  // else load config
+  bool ok = false;
   File f = LittleFS.open(timeZoneConfigFileName, "r");
-  if (!f) {
-    if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->print(" did not open for read.");
-    }
-    LittleFS.remove(timeZoneConfigFileName);
-    saveTimeZoneConfig(timeZoneConfig);
-    return &timeZoneConfig; // returns default wrong size
+  if (f && (f.size() == sizeof(timeZoneConfig))) {
+    ok = (f.read((uint8_t*)(&timeZoneConfig), sizeof(timeZoneConfig)) == sizeof(timeZoneConfig));
   }
-  if (f.size() != sizeof(timeZoneConfig)) {
-    if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->print(" wrong size.");
-    }
+  if (f) {
     f.close();
-    saveTimeZoneConfig(timeZoneConfig);
-    return &timeZoneConfig; // returns default wrong size
   }
-  int bytesIn = f.read((uint8_t*)(&timeZoneConfig), sizeof(timeZoneConfig));
-  if (bytesIn != sizeof(timeZoneConfig)) {
+  if (!ok) {
+    setInitialTimeZoneConfig(); // again
+  }
+  if (debugPtr) {
+    debugPtr->print(timeZoneConfigFileName); debugPtr->println(ok ? " moved to configStore" : " invalid, removed");
+  }
+  configPut(timeZoneConfigKey, &timeZoneConfig, sizeof(timeZoneConfig));
+  configCommit(); // before removing the old file
+  LittleFS.remove(timeZoneConfigFileName);
+  return ok;
+}
+
+static struct timeZoneConfig_struct* loadTimeZoneConfig() {
+  setInitialTimeZoneConfig();
+  if (!initializeConfigStore()) {
     if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->print(" wrong size read in.");
+      debugPtr->println("FS failed to initialize");
+    }
+    return &timeZoneConfig; // returns default if cannot open FS
+  }
+  if (!configGet(timeZoneConfigKey, &timeZoneConfig, sizeof(timeZoneConfig))) {
+    if (!migrateTimeZoneConfigFile()) {
+      if (debugPtr) {
+        debugPtr->print(timeZoneConfigKey); debugPtr->println(" config missing.");
+      }
+      setInitialTimeZoneConfig(); // configGet does not change timeZoneConfig on failure but..
+      saveTimeZoneConfig(timeZoneConfig);
+      return &timeZoneConfig; // returns default if missing
     }
-    setInitialTimeZoneConfig(); // again
-    f.close();
-    saveTimeZoneConfig(timeZoneConfig);
-    return &timeZoneConfig;
   }
-  f.close();
   // else return settings
   // clean up tz and return
   cleanUpPosixTZStr(timeZoneConfig.tzStr, sizeof(timeZoneConfig.tzStr));
@@ -286,45 +607,27 @@ static struct timeZoneConfig_struct* loadTimeZoneConfig() {
     printTimeZoneConfig(timeZoneConfig, *debugPtr);
   }
   if (debugPtr) {
-    String desc = timeZoneConfig.tzStr;
     struct posix_tz_data_struct posixTz;
-    posixTZDataFromStr(desc, posixTz);
-    buildPOSIXdescription(posixTz, desc);
+    posixTZDataFromStr(timeZoneConfig.tzStr, strlen(timeZoneConfig.tzStr), posixTz);
     debugPtr->println("TZ description");
-    debugPtr->println(desc);
+    buildPOSIXdescription(posixTz, *debugPtr);
+    debugPtr->println();
   }
 
   return &timeZoneConfig;
 }
 
-// load the last time saved before shutdown/reboot
+// the last time saved before shutdown/reboot, configStore coalesces the flash writes
 static bool saveTimeZoneConfig(struct timeZoneConfig_struct & timeZoneConfig) {
-  if (!initializeFS()) {
-    if (debugPtr) {
-      debugPtr->println("FS failed to initialize");
-    }
-    return false;
-  }
-  // else save config
-  File f = LittleFS.open(timeZoneConfigFileName, "w"); // create/overwrite
-  if (!f) {
-    if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->print(" did not open for write.");
-    }
-    return false; // returns default wrong size
-  }
   setUTCconfigTime(); // update utc time
-  int bytesOut = f.write((uint8_t*)(&timeZoneConfig), sizeof(struct timeZoneConfig_struct));
-  if (bytesOut != sizeof(struct timeZoneConfig_struct)) {
+  if (!configPut(timeZoneConfigKey, &timeZoneConfig, sizeof(struct timeZoneConfig_struct))) {
     if (debugPtr) {
-      debugPtr->print(timeZoneConfigFileName); debugPtr->print(" write failed.");
+      debugPtr->print(timeZoneConfigKey); debugPtr->print(" config save failed.");
     }
     return false;
   }
-  // else return settings
-  f.close(); // no rturn
   if (debugPtr) {
-    debugPtr->print(timeZoneConfigFileName); debugPtr->println(" config saved.");
+    debugPtr->print(timeZoneConfigKey); debugPtr->println(" config saved.");
     printTimeZoneConfig(timeZoneConfig, *debugPtr);
   }
   return true;
@@ -360,8 +663,16 @@ void initializeNtpSupport() {
   }
   loadTimeZoneConfig(); // load timeZoneConfig global and cleans up tzStr
 
-  setTime(timeZoneConfig.utcTime, 0); //ignore us
-  udpRunning = udp.begin(localPort); // returns 1 for Ok else 0
+  if (timeZoneConfig.utcTime > time(nullptr)) {
+    setTime(timeZoneConfig.utcTime, 0); //ignore us, never step back from a clock already restored at boot
+  }
+  if (!ntpServerAddrs[0].name) {
+    setNTPservers(timeServers, numTimeServers); // initialize address cache
+  }
+  udpRunning = udp.listen(localPort); // returns true for Ok
+  if (udpRunning) {
+    udp.onPacket(onNTPpacket);
+  }
   if (udpRunning) {
     ntpUpdateCheck.start(NTP_NOT_UPDATED_MS); // start monitor
     setTZfromPOSIXstr(timeZoneConfig.tzStr);
@@ -381,16 +692,282 @@ void forceNTPupdate() {
   updateTimer.start(1); // force update in 1ms
 }
 
+static uint32_t readUint32(const byte* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// convert the 8 byte NTP timestamp at p to Unix time in us
+static int64_t ntpTimestampToUnix_us(const byte* p) {
+  uint32_t secsSince1900 = readUint32(p);
+  uint32_t fraction = readUint32(p + 4);
+  // Unix time starts on Jan 1 1970. In seconds, that's 2208988800:
+  const uint64_t seventyYears = 2208988800ULL;
+  uint64_t secs = secsSince1900;
+  if (!(secsSince1900 & 0x80000000)) {
+    secs += 0x100000000ULL; // NTP era 1, after 7 Feb 2036
+  }
+  int64_t unix_us = (int64_t)(secs - seventyYears) * 1000000;
+  unix_us += (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+  return unix_us;
+}
+
+// write Unix time in us as an 8 byte NTP timestamp at p
+static void unixToNtpTimestamp(int64_t unix_us, byte* p) {
+  uint64_t secs = (uint64_t)(unix_us / 1000000) + 2208988800ULL; // wraps to era 1 after 2036
+  uint32_t secsSince1900 = (uint32_t)secs;
+  uint32_t fraction = (uint32_t)((((uint64_t)(unix_us % 1000000)) << 32) / 1000000);
+  for (int i = 0; i < 4; i++) {
+    p[3 - i] = (byte)(secsSince1900 >> (8 * i));
+    p[7 - i] = (byte)(fraction >> (8 * i));
+  }
+}
+
+static void writeUint32(uint32_t value, byte* p) {
+  for (int i = 0; i < 4; i++) {
+    p[3 - i] = (byte)(value >> (8 * i));
+  }
+}
+
+// convert us to NTP short format, 16.16 secs
+static uint32_t usToNtpShort(int64_t us) {
+  if (us < 0) {
+    us = 0;
+  }
+  return (uint32_t)((((uint64_t)us) << 16) / 1000000);
+}
+
+static void sendNextBurstRequest() {
+  if (numRequestsSent >= NTP_BURST_SIZE) {
+    return;
+  }
+  struct ntpRequest_struct& request = ntpRequests[numRequestsSent++];
+  request.replied = true; // until sent
+  request.sent_us = 0;
+  request.serverIdx = 0;
+  // use the next server that has an address
+  for (size_t i = 0; i < numTimeServers; i++) {
+    size_t serverIdx = nextTimeServerIdx;
+    nextTimeServerIdx = (nextTimeServerIdx + 1) % numTimeServers;
+    if (ntpServerAddrs[serverIdx].ip != 0) {
+      IPAddress serverIP((uint32_t)ntpServerAddrs[serverIdx].ip);
+      request.serverIdx = serverIdx;
+      request.replied = false;
+      request.sent_us = esp_timer_get_time();
+      sendNTPpacket(serverIP, request.sent_us);
+      if (debugPtr) {
+        debugPtr->print("Sent NTP UDP request to "); debugPtr->print(timeServers[serverIdx]);
+        debugPtr->print(' '); debugPtr->println(serverIP);
+      }
+      break;
+    }
+  }
+  if (request.replied && debugPtr) {
+    debugPtr->println("No NTP server address available");
+  }
+  if (numRequestsSent < NTP_BURST_SIZE) {
+    burstTimer.start(NTP_BURST_SPACING_MS);
+  }
+}
+
+static void setTimeFromSample(struct ntpSample_struct& sample) {
+  int64_t unix_us = esp_timer_get_time() + sample.epochAtBoot_us;
+  if (debugPtr) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    int64_t offset_us = unix_us - ((int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+    debugPtr->print("NTP server:"); debugPtr->print(timeServers[sample.serverIdx]);
+    debugPtr->print(" stratum:"); debugPtr->print(sample.stratum);
+    debugPtr->print(" delay ms:"); debugPtr->print((long)(sample.delay_us / 1000));
+    debugPtr->print(" offset ms:"); debugPtr->println((long)(offset_us / 1000));
+    debugPtr->print("Unix time = ");
+    debugPtr->println((unsigned long)(unix_us / 1000000));
+  }
+  setTime((long)(unix_us / 1000000), (int)(unix_us % 1000000));
+}
+
+// check the reply in packetBuffer and add it to ntpSamples
+// received_us is esp_timer_get_time() when the reply was read
+static void processNTPreply(int packetSize, int64_t received_us) {
+  if (packetSize < NTP_PACKET_SIZE) {
+    return; // too short
+  }
+  uint8_t leapIndicator = packetBuffer[0] >> 6;
+  uint8_t mode = packetBuffer[0] & 0x07;
+  uint8_t stratum = packetBuffer[1];
+  if ((mode != 4) || (leapIndicator == 3) || (stratum == 0) || (stratum > 15)) {
+    if (debugPtr) {
+      debugPtr->print("NTP reply ignored, LI:"); debugPtr->print(leapIndicator);
+      debugPtr->print(" mode:"); debugPtr->print(mode);
+      debugPtr->print(" stratum:"); debugPtr->println(stratum);
+    }
+    return; // not a server reply or not synchronized or kiss-o'-death
+  }
+  // originate timestamp, bytes 24 to 31, is our transmit timestamp
+  int64_t originate = 0;
+  for (int i = 24; i < 32; i++) {
+    originate = (originate << 8) | packetBuffer[i];
+  }
+  struct ntpRequest_struct* requestPtr = NULL;
+  for (unsigned int i = 0; i < numRequestsSent; i++) {
+    if ((!ntpRequests[i].replied) && (ntpRequests[i].sent_us == originate)) {
+      requestPtr = &ntpRequests[i];
+      break;
+    }
+  }
+  if (!requestPtr) {
+    if (debugPtr) {
+      debugPtr->println("NTP reply does not match any request");
+    }
+    return; // old, duplicate or spoofed reply
+  }
+  requestPtr->replied = true;
+  if (readUint32(packetBuffer + 40) == 0) {
+    return; // no transmit timestamp
+  }
+  int64_t serverReceived_us = ntpTimestampToUnix_us(packetBuffer + 32); // T2
+  int64_t serverTransmit_us = ntpTimestampToUnix_us(packetBuffer + 40); // T3
+  int64_t delay_us = (received_us - requestPtr->sent_us) - (serverTransmit_us - serverReceived_us);
+  if (delay_us < 0) {
+    delay_us = 0;
+  }
+  if (delay_us > MAX_NTP_DELAY_US) {
+    if (debugPtr) {
+      debugPtr->print("NTP reply delay too long ms:"); debugPtr->println((long)(delay_us / 1000));
+    }
+    return;
+  }
+  struct ntpSample_struct& sample = ntpSamples[numSamples++];
+  // offset between server time and esp_timer_get_time(), ((T2 - T1) + (T3 - T4)) / 2
+  sample.epochAtBoot_us = ((serverReceived_us - requestPtr->sent_us) + (serverTransmit_us - received_us)) / 2;
+  sample.delay_us = delay_us;
+  sample.rootDelay = readUint32(packetBuffer + 4);
+  sample.rootDispersion = readUint32(packetBuffer + 8);
+  sample.serverIp = ntpServerAddrs[requestPtr->serverIdx].ip;
+  sample.stratum = stratum;
+  sample.leapIndicator = leapIndicator;
+  sample.serverIdx = requestPtr->serverIdx;
+  if ((!haveSNTPresponse) && (numSamples == 1)) {
+    // first reply after boot, use it now rather than waiting for the rest of the burst
+    setTimeFromSample(sample);
+  }
+}
+
+// returns NULL if no samples
+// uses the lowest delay sample from each server, rejects servers more than NTP_OUTLIER_US from the median of those
+// and then returns the lowest delay sample of the rest
+static struct ntpSample_struct* selectBestNTPsample() {
+  struct ntpSample_struct* serverBest[NTP_BURST_SIZE];
+  unsigned int numServers = 0;
+  for (unsigned int i = 0; i < numSamples; i++) {
+    unsigned int j = 0;
+    for (; j < numServers; j++) {
+      if (serverBest[j]->serverIdx == ntpSamples[i].serverIdx) {
+        if (ntpSamples[i].delay_us < serverBest[j]->delay_us) {
+          serverBest[j] = &ntpSamples[i];
+        }
+        break;
+      }
+    }
+    if (j == numServers) {
+      serverBest[numServers++] = &ntpSamples[i];
+    }
+  }
+  if (numServers == 0) {
+    return NULL;
+  }
+  // sort by offset to find the median, only a few entries so insertion sort
+  for (unsigned int i = 1; i < numServers; i++) {
+    struct ntpSample_struct* tmp = serverBest[i];
+    unsigned int j = i;
+    for (; (j > 0) && (serverBest[j - 1]->epochAtBoot_us > tmp->epochAtBoot_us); j--) {
+      serverBest[j] = serverBest[j - 1];
+    }
+    serverBest[j] = tmp;
+  }
+  int64_t median_us = serverBest[numServers / 2]->epochAtBoot_us;
+  if ((numServers % 2) == 0) {
+    median_us = (median_us + serverBest[numServers / 2 - 1]->epochAtBoot_us) / 2;
+  }
+  struct ntpSample_struct* bestPtr = NULL;
+  for (unsigned int i = 0; i < numServers; i++) {
+    int64_t diff_us = serverBest[i]->epochAtBoot_us - median_us;
+    if (diff_us < 0) {
+      diff_us = -diff_us;
+    }
+    // with less than 3 servers cannot tell which one is wrong so keep them all
+    if ((numServers >= 3) && (diff_us > NTP_OUTLIER_US)) {
+      if (debugPtr) {
+        debugPtr->print("NTP outlier ignored:"); debugPtr->print(timeServers[serverBest[i]->serverIdx]);
+        debugPtr->print(" ms from median:"); debugPtr->println((long)(diff_us / 1000));
+      }
+      continue;
+    }
+    if ((!bestPtr) || (serverBest[i]->delay_us < bestPtr->delay_us)) {
+      bestPtr = serverBest[i];
+    }
+  }
+  return bestPtr;
+}
+
+// all replies received or timed out
+static void finishNTPburst() {
+  responseTimer.stop();
+  burstTimer.stop();
+  struct ntpSample_struct* bestPtr = selectBestNTPsample();
+  if (!bestPtr) {
+    if (debugPtr) {
+      debugPtr->println(" No valid NTP response in 10sec");
+    }
+    haveSNTPresponse = true; // update failed
+    // request again in 20sec
+    updateTimer.start(20ul * 1000);
+    return;
+  }
+  setTimeFromSample(*bestPtr);
+  // update the reference data for the SNTP server
+  struct sntpRefData_struct refData;
+  // upstream stratum 15 would make us 16, i.e. unsynchronized
+  refData.synchronized = (bestPtr->stratum < 15);
+  refData.stratum = bestPtr->stratum + 1;
+  refData.leapIndicator = bestPtr->leapIndicator;
+  refData.refId = bestPtr->serverIp;
+  refData.refTime_us = esp_timer_get_time() + bestPtr->epochAtBoot_us;
+  refData.rootDelay = bestPtr->rootDelay + usToNtpShort(bestPtr->delay_us);
+  refData.rootDispersion = bestPtr->rootDispersion + usToNtpShort(bestPtr->delay_us / 2);
+  portENTER_CRITICAL(&sntpServerMux);
+  sntpRefData = refData;
+  portEXIT_CRITICAL(&sntpServerMux);
+  showTimeDebug();
+  if (haveSNTPresponse) {
+    haveSecondSNTPresponse = true;
+  }
+  haveSNTPresponse = true;
+  haveSNTPupdate = true;
+  ntpUpdateCheck.start(NTP_NOT_UPDATED_MS); // start monitor again
+  updateTimer.start(sntp_update_delay_MS_rfc_not_less_than_15000()); // 20sec until haveSecondSNTPresponse
+}
+
+// does not block, each call does at most one request and processes the replies received since the last call
 void processNTP() {
   if (!udpRunning) {
     return; // udp not started
   }
   missedSNTPupdate(); // update haveSNTPupdate
+  refreshNTPserverAddresses();
 
-  if (updateTimer.justFinished()) {  // send next request
-    sendNTPpacket(timeServer); // send an NTP packet to a time server
-    responseCounter = 0;
-    responseTimer.start(responseTimer_ms); // start first timer
+  if (updateTimer.justFinished()) {  // send next burst of requests
+    if (!haveNTPserverAddress()) {
+      updateTimer.start(DNS_WAIT_MS); // first lookup still in progress
+      return;
+    }
+    numRequestsSent = 0;
+    numSamples = 0;
+    int size; int64_t received_us;
+    while (getNextNTPreply(size, received_us)) {
+      // discard any late replies from the last burst
+    }
+    sendNextBurstRequest(); // send an NTP packet to a time server
+    responseTimer.start(MAX_ResponseTime);
     return;
   }
 
@@ -398,125 +975,321 @@ void processNTP() {
     return; // waiting for next update to start
   }
 
-  if (responseTimer.justFinished()) {  // check response
-    responseCounter++;
-    if (debugPtr) {
-      debugPtr->print("responseCounter:"); debugPtr->println(responseCounter);
+  if (burstTimer.justFinished()) {
+    sendNextBurstRequest();
+  }
+
+  int packetSize;
+  int64_t received_us;
+  while (getNextNTPreply(packetSize, received_us)) {
+    processNTPreply(packetSize, received_us);
+  }
+
+  unsigned int numReplies = 0;
+  for (unsigned int i = 0; i < numRequestsSent; i++) {
+    if (ntpRequests[i].replied) {
+      numReplies++;
     }
-    if (udp.parsePacket()) {
-      // We've received a packet, read the data from it
-      udp.read(packetBuffer, NTP_PACKET_SIZE); // read the packet into the buffer
-
-      // the timestamp starts at byte 40 of the received packet and is four bytes,
-      // or two words, long. First, extract the two words:
-
-      unsigned long highWord = word(packetBuffer[40], packetBuffer[41]);
-      unsigned long lowWord = word(packetBuffer[42], packetBuffer[43]);
-      // combine the four bytes (two words) into a long integer
-      // this is NTP time (seconds since Jan 1 1900):
-      unsigned long secsSince1900 = highWord << 16 | lowWord;
-      //      if (debugPtr) {
-      //        debugPtr->print("Seconds since Jan 1 1900 = ");
-      //        debugPtr->println(secsSince1900);
-      //      }
-      // now convert NTP time into everyday time:
-      // Unix time starts on Jan 1 1970. In seconds, that's 2208988800:
-      const unsigned long seventyYears = 2208988800UL;
-      // subtract seventy years:
-      unsigned long epoch = secsSince1900 - seventyYears;
-      // print Unix time:
-      if (debugPtr) {
-        debugPtr->print("Unix time = ");
-        debugPtr->println(epoch);
-      }
-      setTime(epoch, 0);
+  }
+  if (((numRequestsSent >= NTP_BURST_SIZE) && (numReplies >= NTP_BURST_SIZE)) || responseTimer.justFinished()) {
+    finishNTPburst();
+  }
+}
 
-      showTimeDebug();
-      if (haveSNTPresponse) {
-        haveSecondSNTPresponse = true;
-      }
-      haveSNTPresponse = true;
-      haveSNTPupdate = true;
-      ntpUpdateCheck.start(NTP_NOT_UPDATED_MS); // start monitor again
-      updateTimer.start(sntp_update_delay_MS_rfc_not_less_than_15000()); // 20sec until haveSecondSNTPresponse
-
-    } else {
-      // no response yet
-      if (responseCounter >= MAX_ResponseCounter) {
-        if (debugPtr) {
-          debugPtr->println(" No NTP response in 10sec");
-        }
-        haveSNTPresponse = true; // update failed
-        // request again in 20sec
-        updateTimer.start(20ul * 1000);
-      } else {
-        responseTimer.start(responseTimer_ms); // check response again in 1sec
-      }
+// called in the lwIP task, replies straight away so the receive and transmit timestamps are accurate
+static void onSNTPrequest(AsyncUDPPacket& packet) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  int64_t received_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  const uint8_t* request = packet.data();
+  if ((packet.length() < NTP_PACKET_SIZE) || ((request[0] & 0x07) != 3)) {
+    return; // not a client request
+  }
+  uint8_t version = (request[0] >> 3) & 0x07;
+  if ((version < 1) || (version > 4)) {
+    return;
+  }
+  struct sntpRefData_struct refData;
+  unsigned long sec = millis() / 1000;
+  portENTER_CRITICAL(&sntpServerMux);
+  if (sec != sntpRateLimitSec) {
+    sntpRateLimitSec = sec;
+    sntpRequestsThisSec = 0;
+  }
+  bool drop = (++sntpRequestsThisSec > MAX_SNTP_REQUESTS_PER_SEC);
+  if (drop) {
+    sntpRequestsDropped++;
+  } else {
+    sntpRequestsServed++;
+  }
+  refData = sntpRefData;
+  portEXIT_CRITICAL(&sntpServerMux);
+  if (drop) {
+    return;
+  }
+  if (!haveSNTPupdate) { // never synchronized or missed the last 70mins of updates
+    refData.synchronized = false;
+  }
+
+  uint8_t reply[NTP_PACKET_SIZE];
+  memset(reply, 0, NTP_PACKET_SIZE);
+  if (refData.synchronized) {
+    reply[0] = (refData.leapIndicator << 6) | (version << 3) | 4; // LI from upstream, VN from request, mode server
+    reply[1] = refData.stratum;
+    // add dispersion of 15ppm since the last update
+    int64_t sinceUpdate_us = received_us - refData.refTime_us;
+    writeUint32(refData.rootDelay, reply + 4);
+    writeUint32(refData.rootDispersion + usToNtpShort(sinceUpdate_us / 1000000 * 15), reply + 8);
+    // reference id is the upstream server's IPv4 address in network order
+    memcpy(reply + 12, (const void*)&refData.refId, 4);
+    unixToNtpTimestamp(refData.refTime_us, reply + 16);
+  } else {
+    reply[0] = (3 << 6) | (version << 3) | 4; // LI alarm, clock not synchronized
+    reply[1] = 0; // stratum 16 (unsynchronized) is sent as 0
+    memcpy(reply + 12, "INIT", 4);
+  }
+  reply[2] = request[2]; // poll from request
+  reply[3] = 0xEC; // precision 2^-20 sec, i.e. us
+  memcpy(reply + 24, request + 40, 8); // originate timestamp is the client's transmit timestamp
+  unixToNtpTimestamp(received_us, reply + 32);
+  gettimeofday(&tv, nullptr);
+  unixToNtpTimestamp((int64_t)tv.tv_sec * 1000000 + tv.tv_usec, reply + 40);
+  packet.write(reply, NTP_PACKET_SIZE);
+}
+
+// start/stop answering SNTP requests from the LAN on port 123
+bool enableSNTPserver(bool enable) {
+  if (!enable) {
+    if (sntpServerRunning) {
+      sntpServerUdp.close();
+      sntpServerRunning = false;
+    }
+    return false;
+  }
+  if (sntpServerRunning) {
+    return true;
+  }
+  sntpServerRunning = sntpServerUdp.listen(SNTP_SERVER_PORT);
+  if (sntpServerRunning) {
+    sntpServerUdp.onPacket(onSNTPrequest);
+  }
+  if (debugPtr) {
+    debugPtr->print("SNTP server on port "); debugPtr->print(SNTP_SERVER_PORT);
+    debugPtr->println(sntpServerRunning ? " started" : " failed to start");
+  }
+  return sntpServerRunning;
+}
+
+void getSNTPserverCounts(uint32_t& served, uint32_t& dropped) {
+  portENTER_CRITICAL(&sntpServerMux);
+  served = sntpRequestsServed;
+  dropped = sntpRequestsDropped;
+  portEXIT_CRITICAL(&sntpServerMux);
+}
+
+// returns local time in secs for the utc Unix time, sets isDst and offset_min (POSIX sign, i.e. +ve west of GMT) if not NULL
+// safe to call from any task, the table is only rebuilt on a TZ or year change
+static int64_t utcToLocal(int64_t utc, bool* isDstPtr, int* offset_minPtr = NULL) {
+  portENTER_CRITICAL(&tzTableMux);
+  bool valid = tzTableValid && (utc >= tzTableFromUtc) && (utc < tzTableToUtc);
+  bool hasDst = tzTableHasDst;
+  int64_t dstStartUtc = tzTableDstStartUtc;
+  int64_t dstEndUtc = tzTableDstEndUtc;
+  int offset_min = tzTableOffset_min;
+  int dstOffset_min = tzTableDstOffset_min;
+  portEXIT_CRITICAL(&tzTableMux);
+  if (!valid) {
+    struct posix_tz_data_struct posixData;
+    portENTER_CRITICAL(&tzTableMux);
+    bool cacheValid = tzCacheValid;
+    uint32_t generation = tzGeneration;
+    posixData = tzCache.posixData;
+    portEXIT_CRITICAL(&tzTableMux);
+    if (!cacheValid) { // setTZ() not called yet
+      const char* tz_str = getenv("TZ");
+      posixTZDataFromStr(tz_str ? tz_str : "", tz_str ? strlen(tz_str) : 0, posixData);
+    }
+    int32_t days = (int32_t)((utc >= 0) ? (utc / 86400) : ((utc - 86399) / 86400));
+    int year = 1970 + days / 366; // always <= actual year
+    while (daysFromCivil(year + 1, 1, 1) <= days) {
+      year++;
     }
+    hasDst = getDSTtransitionsUTC(posixData, year, dstStartUtc, dstEndUtc);
+    offset_min = posixData.offset_min;
+    dstOffset_min = posixData.dst_offset_min;
+    portENTER_CRITICAL(&tzTableMux);
+    if (cacheValid && (generation == tzGeneration)) { // not changed by setTZ() while calculating
+      tzTableFromUtc = (int64_t)daysFromCivil(year, 1, 1) * 86400;
+      tzTableToUtc = (int64_t)daysFromCivil(year + 1, 1, 1) * 86400;
+      tzTableHasDst = hasDst;
+      tzTableDstStartUtc = dstStartUtc;
+      tzTableDstEndUtc = dstEndUtc;
+      tzTableOffset_min = offset_min;
+      tzTableDstOffset_min = dstOffset_min;
+      tzTableValid = true;
+    }
+    portEXIT_CRITICAL(&tzTableMux);
+  }
+  bool isDst = false;
+  if (hasDst) {
+    if (dstStartUtc < dstEndUtc) { // northern hemisphere
+      isDst = (utc >= dstStartUtc) && (utc < dstEndUtc);
+    } else { // southern hemisphere, dst over new year
+      isDst = (utc >= dstStartUtc) || (utc < dstEndUtc);
+    }
+  }
+  if (isDstPtr) {
+    *isDstPtr = isDst;
+  }
+  if (isDst) {
+    offset_min = dstOffset_min;
+  }
+  if (offset_minPtr) {
+    *offset_minPtr = offset_min;
+  }
+  // POSIX offsets are +ve west of GMT, i.e. local = UTC - offset
+  return utc - (int64_t)offset_min * 60;
+}
+
+// secs since midnight
+static uint32_t secsOfDay(int64_t secs) {
+  int64_t rtn = secs % 86400;
+  if (rtn < 0) {
+    rtn += 86400;
   }
+  return (uint32_t)rtn;
 }
 
 // only handles +v numbers
-static void print2digits(String & result, uint num) {
+static size_t print2digits(Print & out, unsigned int num) {
+  size_t rtn = 0;
   if (num < 10) {
-    result += '0';
+    rtn += out.print('0');
   }
-  result += num;
+  return rtn + out.print(num);
 }
 
-static String getHHMMss(struct tm * tmPtr) {
-  String result; // hh:mm:ss
-  print2digits(result, tmPtr->tm_hour);
-  result += ':';
-  print2digits(result, tmPtr->tm_min);
-  result += ':';
-  print2digits(result, tmPtr->tm_sec);
-  return result;
+static const char* const dayNames[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char* const monthNames[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static int32_t daysOf(int64_t secs) { // days since 1970-01-01, rounds down for -ve secs
+  return (int32_t)((secs >= 0) ? (secs / 86400) : ((secs - 86399) / 86400));
 }
 
-static String getHHMM(struct tm * tmPtr) {
-  String result; // hh:mm:ss
-  print2digits(result, tmPtr->tm_hour);
-  result += ':';
-  print2digits(result, tmPtr->tm_min);
-  return result;
+static size_t printHHMM(Print & out, uint32_t secs) { // hh:mm
+  size_t rtn = print2digits(out, secs / 3600);
+  rtn += out.print(':');
+  return rtn + print2digits(out, (secs / 60) % 60);
 }
 
-// local time HH:MM:ss in sec
+static size_t printHHMMss(Print & out, uint32_t secs) { // hh:mm:ss
+  size_t rtn = printHHMM(out, secs);
+  rtn += out.print(':');
+  return rtn + print2digits(out, secs % 60);
+}
+
+static size_t printISO8601(Print & out, int64_t secs) { // yyyy-mm-ddThh:mm:ss
+  int year; unsigned int month; unsigned int day;
+  civilFromDays(daysOf(secs), year, month, day);
+  size_t rtn = out.print(year);
+  rtn += out.print('-');
+  rtn += print2digits(out, month);
+  rtn += out.print('-');
+  rtn += print2digits(out, day);
+  rtn += out.print('T');
+  return rtn + printHHMMss(out, secsOfDay(secs));
+}
+
+size_t formatISO8601UTC(time_t utc, Print & out) {
+  size_t rtn = printISO8601(out, utc);
+  return rtn + out.print('Z');
+}
+
+size_t formatISO8601Local(time_t utc, Print & out) {
+  int offset_min = 0;
+  int64_t local = utcToLocal(utc, NULL, &offset_min);
+  size_t rtn = printISO8601(out, local);
+  // ISO offsets are +ve east of GMT, POSIX offsets are +ve west
+  rtn += out.print((offset_min > 0) ? '-' : '+');
+  return rtn + printHHMM(out, (uint32_t)abs(offset_min) * 60);
+}
+
+size_t formatRFC1123(time_t utc, Print & out) {
+  int32_t days = daysOf(utc);
+  int year; unsigned int month; unsigned int day;
+  civilFromDays(days, year, month, day);
+  size_t rtn = out.print(dayNames[((days % 7) + 7 + 4) % 7]); // 1970-01-01 was a Thursday
+  rtn += out.print(", ");
+  rtn += print2digits(out, day);
+  rtn += out.print(' ');
+  rtn += out.print(monthNames[month - 1]);
+  rtn += out.print(' ');
+  rtn += out.print(year);
+  rtn += out.print(' ');
+  rtn += printHHMMss(out, secsOfDay(utc));
+  return rtn + out.print(" GMT");
+}
+
+size_t formatLocalHHMM(time_t utc, Print & out) {
+  return printHHMM(out, secsOfDay(utcToLocal(utc, NULL)));
+}
+
+size_t formatUTCHHMMss(time_t utc, Print & out) {
+  return printHHMMss(out, secsOfDay(utc));
+}
+
+size_t formatISO8601UTC(time_t utc, char* buf, size_t bufSize) {
+  BufferPrint out(buf, bufSize);
+  formatISO8601UTC(utc, out);
+  return out.length();
+}
+
+size_t formatISO8601Local(time_t utc, char* buf, size_t bufSize) {
+  BufferPrint out(buf, bufSize);
+  formatISO8601Local(utc, out);
+  return out.length();
+}
+
+size_t formatRFC1123(time_t utc, char* buf, size_t bufSize) {
+  BufferPrint out(buf, bufSize);
+  formatRFC1123(utc, out);
+  return out.length();
+}
+
+size_t formatLocalHHMM(time_t utc, char* buf, size_t bufSize) {
+  BufferPrint out(buf, bufSize);
+  formatLocalHHMM(utc, out);
+  return out.length();
+}
+
+size_t formatUTCHHMMss(time_t utc, char* buf, size_t bufSize) {
+  BufferPrint out(buf, bufSize);
+  formatUTCHHMMss(utc, out);
+  return out.length();
+}
+
+// local time HH:MM in mins
 static unsigned int getLocalTime_mins() {
-  time_t now = time(nullptr);
-  struct tm* tmPtr = localtime(&now);
-  unsigned int rtn = (tmPtr->tm_hour);
-  rtn = rtn * 60 + tmPtr->tm_min;
-  return rtn;
+  return secsOfDay(utcToLocal(time(nullptr), NULL)) / 60;
 }
 
 
 // local time HH:MM:ss in sec
 String getLocalTime_s() {
-  time_t now = time(nullptr);
-  struct tm* tmPtr = localtime(&now);
-  uint32_t rtn = (tmPtr->tm_hour);
-  rtn = rtn * 60 + tmPtr->tm_min;
-  rtn = rtn * 60 + tmPtr->tm_sec;
-  return String(rtn);
+  return String(secsOfDay(utcToLocal(time(nullptr), NULL)));
 }
 
 // small String <=10char) in ESP8266/ESP32 use built in char[]
 String getCurrentTime_hhmm() {
-  //  gettimeofday(&tv, nullptr);
-  //  clock_gettime(0, &tp);
-  time_t now = time(nullptr);
-  struct tm* tmPtr = localtime(&now);
-  return getHHMM(tmPtr);
+  char buf[TIME_HHMMSS_STR_SIZE];
+  formatLocalHHMM(time(nullptr), buf, sizeof(buf));
+  return String(buf);
 }
 
 String getUTCTime() {
-  //  gettimeofday(&tv, nullptr);
-  //  clock_gettime(0, &tp);
-  time_t now = time(nullptr);
-  struct tm* tmPtr = gmtime(&now);
-  return getHHMMss(tmPtr);
+  char buf[TIME_HHMMSS_STR_SIZE];
+  formatUTCHHMMss(time(nullptr), buf, sizeof(buf));
+  return String(buf);
 }
 
 #define PTM(w) \
@@ -533,19 +1306,15 @@ static void printTm(const char* what, const tm * tm) {
 }
 
 String getCurrentTZ() {
-  char* tz_str = getenv("TZ");
-  if (!tz_str) {
-    return "none";
-  } // else
-  return tz_str;
+  struct tzCache_struct cache;
+  getTZcache(cache);
+  return cache.str;
 }
 
 String getCurrentTZdescription() {
-  char* tz_str = getenv("TZ");
-  String tzStr(tz_str);
-  String result;
-  getTZDescription(tzStr, result);
-  return result;
+  struct tzCache_struct cache;
+  getTZcache(cache);
+  return cache.description;
 }
 
 static void showTimeDebug() {
@@ -564,10 +1333,11 @@ static void showTimeDebug() {
   now_ms = millis();
   now_us = micros();
 
+  struct tm tmNow;
   debugPtr->println();
-  printTm("localtime:", localtime(&now));
+  printTm("localtime:", localtime_r(&now, &tmNow));
   debugPtr->println();
-  printTm("gmtime:   ", gmtime(&now));
+  printTm("gmtime:   ", gmtime_r(&now, &tmNow));
   debugPtr->println();
 
   // EPOCH+tz+dst
@@ -580,14 +1350,14 @@ static void showTimeDebug() {
   } else {
     // human readable
     debugPtr->printf("timezone:  %s\n", tz_str);
-    String tzStr(tz_str);
-    String desc;
-    getTZDescription(tzStr, desc);
-    debugPtr->println(desc);
+    struct tzCache_struct cache;
+    getTZcache(cache);
+    debugPtr->println(cache.description);
   }
 
-  debugPtr->print("ctime:     ");
-  debugPtr->print(ctime(&now));
+  debugPtr->print("local:     ");
+  formatISO8601Local(now, *debugPtr);
+  debugPtr->println();
 
   debugPtr->println();
 }
@@ -10,25 +10,58 @@
 */
 
 #include <Arduino.h>
+#include <time.h>
 void initializeNtpSupport(); // loads and sets tz Must be called by setup()
 
 void processNTP(); // request ntp update at regualar intervals, must be called each loop()
 
 void forceNTPupdate(); // force re-request of time
+// replace the default NTP server list, servers are used in rotation, servers[] must remain valid, e.g. a static array
+// NULL or 0 restores the default list
+void setNTPservers(const char* const servers[], size_t numServers);
+
+// answer SNTP requests from the LAN on port 123 using this clock, call after WiFi connected
+// replies have LI alarm set until the first NTP update, requests over 20 per sec are dropped
+bool enableSNTPserver(bool enable); // returns true if running
+void getSNTPserverCounts(uint32_t& served, uint32_t& dropped); // requests answered and dropped by the rate limit
 
 bool missedSNTPupdate(); // returns true if no update for alst 70 mins
 void setTime(long epochSecs, int us); // epochSec is Unix time, Unix time starts on Jan 1 1970.
 
+// 64bit ms since boot, never wraps and is not changed by setTime()/NTP updates
+int64_t getMonotonic_ms();
+// convert between getMonotonic_ms() values and Unix time in ms, the mapping is seeded from the system clock on first use
+// (still running after ESP.restart()) and updated each time the clock is set
+int64_t monotonicToEpoch_ms(int64_t monotonic_ms);
+int64_t epochToMonotonic_ms(int64_t epoch_ms);
+
 String getCurrentTZ(); // from env
 String getCurrentTZdescription(); // from evn
 
 String getTZstr(); // get the current tz string i.e. timeZoneConfig.tzStr
-void resetDefaultTZstr(); // reset tz to default one (from get_ntpSupport_DefaultTZ) is it is defined
+void resetDefaultTZstr(); // reset tz to default one (IANA name or POSIX string from get_ntpSupport_DefaultTZ) is it is defined
 String getCurrentTime_hhmm(); // returns local time as hh:mm
 String getUTCTime(); // returns UTC time as hh:mm:ss
 String getLocalTime_s(); // local time HH:MM:ss in sec
 
+// time formatting into a caller's buffer or straight to a Print, no heap and no shared static struct tm, so safe from any task
+// utc is Unix secs, e.g. time(nullptr), returns chars written, buffer output is truncated to fit and always '\0' terminated
+#define TIME_ISO8601_STR_SIZE 26 // 2024-05-06T17:08:09+10:00
+#define TIME_RFC1123_STR_SIZE 30 // Mon, 06 May 2024 07:08:09 GMT
+#define TIME_HHMMSS_STR_SIZE 9 // 07:08:09
+size_t formatISO8601UTC(time_t utc, Print& out); // 2024-05-06T07:08:09Z
+size_t formatISO8601UTC(time_t utc, char* buf, size_t bufSize);
+size_t formatISO8601Local(time_t utc, Print& out); // 2024-05-06T17:08:09+10:00
+size_t formatISO8601Local(time_t utc, char* buf, size_t bufSize);
+size_t formatRFC1123(time_t utc, Print& out); // Mon, 06 May 2024 07:08:09 GMT, as used in HTTP headers
+size_t formatRFC1123(time_t utc, char* buf, size_t bufSize);
+size_t formatLocalHHMM(time_t utc, Print& out); // 17:08
+size_t formatLocalHHMM(time_t utc, char* buf, size_t bufSize);
+size_t formatUTCHHMMss(time_t utc, Print& out); // 07:08:09
+size_t formatUTCHHMMss(time_t utc, char* buf, size_t bufSize);
+
 void setTZfromPOSIXstr(const char* tz_str); // sets flag to save config
+bool setTZfromIANAname(const char* ianaName); // e.g. "Australia/Sydney", returns false if not found, sets flag to save config
 bool saveTZconfigIfNeeded(); // saves any TZ config changes returns true if save happened
 
 void setNtpSupportDebug(Stream* debugOutPtr); // for debug output
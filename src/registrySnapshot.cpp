@@ -0,0 +1,320 @@
+/*
+   registrySnapshot.cpp
+*/
+#include "registrySnapshot.h"
+#include "LittleFSsupport.h"
+#include "ntpSupport.h"
+#include "asyncLog.h"
+
+static Stream* debugPtr = NULL;  // local to this file
+
+void setRegistrySnapshotDebug(Stream* debugOutPtr) {
+  debugPtr = debugOutPtr;
+}
+
+static const char snapshotTempFileName[] = "/registry.tmp";
+static const uint32_t REGISTRY_SNAPSHOT_MAGIC = 0x52454731; // REG1
+static const size_t SNAPSHOT_WRITE_BATCH = 16; // records per file write
+
+struct snapshotHeader_struct {
+  uint32_t magic;
+  uint16_t version; // REGISTRY_SNAPSHOT_VERSION
+  uint16_t recordSize; // sizeof(snapshotRecord_struct) when written
+  uint32_t count;
+  uint32_t crc; // CRC-32 of the records
+  int64_t savedEpoch_ms; // Unix time in ms when saved
+};
+
+struct snapshotRecord_struct {
+  int64_t lastSeenEpoch_ms; // Unix time in ms
+  char advertisedName[SIGHTING_LOG_NAME_SIZE]; // full advert name, device name upto the first ,
+};
+
+// reads and checks the header, leaves f positioned at the first record
+static bool readHeader(File& f, struct snapshotHeader_struct& header) {
+  if ((f.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) || (header.magic != REGISTRY_SNAPSHOT_MAGIC)
+      || (header.version != REGISTRY_SNAPSHOT_VERSION) || (header.recordSize != sizeof(struct snapshotRecord_struct))
+      || (header.count > REGISTRY_SNAPSHOT_MAX_ENTRIES) || ((header.count * header.recordSize) != (f.size() - sizeof(header)))) {
+    if (debugPtr) {
+      debugPtr->println(REGISTRY_SNAPSHOT_FILE " bad header");
+    }
+    return false;
+  }
+  return true;
+}
+
+int64_t getRegistrySnapshotTime() {
+  if ((!initializeFS()) || (!LittleFS.exists(REGISTRY_SNAPSHOT_FILE))) {
+    return 0;
+  }
+  File f = LittleFS.open(REGISTRY_SNAPSHOT_FILE, "r");
+  if (!f) {
+    return 0;
+  }
+  struct snapshotHeader_struct header;
+  if (!readHeader(f, header)) {
+    return 0;
+  }
+  return header.savedEpoch_ms;
+}
+
+size_t loadRegistrySnapshot(sightingReplayFn fn) {
+  if ((!fn) || (!initializeFS()) || (!LittleFS.exists(REGISTRY_SNAPSHOT_FILE))) {
+    return 0;
+  }
+  File f = LittleFS.open(REGISTRY_SNAPSHOT_FILE, "r");
+  if (!f) {
+    return 0;
+  }
+  struct snapshotHeader_struct header;
+  if ((!readHeader(f, header)) || (header.count == 0)) {
+    return 0;
+  }
+  // one read of all the records, checked before any are used
+  size_t bytes = header.count * sizeof(struct snapshotRecord_struct);
+  struct snapshotRecord_struct* records = (struct snapshotRecord_struct*)malloc(bytes);
+  if (!records) {
+    if (debugPtr) {
+      debugPtr->print("registrySnapshot no memory for "); debugPtr->println(bytes);
+    }
+    return 0;
+  }
+  size_t loaded = 0;
+  if ((f.read((uint8_t*)records, bytes) == bytes) && (crc32Update(0, (const uint8_t*)records, bytes) == header.crc)) {
+    for (size_t i = 0; i < header.count; i++) {
+      records[i].advertisedName[sizeof(records[i].advertisedName) - 1] = '\0';
+      fn(records[i].lastSeenEpoch_ms, records[i].advertisedName);
+      loaded++;
+    }
+  } else if (debugPtr) {
+    debugPtr->println(REGISTRY_SNAPSHOT_FILE " bad crc");
+  }
+  free(records);
+  if (debugPtr) {
+    debugPtr->print("registrySnapshot loaded "); debugPtr->print(loaded); debugPtr->println(" devices");
+  }
+  return loaded;
+}
+
+// ------------ restore ---------------
+static pfodLinkedPointerList<LastSeen>* restoreListPtr = NULL; // only set while restoreRegistry() runs
+// restored devices keep their recorded Unix times across clock steps until the first NTP update
+// a device is still as it was restored if its last seen is at or before restoreDone_ms, adverts after the restore are later than that
+static bool restoreTracking = false;
+static int64_t restoreEpochAtBoot_ms = 0; // monotonicToEpoch_ms(0) the restored devices were last converted with
+static int64_t restoreDone_ms = 0; // getMonotonic_ms() at the end of restoreRegistry()
+
+// the device name is the advertised name upto and including its first ,
+static void cutToDeviceName(SafeString& sfName) {
+  int idx = sfName.indexOf(',');
+  if (idx >= 0) {
+    sfName.substring(sfName, 0, idx);
+    sfName += ',';
+  }
+}
+
+// returns NULL if not found
+static LastSeen* findLastSeen(pfodLinkedPointerList<LastSeen>& list, SafeString& name) {
+  LastSeen *devicePtr = list.getFirst();
+  while (devicePtr) {
+    if (name.startsWith(devicePtr->getDeviceName())) {
+      return devicePtr;
+    } // else
+    devicePtr = list.getNext();
+  }
+  return devicePtr; // null not found
+}
+
+LastSeen* findOrAddLastSeen(pfodLinkedPointerList<LastSeen>& list, SafeString& sfName) {
+  // only scan for == upto first ,
+  cutToDeviceName(sfName);
+  LastSeen *devicePtr = findLastSeen(list, sfName);
+  if (!devicePtr) {
+    // not  found add it upto first ,
+    LOG_D("Adding Device name: %s", sfName.c_str()); // called from the advert task, must not block on Serial
+    devicePtr = new LastSeen(sfName.c_str()); // note MUST use new since pfodLinkedPointerList uses delete when remove() called
+    list.add(devicePtr);
+  }
+  return devicePtr;
+}
+
+// the snapshot has one record per device so each is added without a lookup
+static void addSnapshotDevice(int64_t epoch_ms, const char* advertisedName) {
+  cSF(sfName, 50); // max 32
+  sfName = advertisedName;
+  cutToDeviceName(sfName);
+  LastSeen *devicePtr = new LastSeen(sfName.c_str());
+  int64_t monotonic_ms = epochToMonotonic_ms(epoch_ms);
+  devicePtr->updateLastSeen(monotonic_ms);
+  devicePtr->setLastLogged(monotonic_ms);
+  devicePtr->setAdvertisedName(advertisedName);
+  restoreListPtr->add(devicePtr);
+}
+
+// log records are in time order, newer records overwrite older ones
+static void replayLogSighting(int64_t epoch_ms, const char* advertisedName) {
+  cSF(sfName, 50); // max 32
+  sfName = advertisedName;
+  LastSeen *devicePtr = findOrAddLastSeen(*restoreListPtr, sfName);
+  int64_t monotonic_ms = epochToMonotonic_ms(epoch_ms);
+  if ((devicePtr->getLastLogged() == 0) || (monotonic_ms >= devicePtr->getLastSeen())) {
+    devicePtr->updateLastSeen(monotonic_ms);
+    devicePtr->setLastLogged(monotonic_ms);
+    devicePtr->setAdvertisedName(advertisedName);
+  }
+}
+
+size_t restoreRegistry(pfodLinkedPointerList<LastSeen>& list) {
+  unsigned long start_us = micros();
+  bool logOk = initializeSightingLog();
+  int64_t snapshot_ms = getRegistrySnapshotTime();
+  int64_t newest_ms = logOk ? getNewestSightingLogTime() : 0;
+  if (snapshot_ms > newest_ms) {
+    newest_ms = snapshot_ms;
+  }
+  restoreTracking = false;
+  if (newest_ms > ((int64_t)time(nullptr)) * 1000) {
+    // clock not set yet, e.g. after a power up, start from the last record so ages are not negative, NTP will correct it
+    setTime((long)(newest_ms / 1000), (int)(newest_ms % 1000) * 1000);
+    restoreTracking = true;
+  }
+  restoreListPtr = &list;
+  size_t restored = loadRegistrySnapshot(addSnapshotDevice);
+  if (logOk) {
+    restored += replaySightingLog(replayLogSighting, snapshot_ms);
+  }
+  restoreListPtr = NULL;
+  restoreEpochAtBoot_ms = monotonicToEpoch_ms(0);
+  restoreDone_ms = getMonotonic_ms();
+  if (debugPtr) {
+    debugPtr->print("Restored "); debugPtr->print(restored); debugPtr->print(" sightings, ");
+    debugPtr->print(list.size()); debugPtr->print(" devices in ");
+    debugPtr->print(micros() - start_us); debugPtr->println("us");
+  }
+  return restored;
+}
+
+// call with the list mutex held
+static void rebaseRestoredDevices(pfodLinkedPointerList<LastSeen>& list) {
+  if (!restoreTracking) {
+    return;
+  }
+  int64_t epochAtBoot_ms = monotonicToEpoch_ms(0);
+  int64_t step_ms = epochAtBoot_ms - restoreEpochAtBoot_ms;
+  if (step_ms != 0) {
+    size_t moved = 0;
+    LastSeen *devicePtr = list.getFirst();
+    while (devicePtr) {
+      if (devicePtr->getLastSeen() <= restoreDone_ms) {
+        devicePtr->updateLastSeen(devicePtr->getLastSeen() - step_ms);
+        moved++;
+      }
+      if ((devicePtr->getLastLogged() != 0) && (devicePtr->getLastLogged() <= restoreDone_ms)) {
+        devicePtr->setLastLogged(devicePtr->getLastLogged() - step_ms);
+      }
+      devicePtr = list.getNext();
+    }
+    restoreEpochAtBoot_ms = epochAtBoot_ms;
+    if (debugPtr) {
+      debugPtr->print("registrySnapshot clock stepped "); debugPtr->print(step_ms); debugPtr->print("ms, moved ");
+      debugPtr->print(moved); debugPtr->println(" restored devices");
+    }
+  }
+  if (!missedSNTPupdate()) { // NTP has set the clock
+    restoreTracking = false;
+  }
+}
+
+void processRegistryRestore(pfodLinkedPointerList<LastSeen>& list, SemaphoreHandle_t listMutex) {
+  if ((!restoreTracking) || (!listMutex)) {
+    return;
+  }
+  if (monotonicToEpoch_ms(0) == restoreEpochAtBoot_ms) { // clock not stepped, leave the BLE task the list
+    if (!missedSNTPupdate()) {
+      restoreTracking = false;
+    }
+    return;
+  }
+  xSemaphoreTake(listMutex, portMAX_DELAY);
+  rebaseRestoredDevices(list);
+  xSemaphoreGive(listMutex);
+}
+
+// ------------ save ---------------
+// call with the list mutex held
+static bool saveLockedList(pfodLinkedPointerList<LastSeen>& list) {
+  if (!initializeFS()) {
+    return false;
+  }
+  rebaseRestoredDevices(list); // so the restored devices are saved with their recorded times
+  File f = LittleFS.open(snapshotTempFileName, "w");
+  if (!f) {
+    if (debugPtr) {
+      debugPtr->print(snapshotTempFileName); debugPtr->println(" did not open for write.");
+    }
+    return false;
+  }
+  struct snapshotHeader_struct header;
+  memset(&header, 0, sizeof(header));
+  header.magic = REGISTRY_SNAPSHOT_MAGIC;
+  header.version = REGISTRY_SNAPSHOT_VERSION;
+  header.recordSize = sizeof(struct snapshotRecord_struct);
+  header.savedEpoch_ms = monotonicToEpoch_ms(getMonotonic_ms());
+  // header written again with the count and crc once the records are written
+  bool ok = (f.write((const uint8_t*)&header, sizeof(header)) == sizeof(header));
+
+  static struct snapshotRecord_struct batch[SNAPSHOT_WRITE_BATCH]; // static to keep it off the stack
+  size_t batchCount = 0;
+  LastSeen *devicePtr = list.getFirst();
+  while (ok && devicePtr && (header.count < REGISTRY_SNAPSHOT_MAX_ENTRIES)) {
+    if (devicePtr->getLastSeen() != 0) { // skip devices not seen yet
+      struct snapshotRecord_struct& record = batch[batchCount++];
+      memset(&record, 0, sizeof(record)); // no random padding on flash
+      record.lastSeenEpoch_ms = monotonicToEpoch_ms(devicePtr->getLastSeen());
+      const char* name = devicePtr->getAdvertisedName();
+      strlcpy(record.advertisedName, (*name) ? name : devicePtr->getDeviceName(), sizeof(record.advertisedName));
+      header.count++;
+    }
+    devicePtr = list.getNext();
+    if ((batchCount == SNAPSHOT_WRITE_BATCH) || ((!devicePtr) && (batchCount > 0))) {
+      size_t bytes = batchCount * sizeof(batch[0]);
+      header.crc = crc32Update(header.crc, (const uint8_t*)batch, bytes);
+      ok = (f.write((const uint8_t*)batch, bytes) == bytes);
+      batchCount = 0;
+    }
+  }
+  if (ok && (batchCount > 0)) { // stopped at REGISTRY_SNAPSHOT_MAX_ENTRIES
+    size_t bytes = batchCount * sizeof(batch[0]);
+    header.crc = crc32Update(header.crc, (const uint8_t*)batch, bytes);
+    ok = (f.write((const uint8_t*)batch, bytes) == bytes);
+  }
+  ok = ok && f.seek(0) && (f.write((const uint8_t*)&header, sizeof(header)) == sizeof(header));
+  f.close();
+  // LittleFS rename replaces the old file atomically
+  if ((!ok) || (!LittleFS.rename(snapshotTempFileName, REGISTRY_SNAPSHOT_FILE))) {
+    if (debugPtr) {
+      debugPtr->println("registrySnapshot save failed");
+    }
+    LittleFS.remove(snapshotTempFileName);
+    return false;
+  }
+  if (debugPtr) {
+    debugPtr->print("registrySnapshot saved "); debugPtr->print(header.count); debugPtr->println(" devices");
+  }
+  return true;
+}
+
+bool saveRegistrySnapshot(pfodLinkedPointerList<LastSeen>& list, SemaphoreHandle_t listMutex, TickType_t wait) {
+  if (!listMutex) {
+    return false; // no lock yet, the list is not ready to save
+  }
+  if (xSemaphoreTake(listMutex, wait) != pdTRUE) {
+    if (debugPtr) {
+      debugPtr->println("registrySnapshot skipped, list busy");
+    }
+    return false;
+  }
+  bool ok = saveLockedList(list);
+  xSemaphoreGive(listMutex);
+  return ok;
+}
@@ -0,0 +1,41 @@
+#ifndef _REGISTRY_SNAPSHOT_H
+#define _REGISTRY_SNAPSHOT_H
+/*
+   registrySnapshot.h
+*/
+#include <Arduino.h>
+#include "pfodLinkedPointerList.h"
+#include "LastSeen.h"
+#include "sightingLog.h"
+#include "SafeString.h"
+
+// Checkpoint of the device registry, listOfLastSeen, as one compact CRC checked file on LittleFS
+// restored at boot in one read so the registry is back before the BLE task starts,
+// then only the sighting log records written after the snapshot need to be replayed
+// saves write /registry.tmp and then rename it over /registry.bin, so a power loss leaves either the old or the new snapshot
+#define REGISTRY_SNAPSHOT_FILE "/registry.bin"
+#define REGISTRY_SNAPSHOT_VERSION 1
+#define REGISTRY_SNAPSHOT_MAX_ENTRIES 512 // larger files are rejected on load
+#define REGISTRY_SNAPSHOT_INTERVAL_MS (10ul * 60 * 1000) // suggested checkpoint interval
+
+// the BLE task adds to list, so the save walks it holding listMutex, the same mutex the adders and other readers take
+// returns false if listMutex is NULL, is not free within wait ticks, or the save failed
+bool saveRegistrySnapshot(pfodLinkedPointerList<LastSeen>& list, SemaphoreHandle_t listMutex, TickType_t wait);
+int64_t getRegistrySnapshotTime(); // Unix time in ms the snapshot was saved, 0 if no valid snapshot, only reads the header
+size_t loadRegistrySnapshot(sightingReplayFn fn); // calls fn for each saved device, returns number of devices, 0 if missing or corrupt
+
+// the device sfName starts with, sfName is cut after its first , and added to list if not found, call with the list mutex held
+LastSeen* findOrAddLastSeen(pfodLinkedPointerList<LastSeen>& list, SafeString& sfName);
+// rebuilds an empty list from the snapshot, one new LastSeen per saved device with no lookup,
+// then replays the sighting log records written since the snapshot, returns number of records restored
+// call from setup() before the BLE task starts adding to list
+// if the clock is not set yet it is started from the newest record, the restored devices then keep their recorded Unix times
+// across any clock step up to and including the first NTP update, see processRegistryRestore()
+size_t restoreRegistry(pfodLinkedPointerList<LastSeen>& list);
+// call each loop(), moves the restored devices not seen since by any clock step since restoreRegistry()
+// saveRegistrySnapshot() does the same first, so a snapshot never saves the restored devices at the wrong time
+void processRegistryRestore(pfodLinkedPointerList<LastSeen>& list, SemaphoreHandle_t listMutex);
+
+void setRegistrySnapshotDebug(Stream* debugOutPtr); // for debug output
+
+#endif
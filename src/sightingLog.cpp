@@ -0,0 +1,313 @@
+/*
+   sightingLog.cpp
+*/
+#include "sightingLog.h"
+#include "LittleFSsupport.h"
+#include <millisDelay.h>
+
+static Stream* debugPtr = NULL;  // local to this file
+
+void setSightingLogDebug(Stream* debugOutPtr) {
+  debugPtr = debugOutPtr;
+}
+
+static const uint8_t SIGHTING_RECORD_MAGIC = 0xA5;
+static const unsigned long SIGHTING_LOG_FLUSH_MS = 60000; // write staged records at least this often
+
+// written to flash as is, a record with a bad magic or crc, e.g. torn by a power loss, is skipped on replay
+struct sightingRecord_struct {
+  int64_t epoch_ms; // Unix time in ms
+  char name[SIGHTING_LOG_NAME_SIZE]; // full advertised name
+  uint8_t magic; // SIGHTING_RECORD_MAGIC
+  uint16_t crc; // over epoch_ms and name
+};
+
+// staging buffer, filled by logSighting() from the BLE task, emptied by flushSightingLog() from loop()
+static struct sightingRecord_struct stagingBuffer[SIGHTING_LOG_STAGING_SIZE];
+static size_t stagingCount = 0;
+static uint32_t loggedCount = 0;
+static uint32_t droppedCount = 0;
+static uint32_t flushCount = 0;
+static portMUX_TYPE stagingMux = portMUX_INITIALIZER_UNLOCKED;
+
+// only used from loop()
+static struct sightingRecord_struct flushBuffer[SIGHTING_LOG_STAGING_SIZE];
+static bool logInitialized = false;
+static uint32_t oldestSegment = 0; // segment numbers, oldestSegment..newestSegment may exist
+static uint32_t newestSegment = 0;
+static size_t newestSegmentSize = 0;
+static millisDelay flushTimer;
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t recordCrc(const struct sightingRecord_struct& record) {
+  uint16_t crc = crc16((const uint8_t*)&record.epoch_ms, sizeof(record.epoch_ms));
+  return crc16((const uint8_t*)record.name, sizeof(record.name), crc);
+}
+
+static bool isValidRecord(const struct sightingRecord_struct& record) {
+  return (record.magic == SIGHTING_RECORD_MAGIC) && (record.name[sizeof(record.name) - 1] == '\0') && (record.crc == recordCrc(record));
+}
+
+static void segmentPath(uint32_t segment, char* path, size_t pathSize) {
+  snprintf(path, pathSize, SIGHTING_LOG_DIR "/seg%08lu.bin", (unsigned long)segment);
+}
+
+// returns true and sets segment if name is seg<n>.bin
+static bool parseSegmentName(const char* name, uint32_t& segment) {
+  const char* slash = strrchr(name, '/'); // ESP32 core versions differ on returning the full path
+  if (slash) {
+    name = slash + 1;
+  }
+  unsigned long n = 0;
+  char ext[5];
+  if ((sscanf(name, "seg%8lu.%4s", &n, ext) != 2) || (strcmp(ext, "bin") != 0)) {
+    return false;
+  }
+  segment = (uint32_t)n;
+  return true;
+}
+
+static size_t getSegmentSize(uint32_t segment) {
+  char path[32];
+  segmentPath(segment, path, sizeof(path));
+  int32_t size = getFileSize(path);
+  return (size < 0) ? 0 : (size_t)size;
+}
+
+// remove segments so at most SIGHTING_LOG_MAX_SEGMENTS are kept
+static void deleteOldSegments() {
+  while ((newestSegment - oldestSegment + 1) > SIGHTING_LOG_MAX_SEGMENTS) {
+    char path[32];
+    segmentPath(oldestSegment, path, sizeof(path));
+    if (LittleFS.exists(path)) {
+      deleteFile(path);
+    }
+    oldestSegment++;
+  }
+}
+
+bool initializeSightingLog() {
+  if (logInitialized) {
+    return true;
+  }
+  if (!initializeFS()) {
+    return false;
+  }
+  if (!LittleFS.exists(SIGHTING_LOG_DIR) && !LittleFS.mkdir(SIGHTING_LOG_DIR)) {
+    if (debugPtr) {
+      debugPtr->println("sightingLog could not create " SIGHTING_LOG_DIR);
+    }
+    return false;
+  }
+  File dir = LittleFS.open(SIGHTING_LOG_DIR);
+  if ((!dir) || (!dir.isDirectory())) {
+    return false;
+  }
+  bool foundSegment = false;
+  File file = dir.openNextFile();
+  while (file) {
+    uint32_t segment;
+    if ((!file.isDirectory()) && parseSegmentName(file.name(), segment)) {
+      if (!foundSegment || (segment < oldestSegment)) {
+        oldestSegment = segment;
+      }
+      if (!foundSegment || (segment > newestSegment)) {
+        newestSegment = segment;
+      }
+      foundSegment = true;
+    }
+    file = dir.openNextFile();
+  }
+  newestSegmentSize = foundSegment ? getSegmentSize(newestSegment) : 0;
+  if ((newestSegmentSize % sizeof(struct sightingRecord_struct)) != 0) {
+    // torn by a power loss, the whole records before the tail are kept and the next flush starts a new segment
+    if (debugPtr) {
+      debugPtr->print("sightingLog segment "); debugPtr->print(newestSegment); debugPtr->println(" has a partial last record");
+    }
+  }
+  deleteOldSegments();
+  logInitialized = true;
+  flushTimer.start(SIGHTING_LOG_FLUSH_MS);
+  if (debugPtr) {
+    debugPtr->print("sightingLog segments "); debugPtr->print(oldestSegment); debugPtr->print(" to "); debugPtr->print(newestSegment);
+    debugPtr->print(" newest size "); debugPtr->println(newestSegmentSize);
+  }
+  return true;
+}
+
+bool logSighting(int64_t epoch_ms, const char* advertisedName) {
+  struct sightingRecord_struct record;
+  memset(&record, 0, sizeof(record)); // no random padding on flash
+  record.epoch_ms = epoch_ms;
+  strlcpy(record.name, advertisedName ? advertisedName : "", sizeof(record.name));
+  record.magic = SIGHTING_RECORD_MAGIC;
+  record.crc = recordCrc(record);
+  bool added = false;
+  portENTER_CRITICAL(&stagingMux);
+  if (stagingCount < SIGHTING_LOG_STAGING_SIZE) {
+    stagingBuffer[stagingCount++] = record;
+    loggedCount++;
+    added = true;
+  } else {
+    droppedCount++;
+  }
+  portEXIT_CRITICAL(&stagingMux);
+  return added;
+}
+
+bool flushSightingLog() {
+  if (!logInitialized) {
+    return false;
+  }
+  portENTER_CRITICAL(&stagingMux);
+  size_t count = stagingCount;
+  memcpy(flushBuffer, stagingBuffer, count * sizeof(stagingBuffer[0]));
+  stagingCount = 0;
+  portEXIT_CRITICAL(&stagingMux);
+  if (count == 0) {
+    return true;
+  }
+  size_t bytes = count * sizeof(flushBuffer[0]);
+  // replay reads records at a fixed stride from the start of a segment, so never append after a torn tail or short write
+  bool partialRecord = ((newestSegmentSize % sizeof(flushBuffer[0])) != 0);
+  if (partialRecord || ((newestSegmentSize > 0) && ((newestSegmentSize + bytes) > SIGHTING_LOG_SEGMENT_SIZE))) {
+    newestSegment++; // rotate
+    newestSegmentSize = 0;
+    deleteOldSegments();
+  }
+  char path[32];
+  segmentPath(newestSegment, path, sizeof(path));
+  File file = LittleFS.open(path, "a");
+  if (!file) {
+    if (debugPtr) {
+      debugPtr->print("sightingLog failed to open "); debugPtr->println(path);
+    }
+    return false;
+  }
+  size_t written = file.write((const uint8_t*)flushBuffer, bytes); // one write per batch
+  file.close();
+  newestSegmentSize += written;
+  portENTER_CRITICAL(&stagingMux);
+  flushCount++;
+  portEXIT_CRITICAL(&stagingMux);
+  if (written != bytes) {
+    if (debugPtr) {
+      debugPtr->print("sightingLog short write "); debugPtr->print(written); debugPtr->print(" of "); debugPtr->println(bytes);
+    }
+    return false;
+  }
+  return true;
+}
+
+void processSightingLog() {
+  if (!logInitialized) {
+    return;
+  }
+  portENTER_CRITICAL(&stagingMux);
+  size_t count = stagingCount;
+  portEXIT_CRITICAL(&stagingMux);
+  if (flushTimer.justFinished()) {
+    flushTimer.start(SIGHTING_LOG_FLUSH_MS);
+    flushSightingLog();
+  } else if (count >= (SIGHTING_LOG_STAGING_SIZE / 2)) {
+    flushTimer.start(SIGHTING_LOG_FLUSH_MS);
+    flushSightingLog();
+  }
+}
+
+// time of the last valid record in the segment, 0 if none
+static int64_t getSegmentNewestTime(File& file) {
+  size_t records = file.size() / sizeof(struct sightingRecord_struct); // ignore any torn partial record
+  while (records > 0) {
+    records--;
+    struct sightingRecord_struct record;
+    file.seek(records * sizeof(record));
+    if ((file.read((uint8_t*)&record, sizeof(record)) == sizeof(record)) && isValidRecord(record)) {
+      return record.epoch_ms;
+    }
+  }
+  return 0;
+}
+
+int64_t getNewestSightingLogTime() {
+  if (!logInitialized) {
+    return 0;
+  }
+  // newest valid record is at the end of the newest non-empty segment
+  for (uint32_t segment = newestSegment + 1; segment-- > oldestSegment;) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    if (!LittleFS.exists(path)) {
+      continue;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      continue;
+    }
+    int64_t newest_ms = getSegmentNewestTime(file);
+    if (newest_ms != 0) {
+      return newest_ms;
+    }
+  }
+  return 0;
+}
+
+size_t replaySightingLog(sightingReplayFn fn, int64_t sinceEpoch_ms) {
+  if ((!logInitialized) || (!fn)) {
+    return 0;
+  }
+  size_t replayed = 0;
+  size_t skipped = 0;
+  for (uint32_t segment = oldestSegment; segment <= newestSegment; segment++) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    if (!LittleFS.exists(path)) {
+      continue;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      continue;
+    }
+    if ((sinceEpoch_ms != 0) && (getSegmentNewestTime(file) < sinceEpoch_ms)) {
+      continue; // all older than the registry snapshot, just one record read
+    }
+    file.seek(0);
+    // read in batches, reusing the flush buffer, only called from setup()/loop()
+    size_t len;
+    while ((len = file.read((uint8_t*)flushBuffer, sizeof(flushBuffer))) >= sizeof(flushBuffer[0])) {
+      for (size_t i = 0; i < len / sizeof(flushBuffer[0]); i++) {
+        if (isValidRecord(flushBuffer[i])) {
+          if (flushBuffer[i].epoch_ms >= sinceEpoch_ms) {
+            fn(flushBuffer[i].epoch_ms, flushBuffer[i].name);
+            replayed++;
+          }
+        } else {
+          skipped++;
+        }
+      }
+      yield();
+    }
+  }
+  if (debugPtr) {
+    debugPtr->print("sightingLog replayed "); debugPtr->print(replayed); debugPtr->print(" skipped "); debugPtr->println(skipped);
+  }
+  return replayed;
+}
+
+void getSightingLogCounts(uint32_t& logged, uint32_t& dropped, uint32_t& flushes) {
+  portENTER_CRITICAL(&stagingMux);
+  logged = loggedCount;
+  dropped = droppedCount;
+  flushes = flushCount;
+  portEXIT_CRITICAL(&stagingMux);
+}
@@ -0,0 +1,33 @@
+#ifndef _SIGHTING_LOG_H
+#define _SIGHTING_LOG_H
+/*
+   sightingLog.h
+*/
+#include <Arduino.h>
+
+// Append only log of BLE sightings on LittleFS
+// sightings are staged in RAM and written in batches from loop() to limit flash wear and keep flash writes out of the BLE task
+// the log is split into segments /log/seg<n>.bin, when a segment is full a new one is started and the oldest deleted
+// so the log never uses more than SIGHTING_LOG_MAX_SEGMENTS * SIGHTING_LOG_SEGMENT_SIZE of flash
+#define SIGHTING_LOG_DIR "/log"
+#define SIGHTING_LOG_SEGMENT_SIZE 16384
+#define SIGHTING_LOG_MAX_SEGMENTS 8
+#define SIGHTING_LOG_STAGING_SIZE 32 // records held in RAM between flushes
+#define SIGHTING_LOG_NAME_SIZE 33 // max BLE name 32 + null
+
+bool initializeSightingLog(); // call from setup() after initializeFS(), returns false if the log dir cannot be used
+bool logSighting(int64_t epoch_ms, const char* advertisedName); // safe from any task, returns false if the staging buffer is full
+void processSightingLog(); // call each loop(), writes the staged records when SIGHTING_LOG_STAGING_SIZE/2 are waiting or every 60sec
+bool flushSightingLog(); // write any staged records now, returns false if the write failed
+
+// call before replaySightingLog() to advance an unset clock to the newest record, returns 0 if log empty
+int64_t getNewestSightingLogTime();
+// calls fn for each valid record at or after sinceEpoch_ms, oldest first, returns number of records replayed
+// segments that end before sinceEpoch_ms, e.g. the registry snapshot time, are skipped without reading them
+typedef void (*sightingReplayFn)(int64_t epoch_ms, const char* advertisedName);
+size_t replaySightingLog(sightingReplayFn fn, int64_t sinceEpoch_ms = 0);
+
+void getSightingLogCounts(uint32_t& logged, uint32_t& dropped, uint32_t& flushes); // staging buffer full => dropped
+void setSightingLogDebug(Stream* debugOutPtr); // for debug output
+
+#endif
@@ -0,0 +1,96 @@
+/*
+   taskStats.cpp
+*/
+#include "taskStats.h"
+
+struct taskStats_struct {
+  TaskHandle_t handle;
+  const char* name;
+  uint32_t stackSize; // bytes, as passed to xTaskCreate
+  volatile uint64_t wall_us; // sum of addTaskWallTime_us(), not CPU time
+  bool timed; // addTaskWallTime_us() called
+};
+
+static struct taskStats_struct taskStats[TASK_STATS_MAX_TASKS];
+static size_t taskCount = 0;
+static portMUX_TYPE taskStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+bool registerTaskStats(TaskHandle_t handle, const char* name, uint32_t stackSize) {
+  if ((!handle) || (taskCount >= TASK_STATS_MAX_TASKS)) {
+    return false;
+  }
+  portENTER_CRITICAL(&taskStatsMux);
+  taskStats[taskCount].handle = handle;
+  taskStats[taskCount].name = name;
+  taskStats[taskCount].stackSize = stackSize;
+  taskStats[taskCount].wall_us = 0;
+  taskStats[taskCount].timed = false;
+  taskCount++;
+  portEXIT_CRITICAL(&taskStatsMux);
+  return true;
+}
+
+void addTaskWallTime_us(TaskHandle_t handle, uint32_t wall_us) {
+  portENTER_CRITICAL(&taskStatsMux);
+  for (size_t i = 0; i < taskCount; i++) {
+    if (taskStats[i].handle == handle) {
+      taskStats[i].wall_us += wall_us;
+      taskStats[i].timed = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&taskStatsMux);
+}
+
+static void printPercent(Print& out, uint64_t part, uint64_t total) {
+  if (total == 0) {
+    out.print('-');
+    return;
+  }
+  uint32_t pct_x10 = (uint32_t)((part * 1000) / total);
+  out.print(pct_x10 / 10); out.print('.'); out.print(pct_x10 % 10); out.print('%');
+}
+
+void streamTaskStats(Print& out) {
+  uint64_t uptime_us = (uint64_t)esp_timer_get_time();
+  out.println("task prio stack minFree wall"); // wall time %, includes time preempted, see the cpu column below for CPU %
+  for (size_t i = 0; i < taskCount; i++) {
+    portENTER_CRITICAL(&taskStatsMux);
+    struct taskStats_struct stats = taskStats[i];
+    portEXIT_CRITICAL(&taskStatsMux);
+    out.print(stats.name); out.print(' ');
+    out.print(uxTaskPriorityGet(stats.handle)); out.print(' ');
+    out.print(stats.stackSize); out.print(' ');
+    out.print(uxTaskGetStackHighWaterMark(stats.handle)); out.print(' '); // bytes on ESP32
+    if (stats.timed) {
+      printPercent(out, stats.wall_us, uptime_us);
+    } else {
+      out.print('-'); // polling task, see taskStats.h
+    }
+    out.println();
+  }
+#if (configUSE_TRACE_FACILITY == 1)
+  // all tasks, including the BLE/WiFi stack tasks and idle
+  UBaseType_t numTasks = uxTaskGetNumberOfTasks() + 2; // room for tasks created while reading
+  TaskStatus_t* status = (TaskStatus_t*)malloc(numTasks * sizeof(TaskStatus_t));
+  if (!status) {
+    return;
+  }
+  uint32_t totalRunTime = 0;
+  numTasks = uxTaskGetSystemState(status, numTasks, &totalRunTime);
+  out.println();
+  out.println("all tasks prio minFree cpu");
+  for (UBaseType_t i = 0; i < numTasks; i++) {
+    out.print(status[i].pcTaskName); out.print(' ');
+    out.print(status[i].uxCurrentPriority); out.print(' ');
+    out.print(status[i].usStackHighWaterMark); out.print(' ');
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    printPercent(out, status[i].ulRunTimeCounter, totalRunTime);
+#else
+    out.print('-'); // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS not enabled in sdkconfig, see taskStats.h
+#endif
+    out.println();
+  }
+  free(status);
+#endif
+}
@@ -0,0 +1,21 @@
+#ifndef _TASK_STATS_H
+#define _TASK_STATS_H
+/*
+   taskStats.h
+*/
+#include <Arduino.h>
+
+// Stack and CPU reporting for the sketch's FreeRTOS tasks, so the stack sizes passed to xTaskCreate can be checked on a running unit
+// register each task with the stack size it was created with, tasks that block waiting for work, e.g. on a queue,
+// can add the wall time of each piece of work with addTaskWallTime_us()
+// wall time is end - start, so it includes time the task was preempted or yielded to other tasks, it is an upper bound on CPU use
+// polling tasks, e.g. loop(), are always runnable so their wall time is ~100% by construction, do not time them, they show wall -
+// CPU % of all tasks, e.g. loop() and the BLE and WiFi stack tasks, needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS=y in sdkconfig,
+// the precompiled Arduino ESP32 core leaves it off, so it needs the core built with ESP-IDF, e.g. framework = arduino, espidf
+#define TASK_STATS_MAX_TASKS 6
+
+bool registerTaskStats(TaskHandle_t handle, const char* name, uint32_t stackSize); // returns false if no room, name must be a static string
+void addTaskWallTime_us(TaskHandle_t handle, uint32_t wall_us); // call from the task itself after each piece of work
+void streamTaskStats(Print& out); // one line per task, "name prio stack minFree wall%", wall - if the task is not timed
+
+#endif
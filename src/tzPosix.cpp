@@ -14,9 +14,12 @@
    ESP8266 insists on DST name if have dst
 */
 #include <Arduino.h>
+#include <time.h>
 #include "tzPosix.h"
 #include "ntpSupport.h"
 #include "SafeString.h"
+#include "BufferPrint.h"
+#include "tzIanaTable.h"
 
 static Stream* debugPtr = NULL;  // local to this file
 
@@ -40,25 +43,46 @@ static Stream* debugPtr = NULL;  // local to this file
 
 static struct posix_tz_data_struct posixTZ_Data;
 
-void buildPOSIXstr(struct posix_tz_data_struct& posixData, String& result);
-void buildPOSIXdescription(struct posix_tz_data_struct& posixData, String& result);
-
 // tz_str is updated with cleaned up tz POSIX string
 // tz_str_len is sizeof of tz_str storage
 // eg    cleanUpPosixTZStr(timeZoneConfig.tzStr,sizeof(timeZoneConfig.tzStr));
 void cleanUpPosixTZStr(char *tz_str, size_t tz_str_len) {
-  String tzStr = tz_str;
-  cleanUpPosixTZStr(tzStr);
-  strlcpy(tz_str, tzStr.c_str(), tz_str_len);
+  if (debugPtr) {
+    debugPtr->print("cleanUpPosixTZStr:"); debugPtr->println(tz_str);
+  }
+  struct posix_tz_data_struct posixData;
+  posixTZDataFromStr(tz_str, strlen(tz_str), posixData); // finished with tz_str before it is overwritten
+  buildPOSIXstr(posixData, tz_str, tz_str_len);
 }
 
 void cleanUpPosixTZStr(String& posixTZstr) {
-  if (debugPtr) {
-    debugPtr->print("cleanUpPosixTZStr:"); debugPtr->println(posixTZstr);
+  char tzStr[POSIX_TZ_STR_SIZE];
+  strlcpy(tzStr, posixTZstr.c_str(), sizeof(tzStr));
+  cleanUpPosixTZStr(tzStr, sizeof(tzStr));
+  posixTZstr = tzStr;
+}
+
+// binary search of the tzdata generated table, e.g. "Australia/Sydney" returns "AEST-10AEDT,M10.1.0,M4.1.0/3"
+// names are case sensitive, returns NULL if not found
+const char* ianaToPosixTZ(const char* ianaName) {
+  if (!ianaName) {
+    return NULL;
+  }
+  size_t lo = 0;
+  size_t hi = TZ_IANA_TABLE_SIZE; // search [lo,hi)
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(ianaName, tzIanaTable[mid].name);
+    if (cmp == 0) {
+      return tzIanaTable[mid].posixTZ;
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
   }
-  struct posix_tz_data_struct posixData;
-  posixTZDataFromStr(posixTZstr, posixData);
-  buildPOSIXstr(posixData, posixTZstr);
+  return NULL;
 }
 
 void printPosixData(struct posix_tz_data_struct& posixData, Stream& out) {
@@ -104,8 +128,8 @@ void setTZoffsetInMins(int min_offset) {
     printPosixData(posixTZ_Data, *debugPtr);
   }
   // fix up name
-  String result;
-  buildPOSIXstr(posixTZ_Data, result); // sets tzname and cleans up struct.
+  char result[POSIX_TZ_STR_SIZE];
+  buildPOSIXstr(posixTZ_Data, result, sizeof(result)); // sets tzname and cleans up struct.
   if (debugPtr) {
     debugPtr->print(result);
   }
@@ -115,16 +139,19 @@ void setTZoffsetInMins(int min_offset) {
   //  saveTZstr(result.c_str()); // update file
   //  clearRebootFile();
   //  ESP.restart(); // see https://github.com/esp8266/Arduino/issues/1017  seems to work here
-  setTZfromPOSIXstr(result.c_str()); // update envir var
+  setTZfromPOSIXstr(result); // update envir var
 }
 
-// only called with +ve value now
-// only works for +ve values
-static void print2digits(String &result, int num) {
+// -ve values get a leading -, e.g. -01
+static void print2digits(Print &result, int num) {
+  if (num < 0) {
+    result.print('-');
+    num = -num;
+  }
   if (num < 10) {
-    result += '0';
+    result.print('0');
   }
-  result += num;
+  result.print(num);
 }
 
 // limit mins to +/-16hrs = 960
@@ -147,10 +174,14 @@ uint8_t cleanTimeMin(uint minIn) {
 }
 
 // would expect to be 0 to 23 but Jerusalem  == "IST-2IDT,M3.4.4/26,M10.5.0"
-// so allow upto 30??
-uint8_t cleanHrStart(uint8_t hrIn) {
-  if (hrIn > 30) { // unsigned
-    hrIn = hrIn % 24; // clean up to 0 to 23
+// Gaza "EET-2EEST,M3.4.4/50,M10.4.4/50" and Nuuk "<-02>2<-01>,M3.5.0/-1,M10.5.0/0"
+// RFC 8536 allows -167 to 167
+int16_t cleanHrStart(int hrIn) {
+  if (hrIn < -167) {
+    return -167;
+  }
+  if (hrIn > 167) {
+    return 167;
   }
   return hrIn;
 }
@@ -189,30 +220,30 @@ void minsToSignHrMin(int mins, int8_t& sgn, uint8_t& hh, uint8_t& mm) {
   mm = mins % 60;
 }
 
-// appends to String rtn +/-hh:mm in POSIX format
+// prints to rtn +/-hh:mm in POSIX format
 // only show :mm if nonzero
-void POSIXTohhmmOffset(int mins, String& rtn) {
+void POSIXTohhmmOffset(int mins, Print& rtn) {
   int8_t sgn = 1; uint8_t hh = 0; uint8_t mm = 0;
   minsToSignHrMin(mins, sgn, hh, mm);
   if (sgn < 0) {
-    rtn += '-';
+    rtn.print('-');
   }
-  rtn += hh;
+  rtn.print(hh);
   if (mm) {
-    rtn += ':';
+    rtn.print(':');
     print2digits(rtn, mm);
   }
 }
 
-// appends to String rtn +/-hhmm in GMT format i.e. leading 0 if <10hrs anD change sign from POSIX tz offset
+// prints to rtn +/-hhmm in GMT format i.e. leading 0 if <10hrs anD change sign from POSIX tz offset
 // only show mm if nonzero
-void GMThhmmOffset(int mins, String& rtn) {
+void GMThhmmOffset(int mins, Print& rtn) {
   int8_t sgn = 1; uint8_t hh = 0; uint8_t mm = 0;
   minsToSignHrMin(mins, sgn, hh, mm);
   if (sgn >= 0) {
-    rtn += '-';
+    rtn.print('-');
   } else {
-    rtn += '+';
+    rtn.print('+');
   }
   print2digits(rtn, hh);
   if (mm) {
@@ -259,6 +290,7 @@ void cleanUpPosixData(struct posix_tz_data_struct& posixData) {
     //set to start
     posixData.end_week = posixData.start_week; // already cleaned up
   }
+  posixData.end_week = cleanWeek(posixData.end_week); // 1 to 5
   posixData.end_dow = cleanDay(posixData.end_dow);// 0 is Sunday
   posixData.end_time_hr = cleanHrStart(posixData.end_time_hr); //default 2 if not specified
   posixData.end_time_min = cleanTimeMin(posixData.end_time_min); // correct to start_month+6 if missing
@@ -270,21 +302,19 @@ void cleanUpPosixData(struct posix_tz_data_struct& posixData) {
       // special GMT case
       strlcpy(posixData.tzname, "GMT", sizeof(posixData.tzname));
     } else {
-      String tzName;
-      tzName += '<';
+      BufferPrint tzName(posixData.tzname, sizeof(posixData.tzname));
+      tzName.print('<');
       GMThhmmOffset(posixData.offset_min, tzName);
-      tzName += '>';
-      strlcpy(posixData.tzname, tzName.c_str(), sizeof(posixData.tzname));
+      tzName.print('>');
     }
   }
   if (posixData.dsttzname[0] == '\0') {
     // ESP8266 need dst name if have dst
     if (posixData.start_month) { // have dst
-      String dsttzName;
-      dsttzName += '<';
+      BufferPrint dsttzName(posixData.dsttzname, sizeof(posixData.dsttzname));
+      dsttzName.print('<');
       GMThhmmOffset(posixData.dst_offset_min, dsttzName);
-      dsttzName += '>';
-      strlcpy(posixData.dsttzname, dsttzName.c_str(), sizeof(posixData.dsttzname));
+      dsttzName.print('>');
     } else {
       posixData.dsttzname[0] = '\0'; // clear it if not dst
     }
@@ -295,92 +325,120 @@ static char weekNames[6][5] = {
   "---", "1st", "2nd", "3rd", "4th", "last"
 };
 
-void convertWeektoStr(String & result, uint8_t week) {
+void convertWeektoStr(Print & result, uint8_t week) {
   if (week > 5) {
     week = 0;
   }
-  result += weekNames[week];
+  result.print(weekNames[week]);
 }
 
 static char dayNames[7][4] = {
   "Sun", "Mon", "Tue", "Wed", "Thr", "Fri", "Sat"
 };
-void convertDaytoStr(String & result, uint8_t dayOfWk) {
+void convertDaytoStr(Print & result, uint8_t dayOfWk) {
   if (dayOfWk >= 7) {
     dayOfWk = 0;
   }
-  result += dayNames[dayOfWk];
+  result.print(dayNames[dayOfWk]);
 }
 
 static char monthNames[13][4] = {
   "---", "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jly", "Aug", "Sep", "Oct", "Nov", "Dec"
 };
-void convertMonthtoStr(String & result, uint8_t month) {
+void convertMonthtoStr(Print & result, uint8_t month) {
   if (month > 12) {
     month = 0;
   }
-  result += monthNames[month];
+  result.print(monthNames[month]);
 }
 
 // human readable description
 void getTZDescription(String& posixTZstr, String &result) {
+  char desc[TZ_DESCRIPTION_SIZE];
+  getTZDescription(posixTZstr.c_str(), desc, sizeof(desc));
+  result = desc;
+}
+
+size_t getTZDescription(const char* posixTZstr, char* buf, size_t bufSize) {
   struct posix_tz_data_struct posixDataLocal;
-  posixTZDataFromStr(posixTZstr, posixDataLocal);
-  buildPOSIXdescription(posixDataLocal, result);
+  posixTZDataFromStr(posixTZstr, strlen(posixTZstr), posixDataLocal);
+  return buildPOSIXdescription(posixDataLocal, buf, bufSize);
 }
 
 void buildPOSIXdescription(struct posix_tz_data_struct & posixData, String & result) {
+  char desc[TZ_DESCRIPTION_SIZE];
+  buildPOSIXdescription(posixData, desc, sizeof(desc));
+  result = desc;
+}
+
+size_t buildPOSIXdescription(struct posix_tz_data_struct & posixData, char* buf, size_t bufSize) {
+  BufferPrint result(buf, bufSize);
+  buildPOSIXdescription(posixData, result);
+  return result.length();
+}
+
+void buildPOSIXdescription(struct posix_tz_data_struct & posixData, Print & result) {
   cleanUpPosixData(posixData);
-  result = ""; // clear result
-  if (posixData.tzname == "UTC") {
-    result = "UTC";
+  if (strcmp(posixData.tzname, "UTC") == 0) {
+    result.print("UTC");
     return;
   }
   // else create name GMT +/- offset but change sign
-  result = "GMT";
+  result.print("GMT");
   GMThhmmOffset(posixData.offset_min, result);
 
   //  result += "\n(Note: POSIX TZ is the -ve of the GMT offset)";
   // finished name.
   if (!posixData.start_month) {
     // no dst rules
-    result += "\n No daylight saving rules";
+    result.print("\n No daylight saving rules");
     return;
   }
-  result += "\n Daylight Saving ";
-  result += "GMT";
+  result.print("\n Daylight Saving ");
+  result.print("GMT");
   GMThhmmOffset(posixData.dst_offset_min, result);
-  result += " starts in the";
-  result += "\n"; // 1st .. last week
+  result.print(" starts in the");
+  result.print('\n'); // 1st .. last week
   convertWeektoStr(result, posixData.start_week);
-  result += " week of ";
+  result.print(" week of ");
   convertMonthtoStr(result, posixData.start_month);
-  result += " on ";
+  result.print(" on ");
   convertDaytoStr(result, posixData.start_dow);
-  result += " at ";
+  result.print(" at ");
   print2digits(result, posixData.start_time_hr);
-  result += ':';
+  result.print(':');
   print2digits(result, posixData.start_time_min);
 
-  result += "\n Daylight Saving ends in the";
-  result += "\n"; // 1st .. last week
+  result.print("\n Daylight Saving ends in the");
+  result.print('\n'); // 1st .. last week
   convertWeektoStr(result, posixData.end_week);
-  result += " week of ";
+  result.print(" week of ");
   convertMonthtoStr(result, posixData.end_month);
-  result += " on ";
+  result.print(" on ");
   convertDaytoStr(result, posixData.end_dow);
-  result += " at ";
+  result.print(" at ");
   print2digits(result, posixData.end_time_hr);
-  result += ':';
+  result.print(':');
   print2digits(result, posixData.end_time_min);
 }
 
-// this also cleans up out of range values
 void buildPOSIXstr(struct posix_tz_data_struct & posixData, String & result) {
+  char tzStr[POSIX_TZ_STR_SIZE];
+  buildPOSIXstr(posixData, tzStr, sizeof(tzStr));
+  result = tzStr;
+}
+
+size_t buildPOSIXstr(struct posix_tz_data_struct & posixData, char* buf, size_t bufSize) {
+  BufferPrint result(buf, bufSize);
+  buildPOSIXstr(posixData, result);
+  return result.length();
+}
+
+// this also cleans up out of range values
+void buildPOSIXstr(struct posix_tz_data_struct & posixData, Print & result) {
   cleanUpPosixData(posixData);
-  result = ""; // clear result
-  result += posixData.tzname;
-  if (result == "UTC") {
+  result.print(posixData.tzname);
+  if (strcmp(posixData.tzname, "UTC") == 0) {
     return;
   }
   POSIXTohhmmOffset(posixData.offset_min, result); // add [-]hr[:mm]
@@ -390,39 +448,98 @@ void buildPOSIXstr(struct posix_tz_data_struct & posixData, String & result) {
     return;
   }
   //else  // have dst
-  result += posixData.dsttzname;
+  result.print(posixData.dsttzname);
   POSIXTohhmmOffset(posixData.dst_offset_min, result); // add [-]hr[:mm]
 
-  result += ',';
-  result += 'M';
-  result +=  posixData.start_month;
-  result += '.';
-  result +=  posixData.start_week;
-  result += '.';
-  result +=  posixData.start_dow;
+  result.print(',');
+  result.print('M');
+  result.print(posixData.start_month);
+  result.print('.');
+  result.print(posixData.start_week);
+  result.print('.');
+  result.print(posixData.start_dow);
   // add default /2 for clarity
-  result += '/';
-  result += posixData.start_time_hr;
+  result.print('/');
+  result.print(posixData.start_time_hr);
   if ( posixData.start_time_min) {
-    result += ':';
+    result.print(':');
     print2digits(result, posixData.start_time_min);
   }
-  result += ',';
-  result += 'M';
-  result +=  posixData.end_month;
-  result += '.';
-  result +=  posixData.end_week;
-  result += '.';
-  result +=  posixData.end_dow;
+  result.print(',');
+  result.print('M');
+  result.print(posixData.end_month);
+  result.print('.');
+  result.print(posixData.end_week);
+  result.print('.');
+  result.print(posixData.end_dow);
   // add default /2 for clarity
-  result += '/';
-  result += posixData.end_time_hr;
+  result.print('/');
+  result.print(posixData.end_time_hr);
   if ( posixData.end_time_min) {
-    result += ':';
+    result.print(':');
     print2digits(result, posixData.end_time_min);
   }
 }
 
+// days since 1970-01-01 for year, month 1 to 12, day 1 to 31
+// from Howard Hinnant's days_from_civil, valid for all int years
+int32_t daysFromCivil(int year, unsigned int month, unsigned int day) {
+  year -= (month <= 2) ? 1 : 0;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned int yoe = (unsigned int)(year - era * 400);      // [0, 399]
+  const unsigned int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+  const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;   // [0, 146096]
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+// inverse of daysFromCivil, from Howard Hinnant's civil_from_days
+void civilFromDays(int32_t days, int& year, unsigned int& month, unsigned int& day) {
+  days += 719468;
+  const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const unsigned int doe = (unsigned int)(days - era * 146097);          // [0, 146096]
+  const unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+  const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);      // [0, 365]
+  const unsigned int mp = (5 * doy + 2) / 153;                           // [0, 11]
+  day = doy - (153 * mp + 2) / 5 + 1;                                    // [1, 31]
+  month = (mp < 10) ? (mp + 3) : (mp - 9);                               // [1, 12]
+  year = (int)(yoe + era * 400) + ((month <= 2) ? 1 : 0);
+}
+
+static bool isLeapYear(int year) {
+  return ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0));
+}
+
+// Unix time of a Mm.w.d/hh:mm rule in year as local time in secs, i.e. still needs the offset applied
+static int64_t localSecsOfRule(int year, uint8_t month, uint8_t week, uint8_t dow, int hr, uint8_t min) {
+  static const uint8_t daysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  int32_t firstDay = daysFromCivil(year, month, 1);
+  uint8_t firstDow = (uint8_t)(((firstDay % 7) + 7 + 4) % 7); // 1970-01-01 was a Thursday, 0 is Sunday
+  int day = 1 + ((dow + 7 - firstDow) % 7) + (week - 1) * 7; // week 5 means the last
+  int monthDays = daysInMonth[month - 1] + (((month == 2) && isLeapYear(year)) ? 1 : 0);
+  while (day > monthDays) {
+    day -= 7;
+  }
+  // hr can be > 24 or -ve, e.g. Jerusalem M3.4.4/26, Nuuk M3.5.0/-1
+  return ((int64_t)(firstDay + day - 1)) * 86400 + (int64_t)hr * 3600 + (int64_t)min * 60;
+}
+
+// calculate the Unix (UTC) times DST starts and ends in year
+// returns false if no dst
+// posixData must be cleaned up, i.e. from posixTZDataFromStr()
+// start is before end for the northern hemisphere and after it for the southern
+bool getDSTtransitionsUTC(const struct posix_tz_data_struct& posixData, int year, int64_t& dstStartUtc, int64_t& dstEndUtc) {
+  if ((posixData.start_month == 0) || (posixData.end_month == 0) || (posixData.dst_offset_min == INT_MAX)) {
+    return false;
+  }
+  // POSIX offsets are +ve west of GMT, i.e. UTC = local + offset
+  // the start time is in standard time, the end time is in daylight saving time
+  dstStartUtc = localSecsOfRule(year, posixData.start_month, posixData.start_week, posixData.start_dow,
+                                posixData.start_time_hr, posixData.start_time_min) + (int64_t)posixData.offset_min * 60;
+  dstEndUtc = localSecsOfRule(year, posixData.end_month, posixData.end_week, posixData.end_dow,
+                              posixData.end_time_hr, posixData.end_time_min) + (int64_t)posixData.dst_offset_min * 60;
+  return (dstStartUtc != dstEndUtc); // e.g. M4.5.0/2,M4.5.0/3 with a 1hr shift starts and ends at the same instant, i.e. no dst
+}
+
 //time_t Timezone::tzTime(time_t t, ezLocalOrUTC_t local_or_utc, String &tzname, bool &is_dst, int16_t &offset) {
 
 // convert (int)hrOffset : (ont)mmOffset into signed offset_min
@@ -451,51 +568,110 @@ int getMinsFromhhmm(int hhOffset, int mmOffset) {
 }
 
 void posixTZDataFromStr(String & posixTZstr) { // parses POSIX tz str into its components updates static global posixTZ_Data
-  posixTZDataFromStr(posixTZstr, posixTZ_Data);
+  posixTZDataFromStr(posixTZstr.c_str(), posixTZstr.length(), posixTZ_Data);
 }
 
-// cleans up data at end
 void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posixTZData) {
-  if (debugPtr) {
-    debugPtr->print("posixTZDataFromStr("); debugPtr->print(posixTZstr); debugPtr->println(")");
+  posixTZDataFromStr(posixTZstr.c_str(), posixTZstr.length(), posixTZData);
+}
+
+// parse [sign]digits starting at str[pos], stops at len or first non-digit, like atoi( ) but does not read past len
+// result limited to +/-9999 so out of range values cannot overflow, they are cleaned up later
+static int parseInt(const char* str, size_t len, size_t pos) {
+  int sgn = 1;
+  if ((pos < len) && ((str[pos] == '-') || (str[pos] == '+'))) {
+    if (str[pos] == '-') {
+      sgn = -1;
+    }
+    pos++;
   }
-  String _posix = posixTZstr.c_str();
-  _posix.trim();
-  String tzname;
-  bool is_dst = false;
-  int16_t offset = 0;
+  int rtn = 0;
+  while ((pos < len) && isDigit(str[pos])) {
+    if (rtn < 9999) {
+      rtn = rtn * 10 + (str[pos] - '0');
+    }
+    pos++;
+  }
+  if (rtn > 9999) {
+    rtn = 9999;
+  }
+  return rtn * sgn;
+}
 
-  zero_posix_tz_data_struct(posixTZData);
-  if (_posix.length() == 0) {
-    return; // use zero data
+// POSIX names are 3 or more letters, or <..> quoted 3 or more letters, digits, + or -
+static bool isValidName(const char* str, size_t begin, size_t end) {
+  if ((end <= begin) || ((end - begin) < 3)) {
+    return false;
+  }
+  bool quoted = (str[begin] == '<');
+  if (quoted) {
+    if (((end - begin) < 5) || (str[end - 1] != '>')) {
+      return false;
+    }
+    begin++;
+    end--;
   }
+  for (size_t i = begin; i < end; i++) {
+    char c = str[i];
+    if (!(isAlpha(c) || (quoted && (isDigit(c) || (c == '+') || (c == '-'))))) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  if ((_posix[0] == '+') || (_posix[0] == '-') || isDigit(_posix[0]) ) {
-    // missing tz name just add space that will be trimmed later
-    String tmp = " ";
-    tmp += _posix;
-    _posix = tmp;
+// copy str[begin..end) to name
+// invalid names and names too long for nameSize (>19chars) are dropped, cleanUpPosixData() then uses <+hh:mm>
+static void copyName(char* name, size_t nameSize, const char* str, size_t begin, size_t end) {
+  name[0] = '\0';
+  if (!isValidName(str, begin, end) || ((end - begin) >= nameSize)) {
+    return;
+  }
+  memcpy(name, str + begin, end - begin);
+  name[end - begin] = '\0';
+}
+
+// parses the first len chars of posixTZstr, does not need a terminating '\0' and does not use the heap
+// cleans up data at end
+void posixTZDataFromStr(const char* posixTZstr, size_t len, struct posix_tz_data_struct & posixTZData) {
+  if (debugPtr) {
+    debugPtr->print("posixTZDataFromStr("); debugPtr->write((const uint8_t*)posixTZstr, len); debugPtr->println(")");
+  }
+  zero_posix_tz_data_struct(posixTZData);
+  // trim
+  const char* _posix = posixTZstr;
+  while ((len > 0) && isSpace(_posix[0])) {
+    _posix++;
+    len--;
+  }
+  while ((len > 0) && isSpace(_posix[len - 1])) {
+    len--;
+  }
+  if (len == 0) {
+    return; // use zero data
   }
 
   enum posix_state_e {STD_NAME, OFFSET_HR, OFFSET_MIN, DST_NAME, DST_SHIFT_HR, DST_SHIFT_MIN, START_MONTH, START_WEEK, START_DOW, START_TIME_HR, START_TIME_MIN, END_MONTH, END_WEEK, END_DOW, END_TIME_HR, END_TIME_MIN};
   posix_state_e state = STD_NAME;
 
-
   bool ignore_nums = false;
   char c = 1; // Dummy value to get while(newchar) started
-  uint8_t strpos = 0;
-  uint8_t stdname_end = _posix.length() - 1;
-  uint8_t dstname_begin = _posix.length();
-  uint8_t dstname_end = _posix.length();
+  size_t strpos = 0;
+  // name ends are one past the last char, missing tz name, e.g. "-10", gives empty stdname
+  size_t stdname_end = len;
+  size_t dstname_begin = len;
+  size_t dstname_end = len;
   bool haveDSTname = false;
   int hhOffset = 0;
   int mmOffset = 0;
+  bool offsetNeg = false; // -0:30 parses hh as 0 so keep sign here
   bool foundDstOffset = false;
   int hhDstOffset = 0;
   int mmDstOffset = 0;
+  bool dstOffsetNeg = false;
 
-  while (strpos < _posix.length()) {
-    c = (char)_posix[strpos];
+  while (strpos < len) {
+    c = _posix[strpos];
 
     // Do not replace the code below with switch statement: evaluation of state that
     // changes while this runs. (Only works because this state can only go forward.)
@@ -509,7 +685,7 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       }
       if (!ignore_nums && (isDigit(c) || c == '-'  || c == '+')) {
         state = OFFSET_HR;
-        stdname_end = strpos - 1;
+        stdname_end = strpos;
       }
     }
     if (c && state == OFFSET_HR) {
@@ -523,11 +699,8 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
         dstname_begin = strpos;
       } else {
         if (hhOffset == 0) {
-          hhOffset = atoi(_posix.c_str() + strpos);
-          //          if (debugPtr) {
-          //            debugPtr->print("hhOffset:"); debugPtr->println(hhOffset);
-          //            debugPtr->println(_posix.c_str() + strpos);
-          //          }
+          offsetNeg = offsetNeg || (c == '-');
+          hhOffset = parseInt(_posix, len, strpos);
         }
       }
     }
@@ -538,11 +711,7 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
         ignore_nums = false;
       } else {
         if (mmOffset == 0) {
-          mmOffset = atoi(_posix.c_str() + strpos);
-          //          if (debugPtr) {
-          //            debugPtr->print("mmOffset:"); debugPtr->println(mmOffset);
-          //            debugPtr->println(_posix.c_str() + strpos);
-          //          }
+          mmOffset = parseInt(_posix, len, strpos);
         }
       }
     }
@@ -552,10 +721,10 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       if (c == ',') {
         state = START_MONTH;
         c = 0;
-        dstname_end = strpos - 1;
+        dstname_end = strpos;
       } else if (!ignore_nums && (c == '-' || isDigit(c))) {
         state = DST_SHIFT_HR;
-        dstname_end = strpos - 1;
+        dstname_end = strpos;
       }
       haveDSTname = true;
     }
@@ -569,10 +738,8 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       } else {
         if (hhDstOffset == 0) {
           foundDstOffset = true;
-          hhDstOffset = atoi(_posix.c_str() + strpos);
-          //          if (debugPtr) {
-          //            debugPtr->print("hhDstOffset:"); debugPtr->println(hhDstOffset);
-          //          }
+          dstOffsetNeg = dstOffsetNeg || (c == '-');
+          hhDstOffset = parseInt(_posix, len, strpos);
         }
       }
     }
@@ -583,10 +750,7 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       } else {
         if (mmDstOffset == 0) {
           foundDstOffset = true;
-          mmDstOffset = atoi(_posix.c_str() + strpos);
-          //          if (debugPtr) {
-          //            debugPtr->print("mmDstOffset:"); debugPtr->println(mmDstOffset);
-          //          }
+          mmDstOffset = parseInt(_posix, len, strpos);
         }
       }
     }
@@ -594,7 +758,7 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       if (c == '.') {
         state = START_WEEK;
         c = 0;
-      } else if (c != 'M' && !posixTZData.start_month) posixTZData.start_month = atoi(_posix.c_str() + strpos);
+      } else if (c != 'M' && !posixTZData.start_month) posixTZData.start_month = parseInt(_posix, len, strpos);
     }
     if (c && state == START_WEEK) {
       if (c == '.') {
@@ -618,19 +782,19 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       } else if (c == ',') {
         state = END_MONTH;
         c = 0;
-      } else if (posixTZData.start_time_hr == 2) posixTZData.start_time_hr = atoi(_posix.c_str() + strpos);
+      } else if (posixTZData.start_time_hr == 2) posixTZData.start_time_hr = parseInt(_posix, len, strpos);
     }
     if (c && state == START_TIME_MIN) {
       if (c == ',') {
         state = END_MONTH;
         c = 0;
-      } else if (!posixTZData.start_time_min) posixTZData.start_time_min = atoi(_posix.c_str() + strpos);
+      } else if (!posixTZData.start_time_min) posixTZData.start_time_min = parseInt(_posix, len, strpos);
     }
     if (c && state == END_MONTH) {
       if (c == '.') {
         state = END_WEEK;
         c = 0;
-      } else if (c != 'M') if (!posixTZData.end_month) posixTZData.end_month = atoi(_posix.c_str() + strpos);
+      } else if (c != 'M') if (!posixTZData.end_month) posixTZData.end_month = parseInt(_posix, len, strpos);
     }
     if (c && state == END_WEEK) {
       if (c == '.') {
@@ -648,10 +812,10 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
       if (c == ':') {
         state = END_TIME_MIN;
         c = 0;
-      }  else if (posixTZData.end_time_hr == 2) posixTZData.end_time_hr = atoi(_posix.c_str() + strpos);
+      }  else if (posixTZData.end_time_hr == 2) posixTZData.end_time_hr = parseInt(_posix, len, strpos);
     }
     if (c && state == END_TIME_MIN) {
-      if (!posixTZData.end_time_min) posixTZData.end_time_min = atoi(_posix.c_str() + strpos);
+      if (!posixTZData.end_time_min) posixTZData.end_time_min = parseInt(_posix, len, strpos);
     }
     strpos++;
   }
@@ -661,17 +825,20 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
 
   // now fill in offset_min and dst_offset_min
   // take the sign from the hr if non-zero else use mm sign
+  if (offsetNeg && (hhOffset == 0) && (mmOffset > 0)) {
+    mmOffset = -mmOffset;
+  }
+  if (dstOffsetNeg && (hhDstOffset == 0) && (mmDstOffset > 0)) {
+    mmDstOffset = -mmDstOffset;
+  }
   posixTZData.offset_min = getMinsFromhhmm(hhOffset, mmOffset); // with sign if any
   if (foundDstOffset) {
     posixTZData.dst_offset_min = getMinsFromhhmm(hhDstOffset, mmDstOffset); // with sign if any
   } // else leave as INT_MAX
 
-  tzname = _posix.substring(0, stdname_end + 1);  // Overwritten with dstname later if needed
-  //      tzname = _posix.substring(dstname_begin, dstname_end + 1);
-  strlcpy(posixTZData.tzname, tzname.c_str(), sizeof(posixTZData.tzname)); // truncate if >19chars
+  copyName(posixTZData.tzname, sizeof(posixTZData.tzname), _posix, 0, stdname_end); // cleared if invalid or >19chars
   if (haveDSTname) {
-    String dsttzname = _posix.substring(dstname_begin, dstname_end + 1);
-    strlcpy(posixTZData.dsttzname, dsttzname.c_str(), sizeof(posixTZData.dsttzname)); // truncate if >19chars
+    copyName(posixTZData.dsttzname, sizeof(posixTZData.dsttzname), _posix, dstname_begin, dstname_end); // cleared if invalid or >19chars
   }
   if (debugPtr) {
     printPosixData(posixTZData, *debugPtr);
@@ -682,14 +849,15 @@ void posixTZDataFromStr(String & posixTZstr, struct posix_tz_data_struct & posix
   }
 }
 
-static bool testParser(String input) {
-  String result;
-  posixTZDataFromStr(input);
+// returns false if input does not round trip
+static bool testParser(const char* input) {
+  char result[POSIX_TZ_STR_SIZE];
+  posixTZDataFromStr(input, strlen(input), posixTZ_Data);
   if (debugPtr) {
     printPosixData(posixTZ_Data, *debugPtr);
   }
-  buildPOSIXstr(posixTZ_Data, result);
-  if (result != input) {
+  buildPOSIXstr(posixTZ_Data, result, sizeof(result));
+  if (strcmp(result, input) != 0) {
     if (debugPtr) {
       debugPtr->print(" >>> >>> >>> > missmatch  ");
       debugPtr->println(result);
@@ -699,8 +867,106 @@ static bool testParser(String input) {
   return true;
 }
 
+// parse, build, parse, build must give the same string both times for any input
+static bool testRoundTrip(const char* input, size_t len) {
+  struct posix_tz_data_struct posixData;
+  char result1[POSIX_TZ_STR_SIZE];
+  char result2[POSIX_TZ_STR_SIZE];
+  posixTZDataFromStr(input, len, posixData);
+  buildPOSIXstr(posixData, result1, sizeof(result1));
+  posixTZDataFromStr(result1, strlen(result1), posixData);
+  buildPOSIXstr(posixData, result2, sizeof(result2));
+  if (strcmp(result1, result2) != 0) {
+    if (debugPtr) {
+      debugPtr->print(" >>> >>> >>> > round trip missmatch  "); debugPtr->print(result1); debugPtr->print("  "); debugPtr->println(result2);
+    }
+    return false;
+  }
+  return true;
+}
+
+// compare the getDSTtransitionsUTC() local time with the C library's localtime_r() for the same TZ
+// over a sweep of times, returns number of mismatches
+// changes the TZ env, caller restores it
+static unsigned int testOffsets(const char* posixTZstr, int fromYear, int toYear, int32_t step_secs) {
+  struct posix_tz_data_struct posixData;
+  posixTZDataFromStr(posixTZstr, strlen(posixTZstr), posixData);
+  char tzStr[POSIX_TZ_STR_SIZE];
+  buildPOSIXstr(posixData, tzStr, sizeof(tzStr));
+  setenv("TZ", tzStr, 1);
+  tzset();
+  unsigned int errors = 0;
+  for (int year = fromYear; year <= toYear; year++) {
+    int64_t dstStartUtc = 0;
+    int64_t dstEndUtc = 0;
+    bool hasDst = getDSTtransitionsUTC(posixData, year, dstStartUtc, dstEndUtc);
+    int64_t yearEnd = (int64_t)daysFromCivil(year + 1, 1, 1) * 86400;
+    for (int64_t utc = (int64_t)daysFromCivil(year, 1, 1) * 86400; utc < yearEnd; utc += step_secs) {
+      bool isDst = false;
+      if (hasDst) {
+        isDst = (dstStartUtc < dstEndUtc) ? ((utc >= dstStartUtc) && (utc < dstEndUtc)) : ((utc >= dstStartUtc) || (utc < dstEndUtc));
+      }
+      int64_t local = utc - (int64_t)(isDst ? posixData.dst_offset_min : posixData.offset_min) * 60;
+      time_t t = (time_t)utc;
+      struct tm tmLocal;
+      localtime_r(&t, &tmLocal);
+      int64_t libLocal = (int64_t)daysFromCivil(tmLocal.tm_year + 1900, tmLocal.tm_mon + 1, tmLocal.tm_mday) * 86400
+                         + tmLocal.tm_hour * 3600 + tmLocal.tm_min * 60 + tmLocal.tm_sec;
+      if (local != libLocal) {
+        if (debugPtr && (errors < 3)) {
+          debugPtr->print(" >>> >>> >>> > offset missmatch  "); debugPtr->print(tzStr);
+          debugPtr->print(" at "); debugPtr->print((long)utc); debugPtr->print(" local:"); debugPtr->print((long)(local - utc));
+          debugPtr->print(" lib:"); debugPtr->println((long)(libLocal - utc));
+        }
+        errors++;
+      }
+    }
+  }
+  return errors;
+}
+
 void testPosix() {
-  String result;
+  // malformed input, must not crash and must round trip after clean up
+  static const char* const badInputs[] = {"", " ", "<", "<+1", "<+-40", "ABC", "A1B", "-0:30", "XYZ-0:59ABC-0:01,M4.5.0,M4.252.0",
+                                          "CST6CDT,M13.9.9/99:99,M0.0.0", "EST5EDT,M3.2.0/-200,M11.1.0/200", "<+0123456789012345678901>1",
+                                          ",,,,,,", "M3.2.0", "EST99999999999999EDT,M3.2.0,M11.1.0", "ABC\x01\xff-1"
+                                         };
+  unsigned int errors = 0;
+  for (size_t i = 0; i < sizeof(badInputs) / sizeof(badInputs[0]); i++) {
+    if (!testRoundTrip(badInputs[i], strlen(badInputs[i]))) {
+      errors++;
+    }
+  }
+  // every tzdata zone
+  // newlib does not handle -ve rule hours, e.g. America/Nuuk, so their offsets are expected to differ and are not checked
+  unsigned int skipped = 0;
+  char savedTZ[POSIX_TZ_STR_SIZE];
+  const char* envTZ = getenv("TZ");
+  strlcpy(savedTZ, envTZ ? envTZ : "", sizeof(savedTZ));
+  for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+    if (!testRoundTrip(tzIanaTable[i].posixTZ, strlen(tzIanaTable[i].posixTZ))) {
+      errors++;
+    }
+    struct posix_tz_data_struct posixData;
+    posixTZDataFromStr(tzIanaTable[i].posixTZ, strlen(tzIanaTable[i].posixTZ), posixData);
+    if ((posixData.start_month != 0) && ((posixData.start_time_hr < 0) || (posixData.end_time_hr < 0))) {
+      skipped++;
+    } else {
+      errors += testOffsets(tzIanaTable[i].posixTZ, 2024, 2026, 6 * 3600 + 17 * 60);
+    }
+    yield();
+  }
+  if (envTZ) {
+    setenv("TZ", savedTZ, 1);
+  } else {
+    unsetenv("TZ");
+  }
+  tzset();
+  if (debugPtr) {
+    debugPtr->print("testPosix errors:"); debugPtr->print(errors);
+    debugPtr->print(" zones with -ve rule hours not checked against newlib:"); debugPtr->println(skipped);
+  }
+
   testParser("GMT0");
 
   testParser("<+01>-1");
@@ -13,6 +13,11 @@
 */
 
 #include "limits.h"
+#include <Arduino.h>
+
+// buffer sizes that always hold the output of buildPOSIXstr() and buildPOSIXdescription()
+#define POSIX_TZ_STR_SIZE 96
+#define TZ_DESCRIPTION_SIZE 192
 
 // NOTE if start_month = 0 => no dst
 struct posix_tz_data_struct {
@@ -21,12 +26,12 @@ struct posix_tz_data_struct {
   uint8_t start_month;// = 0, 1 to 12  0 => no dst
   uint8_t start_week;// = 0,  "5th" week means the last in the mon
   uint8_t start_dow; // = 0, 0 is Sunday
-  uint8_t start_time_hr; // = 2, //default 2 if not specified
+  int16_t start_time_hr; // = 2, //default 2 if not specified, -167 to 167
   uint8_t start_time_min; // = 0;
   uint8_t end_month; // = 0, 1 to 12
   uint8_t end_week; // = 0,  "5th" week means the last in the mon
   uint8_t end_dow; // = 0, 0 is Sunday
-  uint8_t end_time_hr; // = 2, //default 2 if not specified
+  int16_t end_time_hr; // = 2, //default 2 if not specified, -167 to 167
   uint8_t end_time_min; // = 0;
   char tzname[20];
   char dsttzname[20];
@@ -36,15 +41,29 @@ void setTZoffsetInMins(int min_offset);
 // use this if just updating TZ offset so that new name generated
 void clearTZnames(struct posix_tz_data_struct& posixData);
 
+// the char*/Print versions do not use the heap, output is truncated to fit bufSize, return the length written
 void getTZDescription(String& posixTZstr, String &result); // human readable description
+size_t getTZDescription(const char* posixTZstr, char* buf, size_t bufSize);
 
 void buildPOSIXstr(struct posix_tz_data_struct& posixData, String& result);
+size_t buildPOSIXstr(struct posix_tz_data_struct& posixData, char* buf, size_t bufSize);
+void buildPOSIXstr(struct posix_tz_data_struct& posixData, Print& result);
 void posixTZDataFromStr(String& posixTZstr); // parses POSIX tz str into its components updates static global posixTZ_Data
 void posixTZDataFromStr(String& posixTZstr, struct posix_tz_data_struct& posixData);
+void posixTZDataFromStr(const char* posixTZstr, size_t len, struct posix_tz_data_struct& posixData); // parses first len chars, '\0' not needed
 void buildPOSIXdescription(struct posix_tz_data_struct& posixData, String& result); // human readable description
+size_t buildPOSIXdescription(struct posix_tz_data_struct& posixData, char* buf, size_t bufSize);
+void buildPOSIXdescription(struct posix_tz_data_struct& posixData, Print& result);
+
+// Unix (UTC) times, in secs, of the DST start and end in year, returns false if no dst
+// for the southern hemisphere dstStartUtc is after dstEndUtc
+bool getDSTtransitionsUTC(const struct posix_tz_data_struct& posixData, int year, int64_t& dstStartUtc, int64_t& dstEndUtc);
+int32_t daysFromCivil(int year, unsigned int month, unsigned int day); // days since 1970-01-01, month 1 to 12
+void civilFromDays(int32_t days, int& year, unsigned int& month, unsigned int& day); // inverse of daysFromCivil
 
 void cleanUpPosixTZStr(char *tz_str, size_t tz_str_len); // tz_str_len is sizeof of tz_str storage, e.g.  cleanUpPosixTZStr(timeZoneConfig.tzStr,sizeof(timeZoneConfig.tzStr));
 void cleanUpPosixTZStr(String& posixTZstr);
+const char* ianaToPosixTZ(const char* ianaName); // e.g. "Australia/Sydney", returns NULL if not in tzIanaTable.h
 
 void testPosix(); // tests
 
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+   genIanaTZtable.py
+   Generates src/tzIanaTable.h, the IANA zone name to POSIX TZ string table
+   used by ianaToPosixTZ() in tzPosix.cpp
+   The POSIX string for each zone is the footer of its compiled TZif file.
+   Rerun when tzdata is updated, e.g.
+     python3 tools/genIanaTZtable.py
+     python3 tools/genIanaTZtable.py --zoneinfo /usr/share/zoneinfo --out src/tzIanaTable.h
+"""
+import argparse
+import os
+import sys
+
+MAX_POSIX_LEN = 49  # timeZoneConfig.tzStr[50] in ntpSupport.cpp
+EXTRA_ZONES = ["Etc/UTC", "UTC"]  # not in zone.tab
+
+
+def read_zone_names(zoneinfo):
+    names = set(EXTRA_ZONES)
+    with open(os.path.join(zoneinfo, "zone.tab"), encoding="utf-8") as f:
+        for line in f:
+            if line.startswith("#") or not line.strip():
+                continue
+            names.add(line.split("\t")[2].strip())
+    return names
+
+
+def read_posix_footer(path):
+    # TZif v2+ files end with \n<POSIX TZ string>\n
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(b"TZif") or data[4:5] < b"2" or not data.endswith(b"\n"):
+        return None
+    start = data.rfind(b"\n", 0, len(data) - 1)
+    if start < 0:
+        return None
+    return data[start + 1:-1].decode("ascii")
+
+
+def read_version(zoneinfo):
+    try:
+        with open(os.path.join(zoneinfo, "tzdata.zi"), encoding="utf-8") as f:
+            first = f.readline().split()
+            if len(first) == 3 and first[1] == "version":
+                return first[2]
+    except OSError:
+        pass
+    return "unknown"
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="Generate the IANA zone to POSIX TZ table")
+    parser.add_argument("--zoneinfo", default="/usr/share/zoneinfo")
+    parser.add_argument("--out", default=os.path.normpath(os.path.join(here, "..", "src", "tzIanaTable.h")))
+    args = parser.parse_args()
+
+    entries = []
+    for name in read_zone_names(args.zoneinfo):
+        posix = read_posix_footer(os.path.join(args.zoneinfo, name))
+        if not posix:
+            print("skipping %s, no POSIX footer" % name, file=sys.stderr)
+            continue
+        if len(posix) > MAX_POSIX_LEN:
+            print("skipping %s, %s is longer than %d" % (name, posix, MAX_POSIX_LEN), file=sys.stderr)
+            continue
+        entries.append((name, posix))
+    entries.sort(key=lambda e: e[0].encode("ascii"))  # same order as strcmp()
+
+    with open(args.out, "w", encoding="ascii", newline="\n") as out:
+        out.write("#ifndef TZ_IANA_TABLE_H\n#define TZ_IANA_TABLE_H\n")
+        out.write("// generated by tools/genIanaTZtable.py from tzdata %s, do not edit\n" % read_version(args.zoneinfo))
+        out.write("// sorted by name for binary search, const so it stays in flash\n\n")
+        out.write("struct tzIanaEntry_struct {\n  const char* name;\n  const char* posixTZ;\n};\n\n")
+        out.write("static constexpr struct tzIanaEntry_struct tzIanaTable[] = {\n")
+        for name, posix in entries:
+            out.write('  {"%s", "%s"},\n' % (name, posix))
+        out.write("};\n\n")
+        out.write("static constexpr size_t TZ_IANA_TABLE_SIZE = sizeof(tzIanaTable) / sizeof(tzIanaTable[0]);\n\n")
+        out.write("#endif\n")
+    print("wrote %d zones to %s" % (len(entries), args.out))
+
+
+if __name__ == "__main__":
+    main()
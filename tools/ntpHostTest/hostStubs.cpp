@@ -0,0 +1,209 @@
+/*
+   hostStubs.cpp
+   The simulated clock, in memory LittleFS, DNS and the other stand ins declared in stubs/, see run.sh
+*/
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <lwip/dns.h>
+
+// ------------- simulated clock -----------------
+static int64_t monotonic_us = 1000000; // 1sec after boot, setup() has started
+static int64_t epochAtZero_us = 0; // system clock is 1970 at power up, like the ESP32 without a backup RTC
+
+void hostAdvance_us(int64_t us) {
+  monotonic_us += us;
+}
+
+int64_t hostGetMonotonic_us() {
+  return monotonic_us;
+}
+
+void hostSetSystemClock_us(int64_t epoch_us) {
+  epochAtZero_us = epoch_us - monotonic_us;
+}
+
+int64_t hostGetSystemClock_us() {
+  return monotonic_us + epochAtZero_us;
+}
+
+extern "C" int hostGettimeofday(struct timeval* tv, void* tz) noexcept {
+  (void)tz;
+  int64_t now_us = hostGetSystemClock_us();
+  tv->tv_sec = (time_t)(now_us / 1000000);
+  tv->tv_usec = (suseconds_t)(now_us % 1000000);
+  return 0;
+}
+
+extern "C" int hostSettimeofday(const struct timeval* tv, const struct timezone* tz) noexcept {
+  (void)tz;
+  hostSetSystemClock_us((int64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+  return 0;
+}
+
+extern "C" time_t hostTime(time_t* t) noexcept {
+  time_t now = (time_t)(hostGetSystemClock_us() / 1000000);
+  if (t) {
+    *t = now;
+  }
+  return now;
+}
+
+unsigned long millis() {
+  return (unsigned long)(monotonic_us / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)monotonic_us;
+}
+
+bool getLocalTime(struct tm* info, uint32_t ms) {
+  (void)ms;
+  time_t now = hostTime(NULL);
+  localtime_r(&now, info);
+  return (info->tm_year > (2016 - 1900));
+}
+
+EspClass ESP;
+WiFiClass WiFi;
+
+// ------------- DNS -----------------
+uint32_t hostDnsAddress = 0x0101a8c0; // 192.168.1.1
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg) {
+  (void)hostname;
+  (void)found;
+  (void)callback_arg;
+  addr->addr = hostDnsAddress;
+  return ERR_OK;
+}
+
+// ------------- in memory LittleFS -----------------
+HostFS LittleFS;
+
+static std::string parentDir(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return (slash == 0 || slash == std::string::npos) ? "/" : path.substr(0, slash);
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+  if (!fileData) {
+    return 0;
+  }
+  std::vector<uint8_t>& data = fileData->data;
+  if ((pos + size) > data.size()) {
+    data.resize(pos + size);
+  }
+  memcpy(data.data() + pos, buf, size);
+  pos += size;
+  return size;
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+  if (!fileData) {
+    return 0;
+  }
+  size_t n = fileData->data.size() - pos;
+  if (n > size) {
+    n = size;
+  }
+  memcpy(buf, fileData->data.data() + pos, n);
+  pos += n;
+  return n;
+}
+
+const char* File::name() const {
+  size_t slash = filePath.rfind('/');
+  return filePath.c_str() + ((slash == std::string::npos) ? 0 : slash + 1);
+}
+
+File File::openNextFile() {
+  if ((!isDir) || (nextChild >= children.size())) {
+    return File();
+  }
+  return LittleFS.open(children[nextChild++].c_str(), "r");
+}
+
+File HostFS::open(const char* path, const char* mode) {
+  File f;
+  std::string p(path);
+  if ((p.size() > 1) && (p.back() == '/')) {
+    p.pop_back();
+  }
+  if ((p == "/") || dirs.count(p)) {
+    f.filePath = p;
+    f.isDir = true;
+    std::string prefix = (p == "/") ? "/" : p + "/";
+    for (const auto& entry : files) {
+      if ((entry.first.compare(0, prefix.size(), prefix) == 0) && (entry.first.find('/', prefix.size()) == std::string::npos)) {
+        f.children.push_back(entry.first);
+      }
+    }
+    for (const std::string& dir : dirs) {
+      if ((dir.compare(0, prefix.size(), prefix) == 0) && (dir.find('/', prefix.size()) == std::string::npos)) {
+        f.children.push_back(dir);
+      }
+    }
+    return f;
+  }
+  auto it = files.find(p);
+  if (mode[0] == 'r') {
+    if (it == files.end()) {
+      return f;
+    }
+    f.fileData = it->second;
+  } else {
+    std::string parent = parentDir(p);
+    if ((parent != "/") && (!dirs.count(parent))) {
+      return f; // no such dir
+    }
+    if ((it == files.end()) || (mode[0] == 'w')) {
+      files[p] = std::make_shared<hostFileData_struct>(); // "w" truncates, open handles keep the old data
+    }
+    f.fileData = files[p];
+    if (mode[0] == 'a') {
+      f.pos = f.fileData->data.size();
+    }
+  }
+  f.filePath = p;
+  return f;
+}
+
+bool HostFS::exists(const char* path) {
+  std::string p(path);
+  return (p == "/") || files.count(p) || dirs.count(p);
+}
+
+bool HostFS::remove(const char* path) {
+  return files.erase(path) > 0;
+}
+
+bool HostFS::rename(const char* pathFrom, const char* pathTo) {
+  auto it = files.find(pathFrom);
+  if (it == files.end()) {
+    return false;
+  }
+  std::shared_ptr<hostFileData_struct> data = it->second;
+  files.erase(it);
+  files[pathTo] = data; // replaces any existing file, as LittleFS does
+  return true;
+}
+
+bool HostFS::mkdir(const char* path) {
+  std::string p(path);
+  if (exists(path)) {
+    return false;
+  }
+  dirs.insert(p);
+  return true;
+}
+
+bool HostFS::rmdir(const char* path) {
+  return dirs.erase(path) > 0;
+}
+
+void HostFS::clear() {
+  files.clear();
+  dirs.clear();
+}
@@ -0,0 +1,134 @@
+/*
+   ntpHostTest.cpp
+   Host (PC) tests for src/ntpSupport.cpp, the real file compiled against the stand ins in stubs/, built and run by tools/ntpHostTest/run.sh
+     run.sh          getCurrentTZdescription() from the TZ cache compared with the original String code path, exits 1 on any failure
+     run.sh bench    getCurrentTZdescription() time and heap allocations per call, original code path vs the TZ cache
+   The clock is simulated, see stubs/Arduino.h, the PC's clock is never read or set by the code under test
+*/
+#include <Arduino.h>
+#include <new>
+#include "../../src/ntpSupport.h"
+#include "../../src/tzPosix.h"
+#include "../../src/tzIanaTable.h"
+
+namespace baseline {
+void getTZDescription(String& posixTZstr, String& result);
+}
+
+// count heap allocations, String copies included
+static size_t allocations = 0;
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void* p) noexcept {
+  free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static unsigned int failures = 0;
+
+static void fail(const char* what, const char* input, const char* detail) {
+  if (failures < 50) {
+    printf("FAIL %s \"%s\" %s\n", what, input, detail ? detail : "");
+  }
+  failures++;
+}
+
+// getCurrentTZdescription() as it was before the TZ cache, parsed the TZ env into Strings on every call
+static String originalGetCurrentTZdescription() {
+  char* tz_str = getenv("TZ");
+  String tzStr(tz_str);
+  String result;
+  baseline::getTZDescription(tzStr, result);
+  return result;
+}
+
+// ------------- TZ cache -----------------
+// the original kept rule hours in a uint8_t, so -ve hours and hours > 30 were wrong, and its tzname == "UTC" compared pointers
+// so UTC was described as GMT+00, the new description is expected to differ for these
+static bool isExpectedDifference(const char* posixTZ) {
+  struct posix_tz_data_struct posixData;
+  posixTZDataFromStr(posixTZ, strlen(posixTZ), posixData);
+  return (strcmp(posixData.tzname, "UTC") == 0) || (posixData.start_time_hr < 0) || (posixData.start_time_hr > 30)
+         || (posixData.end_time_hr < 0) || (posixData.end_time_hr > 30);
+}
+
+static void testTZdescription() {
+  unsigned int same = 0;
+  unsigned int expectedDiffs = 0;
+  for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+    setTZfromPOSIXstr(tzIanaTable[i].posixTZ); // setTZ() builds the cache
+    String cached = getCurrentTZdescription();
+    String original = originalGetCurrentTZdescription();
+    if (cached == original) {
+      same++;
+    } else if (isExpectedDifference(tzIanaTable[i].posixTZ)) {
+      expectedDiffs++;
+    } else {
+      fail("getCurrentTZdescription() differs from the original", tzIanaTable[i].name, cached.c_str());
+    }
+    if (getCurrentTZ() != tzIanaTable[i].posixTZ) {
+      fail("getCurrentTZ()", tzIanaTable[i].name, getCurrentTZ().c_str());
+    }
+  }
+  printf("getCurrentTZdescription() same as the original for %u tzdata zones, %u expected differences (UTC, rule hours < 0 or > 30)\n",
+         same, expectedDiffs);
+}
+
+// ------------- benchmarks -----------------
+static int64_t benchNow_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static volatile int sink; // stop the compiler removing the work
+
+static void benchTZdescription() {
+  const size_t calls = 200000;
+  setTZfromPOSIXstr("AEST-10AEDT,M10.1.0,M4.1.0/3");
+
+  size_t allocationsBefore = allocations;
+  int64_t start_ns = benchNow_ns();
+  for (size_t i = 0; i < calls; i++) {
+    String description = originalGetCurrentTZdescription();
+    sink = description[0];
+  }
+  double originalNs = (double)(benchNow_ns() - start_ns) / calls;
+  double originalAllocs = (double)(allocations - allocationsBefore) / calls;
+
+  allocationsBefore = allocations;
+  start_ns = benchNow_ns();
+  for (size_t i = 0; i < calls; i++) {
+    String description = getCurrentTZdescription();
+    sink = description[0];
+  }
+  double cachedNs = (double)(benchNow_ns() - start_ns) / calls;
+  double cachedAllocs = (double)(allocations - allocationsBefore) / calls;
+
+  printf("getCurrentTZdescription() x %zu, \"%s\"\n", calls, getCurrentTZ().c_str());
+  printf("  original, getenv() and String parse each call  %6.0f ns/call  %5.2f heap allocations/call\n", originalNs, originalAllocs);
+  printf("  now, copy of the TZ cache                      %6.0f ns/call  %5.2f heap allocations/call  %.1fx faster\n",
+         cachedNs, cachedAllocs, originalNs / cachedNs);
+  printf("  the one allocation left is the returned String, the description is longer than String's inline buffer\n");
+  printf("  tzTableMux is a no-op on the PC, on the ESP32 add the cost of one portENTER_CRITICAL/portEXIT_CRITICAL pair\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char* mode = (argc > 1) ? argv[1] : "test";
+  if (strcmp(mode, "bench") == 0) {
+    printf("PC timings, only the before/after ratios carry over to the ESP32\n");
+    benchTZdescription();
+    return 0;
+  }
+  testTZdescription();
+  printf(failures ? "%u failures\n" : "all passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# tools/ntpHostTest/run.sh  builds and runs the host tests for src/ntpSupport.cpp, see ntpHostTest.cpp
+#   tools/ntpHostTest/run.sh [bench]
+# needs g++ and glibc, run from anywhere
+set -e
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC="$DIR/../../src"
+OUT="${TMPDIR:-/tmp}/ntpHostTest"
+mkdir -p "$OUT"
+SOURCES="$SRC/ntpSupport.cpp $SRC/tzPosix.cpp $SRC/configStore.cpp $SRC/LittleFSsupport.cpp
+  $DIR/../tzHostTest/tzPosixBaseline.cpp $DIR/hostStubs.cpp $DIR/ntpHostTest.cpp"
+# the system clock calls go to the simulated clock in hostStubs.cpp
+CLOCK="-Dgettimeofday=hostGettimeofday -Dsettimeofday=hostSettimeofday -Dtime=hostTime"
+FLAGS="-std=c++17 $CLOCK -I$DIR/stubs -I$DIR/../tzHostTest/stubs -I$SRC"
+
+if [ "$1" = "bench" ]; then
+  g++ $FLAGS -O2 -DNDEBUG $SOURCES -o "$OUT/ntpHostBench"
+  exec "$OUT/ntpHostBench" bench
+fi
+g++ $FLAGS -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all $SOURCES -o "$OUT/ntpHostTest"
+exec "$OUT/ntpHostTest" "$@"
@@ -0,0 +1,88 @@
+#ifndef _NTP_HOST_ARDUINO_H
+#define _NTP_HOST_ARDUINO_H
+/*
+   Arduino.h
+   The tools/tzHostTest Arduino core stand in plus the clock, FreeRTOS and ESP parts src/ntpSupport.cpp and the registry code use
+   The clock is simulated, see hostStubs.cpp, so the tests never read or set the PC's clock
+*/
+#include "../../tzHostTest/stubs/Arduino.h"
+#include <functional>
+#include <sys/time.h>
+#include <time.h>
+
+// ------------- simulated clock -----------------
+// hostMonotonic_us is esp_timer_get_time(), only moved by hostAdvance_us()
+// the system clock, gettimeofday()/settimeofday()/time(), is hostMonotonic_us + hostEpochAtZero_us
+// run.sh compiles with gettimeofday, settimeofday and time defined as hostGettimeofday etc., implemented in hostStubs.cpp
+void hostAdvance_us(int64_t us);
+void hostSetSystemClock_us(int64_t epoch_us); // as if the RTC had kept this time, e.g. across ESP.restart()
+int64_t hostGetSystemClock_us();
+int64_t hostGetMonotonic_us();
+unsigned long millis();
+unsigned long micros();
+inline void delay(unsigned long) {}
+
+// ------------- FreeRTOS -----------------
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+typedef void* TaskHandle_t;
+struct hostSemaphore_struct {
+  bool taken;
+};
+typedef struct hostSemaphore_struct* SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new hostSemaphore_struct{false};
+}
+// single threaded, a taken mutex times out straight away
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t) {
+  if (sem->taken) {
+    return pdFALSE;
+  }
+  sem->taken = true;
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  sem->taken = false;
+  return pdTRUE;
+}
+
+// ------------- ESP -----------------
+class EspClass {
+  public:
+    void restart() {
+      printf("ESP.restart() called\n");
+      exit(1);
+    }
+};
+extern EspClass ESP;
+
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+class IPAddress {
+  public:
+    IPAddress() : addr(0) {}
+    IPAddress(uint32_t a) : addr(a) {} // network order, as lwIP stores it
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    operator uint32_t() const {
+      return addr;
+    }
+    String toString() const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr & 0xff, (addr >> 8) & 0xff, (addr >> 16) & 0xff, addr >> 24);
+      return String(buf);
+    }
+  private:
+    uint32_t addr;
+};
+
+#endif
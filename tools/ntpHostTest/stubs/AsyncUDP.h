@@ -0,0 +1,69 @@
+#ifndef _NTP_HOST_ASYNC_UDP_H
+#define _NTP_HOST_ASYNC_UDP_H
+/*
+   AsyncUDP.h
+   Packets sent are kept in lastSent for the tests, which deliver replies with receive()
+*/
+#include <Arduino.h>
+#include <vector>
+
+class AsyncUDPPacket {
+  public:
+    AsyncUDPPacket(const uint8_t* _data, size_t _len) : pData(_data), len(_len) {}
+    const uint8_t* data() {
+      return pData;
+    }
+    size_t length() {
+      return len;
+    }
+    size_t write(const uint8_t* buf, size_t size) {
+      written.assign(buf, buf + size);
+      return size;
+    }
+    std::vector<uint8_t> written;
+  private:
+    const uint8_t* pData;
+    size_t len;
+};
+
+typedef std::function<void(AsyncUDPPacket& packet)> AuPacketHandlerFunction;
+
+class AsyncUDP {
+  public:
+    bool listen(uint16_t _port) {
+      port = _port;
+      listening = true;
+      return true;
+    }
+    void onPacket(AuPacketHandlerFunction fn) {
+      handler = fn;
+    }
+    void close() {
+      listening = false;
+    }
+    size_t writeTo(const uint8_t* data, size_t len, const IPAddress& addr, uint16_t toPort) {
+      lastSent.assign(data, data + len);
+      lastSentTo = addr;
+      lastSentPort = toPort;
+      sentCount++;
+      return len;
+    }
+    // deliver a packet as lwIP would, returns what the handler wrote back
+    std::vector<uint8_t> receive(const uint8_t* data, size_t len) {
+      AsyncUDPPacket packet(data, len);
+      if (listening && handler) {
+        handler(packet);
+      }
+      return packet.written;
+    }
+    std::vector<uint8_t> lastSent;
+    IPAddress lastSentTo;
+    uint16_t lastSentPort = 0;
+    unsigned int sentCount = 0;
+    uint16_t port = 0;
+    bool listening = false;
+  private:
+    AuPacketHandlerFunction handler;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _NTP_HOST_FS_H
+#define _NTP_HOST_FS_H
+/*
+   FS.h
+   In memory file system with the File and LittleFS calls the sketch's modules use, see hostStubs.cpp
+   Paths are absolute, directories must be made with mkdir(), open() for "w" or "a" creates the file
+*/
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+struct hostFileData_struct {
+  std::vector<uint8_t> data;
+};
+
+class File : public Stream {
+  public:
+    File() {}
+    operator bool() const {
+      return isDir || (bool)fileData;
+    }
+    size_t write(uint8_t c) override {
+      return write(&c, 1);
+    }
+    size_t write(const uint8_t* buf, size_t size) override;
+    using Print::write;
+    size_t read(uint8_t* buf, size_t size);
+    int read() {
+      uint8_t c;
+      return (read(&c, 1) == 1) ? c : -1;
+    }
+    int available() {
+      return fileData ? (int)(fileData->data.size() - pos) : 0;
+    }
+    bool seek(uint32_t _pos) {
+      if ((!fileData) || (_pos > fileData->data.size())) {
+        return false;
+      }
+      pos = _pos;
+      return true;
+    }
+    size_t position() const {
+      return pos;
+    }
+    size_t size() const {
+      return fileData ? fileData->data.size() : 0;
+    }
+    void close() {
+      fileData.reset();
+      isDir = false;
+    }
+    void flush() {}
+    bool isDirectory() const {
+      return isDir;
+    }
+    const char* name() const; // file name only, as ESP32 core 2.x returns
+    const char* path() const {
+      return filePath.c_str();
+    }
+    File openNextFile();
+
+    // used by hostStubs.cpp
+    std::string filePath;
+    std::shared_ptr<hostFileData_struct> fileData;
+    bool isDir = false;
+    size_t pos = 0;
+    std::vector<std::string> children; // directory listing taken when opened
+    size_t nextChild = 0;
+};
+
+class HostFS {
+  public:
+    bool begin(bool formatOnFail = false) {
+      (void)formatOnFail;
+      return true;
+    }
+    File open(const char* path, const char* mode = "r");
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* pathFrom, const char* pathTo);
+    bool mkdir(const char* path);
+    bool rmdir(const char* path);
+    void clear(); // format
+    // the tests read and damage files directly
+    std::map<std::string, std::shared_ptr<hostFileData_struct>> files;
+    std::set<std::string> dirs;
+};
+
+typedef HostFS FS;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _NTP_HOST_IPADDRESS_H
+#define _NTP_HOST_IPADDRESS_H
+/*
+   IPAddress.h
+   IPAddress is in the Arduino.h stand in
+*/
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _NTP_HOST_LITTLE_FS_H
+#define _NTP_HOST_LITTLE_FS_H
+/*
+   LittleFS.h
+*/
+#include "FS.h"
+
+extern HostFS LittleFS;
+
+#endif
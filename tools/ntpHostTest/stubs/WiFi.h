@@ -0,0 +1,18 @@
+#ifndef _NTP_HOST_WIFI_H
+#define _NTP_HOST_WIFI_H
+/*
+   WiFi.h
+   Just WiFi.isConnected(), set by the tests
+*/
+#include <Arduino.h>
+
+class WiFiClass {
+  public:
+    bool isConnected() {
+      return connected;
+    }
+    bool connected = true;
+};
+extern WiFiClass WiFi;
+
+#endif
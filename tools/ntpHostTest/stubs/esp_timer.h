@@ -0,0 +1,13 @@
+#ifndef _NTP_HOST_ESP_TIMER_H
+#define _NTP_HOST_ESP_TIMER_H
+/*
+   esp_timer.h
+   esp_timer_get_time() on the simulated clock, see Arduino.h
+*/
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() {
+  return hostGetMonotonic_us();
+}
+
+#endif
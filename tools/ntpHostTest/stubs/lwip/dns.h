@@ -0,0 +1,26 @@
+#ifndef _NTP_HOST_LWIP_DNS_H
+#define _NTP_HOST_LWIP_DNS_H
+/*
+   lwip/dns.h
+   Every name resolves straight away to hostDnsAddress, see hostStubs.cpp
+*/
+#include <stdint.h>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+struct ip4_addr {
+  uint32_t addr;
+};
+typedef struct ip4_addr ip4_addr_t;
+typedef struct ip4_addr ip_addr_t;
+#define IP_IS_V4(ipaddr) (1)
+#define ip_2_ip4(ipaddr) (ipaddr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg);
+extern uint32_t hostDnsAddress; // network order
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _NTP_HOST_LWIP_TCPIP_H
+#define _NTP_HOST_LWIP_TCPIP_H
+/*
+   lwip/tcpip.h
+   tcpip_callback() runs the function straight away
+*/
+#include "dns.h"
+
+typedef void (*tcpip_callback_fn)(void* ctx);
+inline err_t tcpip_callback(tcpip_callback_fn function, void* ctx) {
+  function(ctx);
+  return ERR_OK;
+}
+
+#endif
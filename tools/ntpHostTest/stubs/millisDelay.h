@@ -0,0 +1,42 @@
+#ifndef _NTP_HOST_MILLIS_DELAY_H
+#define _NTP_HOST_MILLIS_DELAY_H
+/*
+   millisDelay.h
+   The parts of the millisDelay library the sketch's modules use, on the simulated millis()
+*/
+#include <Arduino.h>
+
+class millisDelay {
+  public:
+    void start(unsigned long delay) {
+      ms_delay = delay;
+      startTime = millis();
+      running = true;
+      finishNow = false;
+    }
+    void stop() {
+      running = false;
+      finishNow = false;
+    }
+    bool isRunning() {
+      return running;
+    }
+    bool justFinished() {
+      if (running && (finishNow || ((millis() - startTime) >= ms_delay))) {
+        running = false;
+        finishNow = false;
+        return true;
+      }
+      return false;
+    }
+    void finish() {
+      finishNow = true;
+    }
+  private:
+    unsigned long ms_delay = 0;
+    unsigned long startTime = 0;
+    bool running = false;
+    bool finishNow = false;
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*
+   registryHostTest.cpp
+   Host (PC) tests for src/registrySnapshot.cpp with src/sightingLog.cpp, the real files compiled against the tools/ntpHostTest stand ins,
+   built and run by tools/registryHostTest/run.sh
+     run.sh          restore at power up with the clock in 1970, clock steps, snapshot, the restored devices must keep their Unix times
+     run.sh bench    restore of a REGISTRY_SNAPSHOT_MAX_ENTRIES snapshot plus the sighting log since it,
+                     time and name compares, one lookup per record (as before) vs snapshot records added without a lookup
+   The clock is simulated, see ../ntpHostTest/stubs/Arduino.h, the PC's clock is never read or set by the code under test
+   Each mode is a fresh process, the modules' static state is that of one boot, a power cycle is simulated by a new list and a setTime()
+*/
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include "../../src/ntpSupport.h"
+#include "../../src/registrySnapshot.h"
+#include "../../src/sightingLog.h"
+#include "../../src/LittleFSsupport.h"
+
+static unsigned int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) {
+    failures++;
+  }
+}
+
+static SemaphoreHandle_t mutex = NULL; // as the sketch's registryMutex
+
+static const int64_t T0_ms = 1767225600000LL; // 2026/01/01 00:00:00 UTC
+
+static int64_t nowEpoch_ms() {
+  return hostGetSystemClock_us() / 1000;
+}
+
+static void advance_ms(int64_t ms) {
+  hostAdvance_us(ms * 1000);
+}
+
+// as the sketch's processAdvert(), the device is found or added and the sighting logged
+static void seeDevice(pfodLinkedPointerList<LastSeen>& list, const char* advertisedName) {
+  cSF(sfName, 50);
+  sfName = advertisedName;
+  LastSeen* devicePtr = findOrAddLastSeen(list, sfName);
+  int64_t now_ms = getMonotonic_ms();
+  devicePtr->updateLastSeen(now_ms);
+  devicePtr->setAdvertisedName(advertisedName);
+  devicePtr->setLastLogged(now_ms);
+  logSighting(monotonicToEpoch_ms(now_ms), advertisedName);
+}
+
+static LastSeen* getDevice(pfodLinkedPointerList<LastSeen>& list, const char* deviceName) {
+  for (LastSeen* devicePtr = list.getFirst(); devicePtr; devicePtr = list.getNext()) {
+    if (strcmp(devicePtr->getDeviceName(), deviceName) == 0) {
+      return devicePtr;
+    }
+  }
+  return NULL;
+}
+
+// Unix time the device was last seen, as handleRoot() shows it
+static int64_t lastSeenEpoch(pfodLinkedPointerList<LastSeen>& list, const char* deviceName) {
+  LastSeen* devicePtr = getDevice(list, deviceName);
+  return devicePtr ? monotonicToEpoch_ms(devicePtr->getLastSeen()) : -1;
+}
+
+static std::map<std::string, int64_t> loadedSnapshot;
+
+static void collectSnapshotRecord(int64_t epoch_ms, const char* advertisedName) {
+  loadedSnapshot[advertisedName] = epoch_ms;
+}
+
+static void checkTime(int64_t got_ms, int64_t expected_ms, const char* what) {
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%s, %lld ms from expected", what, (long long)(got_ms - expected_ms));
+  check(got_ms == expected_ms, msg);
+}
+
+// ------------- restore then clock steps -----------------
+static void testRestoreClockStep() {
+  mutex = xSemaphoreCreateMutex();
+  initializeFS();
+  initializeSightingLog();
+
+  // first boot, clock set by NTP
+  pfodLinkedPointerList<LastSeen> before;
+  setTime((long)(T0_ms / 1000), 0);
+  advance_ms(10000);
+  seeDevice(before, "devA,1");
+  int64_t seenA_ms = nowEpoch_ms();
+  advance_ms(10000);
+  seeDevice(before, "devB,1");
+  int64_t seenB_ms = nowEpoch_ms();
+  flushSightingLog();
+  advance_ms(10000);
+  check(saveRegistrySnapshot(before, mutex, 0), "first boot snapshot saved");
+  advance_ms(10000);
+  seeDevice(before, "devC,1");
+  int64_t seenC_ms = nowEpoch_ms();
+  advance_ms(10000);
+  seeDevice(before, "devA,2"); // after the snapshot, replayed from the log
+  seenA_ms = nowEpoch_ms();
+  flushSightingLog();
+
+  // power cycle, no RTC so the clock restarts in 1970
+  advance_ms(3600000); // powered off for an hour
+  setTime(100, 0);
+  pfodLinkedPointerList<LastSeen> list;
+  size_t restored = restoreRegistry(list);
+  check((restored == 4) && (list.size() == 3), "4 sightings restored, 2 from the snapshot and 2 from the log, as 3 devices");
+  checkTime(nowEpoch_ms(), seenA_ms, "clock started from the newest record");
+  checkTime(lastSeenEpoch(list, "devA,"), seenA_ms, "devA restored");
+  checkTime(lastSeenEpoch(list, "devB,"), seenB_ms, "devB restored");
+  checkTime(lastSeenEpoch(list, "devC,"), seenC_ms, "devC restored");
+
+  // seen again after the restore, before NTP, these times are from the running clock and move with it
+  advance_ms(5000);
+  seeDevice(list, "devB,2");
+  seeDevice(list, "devD,1");
+  int64_t seenAfterRestore_ms = getMonotonic_ms();
+
+  // the config file's saved utcTime, then the first NTP update, each step the clock
+  int64_t configStep_ms = 60000;
+  setTime((long)((nowEpoch_ms() + configStep_ms) / 1000), (int)((nowEpoch_ms() + configStep_ms) % 1000) * 1000);
+  processRegistryRestore(list, mutex);
+  checkTime(lastSeenEpoch(list, "devA,"), seenA_ms, "devA unchanged by the config utcTime step");
+  advance_ms(1000);
+  int64_t realNow_ms = seenA_ms + 3600000 + 6000;
+  setTime((long)(realNow_ms / 1000), (int)(realNow_ms % 1000) * 1000);
+  processRegistryRestore(list, mutex);
+  checkTime(lastSeenEpoch(list, "devA,"), seenA_ms, "devA unchanged by the NTP step");
+  checkTime(lastSeenEpoch(list, "devC,"), seenC_ms, "devC unchanged by the NTP step");
+  int64_t seenAfterRestoreEpoch_ms = monotonicToEpoch_ms(seenAfterRestore_ms);
+  checkTime(lastSeenEpoch(list, "devB,"), seenAfterRestoreEpoch_ms, "devB seen after the restore moves with the clock");
+  checkTime(lastSeenEpoch(list, "devD,"), seenAfterRestoreEpoch_ms, "devD seen after the restore moves with the clock");
+  checkTime(seenAfterRestoreEpoch_ms, realNow_ms - 1000, "devB and devD at the NTP time they were seen");
+
+  // a later step, without processRegistryRestore() first, the save moves the restored devices itself
+  advance_ms(1000);
+  realNow_ms += 1000 + 250;
+  setTime((long)(realNow_ms / 1000), (int)(realNow_ms % 1000) * 1000);
+  check(saveRegistrySnapshot(list, mutex, 0), "snapshot after the NTP steps saved");
+  loadedSnapshot.clear();
+  check(loadRegistrySnapshot(collectSnapshotRecord) == 4, "snapshot has 4 devices");
+  checkTime(loadedSnapshot["devA,2"], seenA_ms, "devA snapshot record");
+  checkTime(loadedSnapshot["devB,2"], seenAfterRestoreEpoch_ms + 250, "devB snapshot record");
+  checkTime(loadedSnapshot["devC,1"], seenC_ms, "devC snapshot record");
+  checkTime(loadedSnapshot["devD,1"], seenAfterRestoreEpoch_ms + 250, "devD snapshot record");
+}
+
+// ------------- benchmarks -----------------
+static int64_t benchNow_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static pfodLinkedPointerList<LastSeen>* originalListPtr = NULL;
+
+// the sketch's replaySighting() before the snapshot records were added without a lookup, used for both the snapshot and the log
+static void originalReplaySighting(int64_t epoch_ms, const char* advertisedName) {
+  cSF(sfName, 50); // max 32
+  sfName = advertisedName;
+  LastSeen *devicePtr = findOrAddLastSeen(*originalListPtr, sfName);
+  int64_t monotonic_ms = epochToMonotonic_ms(epoch_ms);
+  if ((devicePtr->getLastLogged() == 0) || (monotonic_ms >= devicePtr->getLastSeen())) {
+    devicePtr->updateLastSeen(monotonic_ms);
+    devicePtr->setLastLogged(monotonic_ms);
+    devicePtr->setAdvertisedName(advertisedName);
+  }
+}
+
+static void benchRestore() {
+  const size_t devices = REGISTRY_SNAPSHOT_MAX_ENTRIES;
+  const size_t logRecordsSince = 2 * devices; // each device logged every 5mins, snapshot every 10mins
+  const int runs = 20;
+  mutex = xSemaphoreCreateMutex();
+  initializeFS();
+  initializeSightingLog();
+  setTime((long)(T0_ms / 1000), 0);
+  pfodLinkedPointerList<LastSeen> before;
+  char name[SIGHTING_LOG_NAME_SIZE];
+  for (size_t i = 0; i < devices; i++) {
+    snprintf(name, sizeof(name), "device%04zu,0", i);
+    seeDevice(before, name);
+    advance_ms(100);
+    if (((i + 1) % (SIGHTING_LOG_STAGING_SIZE / 2)) == 0) {
+      flushSightingLog();
+    }
+  }
+  flushSightingLog();
+  saveRegistrySnapshot(before, mutex, 0);
+  for (size_t i = 0; i < logRecordsSince; i++) {
+    snprintf(name, sizeof(name), "device%04zu,%zu", i % devices, 1 + (i / devices));
+    seeDevice(before, name);
+    advance_ms(100);
+    if (((i + 1) % (SIGHTING_LOG_STAGING_SIZE / 2)) == 0) {
+      flushSightingLog();
+    }
+  }
+  flushSightingLog();
+  int64_t snapshot_ms = getRegistrySnapshotTime();
+
+  size_t comparesBefore = hostSafeStringCompares;
+  int64_t start_ns = benchNow_ns();
+  size_t originalSnapshotRecords = 0;
+  for (int run = 0; run < runs; run++) {
+    pfodLinkedPointerList<LastSeen> list;
+    originalListPtr = &list;
+    originalSnapshotRecords = loadRegistrySnapshot(originalReplaySighting);
+    replaySightingLog(originalReplaySighting, snapshot_ms);
+  }
+  double originalUs = (double)(benchNow_ns() - start_ns) / runs / 1000;
+  double originalCompares = (double)(hostSafeStringCompares - comparesBefore) / runs;
+
+  comparesBefore = hostSafeStringCompares;
+  start_ns = benchNow_ns();
+  size_t restored = 0;
+  for (int run = 0; run < runs; run++) {
+    pfodLinkedPointerList<LastSeen> list;
+    restored = restoreRegistry(list);
+  }
+  double nowUs = (double)(benchNow_ns() - start_ns) / runs / 1000;
+  double nowCompares = (double)(hostSafeStringCompares - comparesBefore) / runs;
+
+  comparesBefore = hostSafeStringCompares;
+  start_ns = benchNow_ns();
+  for (int run = 0; run < runs; run++) {
+    pfodLinkedPointerList<LastSeen> list;
+    originalListPtr = &list;
+    loadRegistrySnapshot(originalReplaySighting);
+  }
+  double originalSnapshotUs = (double)(benchNow_ns() - start_ns) / runs / 1000;
+  double originalSnapshotCompares = (double)(hostSafeStringCompares - comparesBefore) / runs;
+
+  printf("restore of a %zu device snapshot plus %zu log records since it, %zu records restored\n",
+         originalSnapshotRecords, logRecordsSince, restored);
+  printf("  before, lookup per record   %8.0f us  %8.0f name compares  (snapshot alone %6.0f us, %6.0f compares)\n",
+         originalUs, originalCompares, originalSnapshotUs, originalSnapshotCompares);
+  printf("  now, snapshot without lookup %7.0f us  %8.0f name compares  %.1fx faster\n", nowUs, nowCompares, originalUs / nowUs);
+  printf("  the log replay still looks each record up, its compares are the ones left\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char* mode = (argc > 1) ? argv[1] : "test";
+  if (strcmp(mode, "bench") == 0) {
+    printf("PC timings, scale the compare counts by the ESP32's time per startsWith()\n");
+    benchRestore();
+    return 0;
+  }
+  testRestoreClockStep();
+  printf(failures ? "%u failures\n" : "all passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+# tools/registryHostTest/run.sh  builds and runs the host tests for src/registrySnapshot.cpp, see registryHostTest.cpp
+#   tools/registryHostTest/run.sh [bench]
+# needs g++ and glibc, run from anywhere
+set -e
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC="$DIR/../../src"
+NTP="$DIR/../ntpHostTest"
+OUT="${TMPDIR:-/tmp}/registryHostTest"
+mkdir -p "$OUT"
+SOURCES="$SRC/registrySnapshot.cpp $SRC/sightingLog.cpp $SRC/LastSeen.cpp $SRC/ntpSupport.cpp $SRC/tzPosix.cpp
+  $SRC/configStore.cpp $SRC/LittleFSsupport.cpp $NTP/hostStubs.cpp $DIR/registryHostTest.cpp"
+# the system clock calls go to the simulated clock in ../ntpHostTest/hostStubs.cpp
+CLOCK="-Dgettimeofday=hostGettimeofday -Dsettimeofday=hostSettimeofday -Dtime=hostTime"
+FLAGS="-std=c++17 $CLOCK -I$NTP/stubs -I$DIR/../tzHostTest/stubs -I$SRC"
+
+if [ "$1" = "bench" ]; then
+  g++ $FLAGS -O2 -DNDEBUG $SOURCES -o "$OUT/registryHostBench"
+  exec "$OUT/registryHostBench" bench
+fi
+g++ $FLAGS -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all $SOURCES -o "$OUT/registryHostTest"
+exec "$OUT/registryHostTest" "$@"
@@ -0,0 +1,269 @@
+/*
+   rmtHostTest.c
+   Host (PC) tests for the WS2812 RMT code in src/ESP_RMT_Peripheral.c, against the simulated driver in rmtSim.c
+     tools/rmtHostTest/run.sh          the RMT items match the original bit by bit translator for every byte value,
+                                       the channel stays installed between shows, newest frame wins, the latch time is kept,
+                                       espShowRelease() leaves no timer or transmit running, exits 1 on any failure
+     tools/rmtHostTest/run.sh bench    translator speed, nibble table vs the original bit loop, and driver calls per show
+   The driver install/uninstall cost saved by keeping the channel installed can only be timed on the ESP32
+*/
+#include <stdio.h>
+#include <time.h>
+#include <Arduino.h>
+#include "rmtSim.h"
+
+// from ESP_RMT_Peripheral.c
+void espShow(uint8_t pin, uint8_t *pixels, uint32_t numBytes, boolean is800KHz);
+bool espShowBusy(void);
+void espShowRelease(void);
+
+#define LATCH_US 300 // WS2812_LATCH_US
+#define MAX_BYTES (3 * 256) // WS2812_MAX_BYTES
+#define CLOCK_HZ 40000000 // 80MHz APB / clk_div 2
+
+static unsigned int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+// the translator as it was before the nibble table, one test per bit
+static uint32_t ref_t0h, ref_t0l, ref_t1h, ref_t1l;
+
+static void setRefTicks(bool is800KHz) {
+  ref_t0h = is800KHz ? 16 : 20; // 400ns : 500ns
+  ref_t0l = is800KHz ? 34 : 80; // 850ns : 2000ns
+  ref_t1h = is800KHz ? 32 : 48; // 800ns : 1200ns
+  ref_t1l = is800KHz ? 18 : 52; // 450ns : 1300ns
+}
+
+static void baselineAdapter(const void *src, rmt_item32_t *dest, size_t src_size,
+                            size_t wanted_num, size_t *translated_size, size_t *item_num) {
+  if (src == NULL || dest == NULL) {
+    *translated_size = 0;
+    *item_num = 0;
+    return;
+  }
+  const rmt_item32_t bit0 = {{{ ref_t0h, 1, ref_t0l, 0 }}}; //Logical 0
+  const rmt_item32_t bit1 = {{{ ref_t1h, 1, ref_t1l, 0 }}}; //Logical 1
+  size_t size = 0;
+  size_t num = 0;
+  uint8_t *psrc = (uint8_t *)src;
+  rmt_item32_t *pdest = dest;
+  while (size < src_size && num < wanted_num) {
+    for (int i = 0; i < 8; i++) {
+      // MSB first
+      if (*psrc & (1 << (7 - i))) {
+        pdest->val =  bit1.val;
+      } else {
+        pdest->val =  bit0.val;
+      }
+      num++;
+      pdest++;
+    }
+    size++;
+    psrc++;
+  }
+  *translated_size = size;
+  *item_num = num;
+}
+
+// translate a whole frame in RMT memory block pieces, as rmtSim.c does, returns the number of items
+static size_t translateFrame(sample_to_rmt_t fn, const uint8_t* src, size_t srcSize, rmt_item32_t* dest) {
+  size_t done = 0;
+  size_t items = 0;
+  size_t wanted = 48;
+  while (done < srcSize) {
+    size_t translated = 0;
+    size_t num = 0;
+    fn(src + done, dest + items, srcSize - done, wanted, &translated, &num);
+    done += translated;
+    items += num;
+    wanted = 24;
+  }
+  return items;
+}
+
+static rmt_item32_t refItems[SIM_MAX_ITEMS];
+
+static bool lastFrameMatches(const uint8_t* pixels, size_t numBytes) {
+  size_t items = translateFrame(baselineAdapter, pixels, numBytes, refItems);
+  return (items == simLastFrameItems) && (memcmp(refItems, simLastFrame, items * sizeof(rmt_item32_t)) == 0);
+}
+
+static void fillFrame(uint8_t* frame, size_t numBytes, uint8_t seed) {
+  for (size_t i = 0; i < numBytes; i++) {
+    frame[i] = (uint8_t)(seed + i * 37);
+  }
+}
+
+// every byte value, both speeds, odd and max lengths, the items must be bit for bit the original translator's
+static void testTranslation(void) {
+  static uint8_t frame[MAX_BYTES];
+  for (int speed = 0; speed < 2; speed++) {
+    bool is800KHz = (speed == 0);
+    setRefTicks(is800KHz);
+    for (int b = 0; b < 256; b++) {
+      memset(frame, b, 9);
+      espShow(8, frame, 9, is800KHz);
+      simRunUntilIdle();
+      check(lastFrameMatches(frame, 9), "every byte value, same items as the original translator");
+    }
+    for (size_t len = 1; len <= MAX_BYTES; len += 97) {
+      fillFrame(frame, len, (uint8_t)len);
+      espShow(8, frame, len, is800KHz);
+      simRunUntilIdle();
+      check(lastFrameMatches(frame, len), "frame lengths, same items as the original translator");
+    }
+  }
+  espShowRelease();
+}
+
+// the channel is installed once and kept, re-installed only for a new pin, speed or a larger frame
+static void testChannelKept(void) {
+  static uint8_t frame[MAX_BYTES];
+  simReset();
+  fillFrame(frame, 30, 1);
+  for (int i = 0; i < 100; i++) {
+    espShow(8, frame, 30, true);
+    simRunUntilIdle();
+  }
+  check((simCounts.installs == 1) && (simCounts.uninstalls == 0), "100 shows, one install");
+  check(simCounts.framesSent == 100, "100 shows, 100 frames sent");
+  espShow(8, frame, 12, true);
+  simRunUntilIdle();
+  check(simCounts.installs == 1, "smaller frame, no re-install");
+  espShow(9, frame, 12, true);
+  simRunUntilIdle();
+  check((simCounts.installs == 2) && (simCounts.uninstalls == 1), "new pin, re-installed");
+  espShow(9, frame, 60, true);
+  simRunUntilIdle();
+  check(simCounts.installs == 3, "larger frame, re-installed");
+  espShow(9, frame, 60, false);
+  simRunUntilIdle();
+  check(simCounts.installs == 4, "400KHz, re-installed");
+  espShow(9, frame, MAX_BYTES + 100, false);
+  simRunUntilIdle();
+  check(simLastFrameItems == (MAX_BYTES * 8), "frame cut to WS2812_MAX_BYTES");
+  espShowRelease();
+  check(simCounts.installs == simCounts.uninstalls, "released");
+}
+
+// espShow() does not wait, frames shown while one is sending are replaced by the newest, the latch time is kept
+static void testNonBlocking(void) {
+  static uint8_t frames[3][MAX_BYTES];
+  simReset();
+  setRefTicks(true);
+  for (int f = 0; f < 3; f++) {
+    fillFrame(frames[f], MAX_BYTES, (uint8_t)(f * 50));
+  }
+  int64_t before_us = esp_timer_get_time();
+  espShow(8, frames[0], MAX_BYTES, true);
+  check(esp_timer_get_time() == before_us, "espShow() returns without waiting for the frame");
+  check(espShowBusy(), "busy while sending");
+  simAdvance(1000);
+  espShow(8, frames[1], MAX_BYTES, true); // still sending frames[0]
+  espShow(8, frames[2], MAX_BYTES, true); // replaces frames[1]
+  check(simCounts.framesSent == 1, "one frame at a time");
+  simRunUntilIdle();
+  check(simCounts.framesSent == 2, "the replaced frame is dropped");
+  check(lastFrameMatches(frames[2], MAX_BYTES), "newest frame sent");
+  check((simLastFrameStart_us - simPrevFrameEnd_us) >= LATCH_US, "latch time kept between frames");
+  check(!espShowBusy(), "not busy once idle");
+  espShowRelease();
+}
+
+// espShowRelease() with a frame waiting on the latch timer, the timer must be stopped and deleted before the channel goes
+static void testRelease(void) {
+  static uint8_t frame[MAX_BYTES];
+  simReset();
+  fillFrame(frame, 90, 3);
+  espShow(8, frame, 90, true);
+  espShow(8, frame, 90, true); // pending, latch timer armed
+  check(simTimerArmed(), "latch timer armed for the pending frame");
+  espShowRelease();
+  check(!simTimerArmed(), "release stops the latch timer");
+  check(simCounts.timersDeleted == 1, "release deletes the latch timer");
+  check(simCounts.uninstalls == 1, "release uninstalls the channel");
+  unsigned int sent = simCounts.framesSent;
+  simFireStaleTimerCallback(); // dispatched by the esp_timer task just before the stop
+  simAdvance(100000);
+  check(simCounts.framesSent == sent, "nothing sent after release");
+  espShow(8, frame, 90, true);
+  simRunUntilIdle();
+  check((simCounts.timersCreated == 2) && (simCounts.framesSent == sent + 1), "show after release installs again");
+  espShowRelease();
+}
+
+// ---------- bench ----------
+static double secsSince(struct timespec* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void bench(void) {
+  static uint8_t frame[MAX_BYTES];
+  static rmt_item32_t dest[SIM_MAX_ITEMS];
+  const int rounds = 20000;
+  simReset();
+  setRefTicks(true);
+  fillFrame(frame, MAX_BYTES, 7);
+  espShow(8, frame, MAX_BYTES, true); // installs and builds the nibble table
+  simRunUntilIdle();
+  sample_to_rmt_t lutAdapter = simTranslator();
+  volatile uint32_t sink = 0;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < rounds; r++) {
+    frame[0] = (uint8_t)r;
+    translateFrame(baselineAdapter, frame, MAX_BYTES, dest);
+    sink += dest[r & 1023].val;
+  }
+  double oldSecs = secsSince(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < rounds; r++) {
+    frame[0] = (uint8_t)r;
+    translateFrame(lutAdapter, frame, MAX_BYTES, dest);
+    sink += dest[r & 1023].val;
+  }
+  double newSecs = secsSince(&start);
+  (void)sink;
+
+  double mbytes = (double)rounds * MAX_BYTES / 1e6;
+  printf("PC timings, only the old/new ratio carries over to the ESP32\n");
+  printf("translate %d byte frames x %d\n", MAX_BYTES, rounds);
+  printf("  original bit loop  %7.1f MB/s  %6.1f ns/byte\n", mbytes / oldSecs, oldSecs * 1e9 / (rounds * MAX_BYTES));
+  printf("  nibble table       %7.1f MB/s  %6.1f ns/byte  %.1fx faster\n", mbytes / newSecs, newSecs * 1e9 / (rounds * MAX_BYTES), oldSecs / newSecs);
+
+  espShowRelease();
+  simReset();
+  for (int i = 0; i < 100; i++) {
+    espShow(8, frame, MAX_BYTES, true);
+    simRunUntilIdle();
+  }
+  printf("100 shows of %d bytes\n", MAX_BYTES);
+  printf("  original  100 installs, 100 uninstalls, espShow() blocked %lld us each (frame time)\n",
+         (long long)simFrameTime_us(MAX_BYTES * 8, 50, CLOCK_HZ));
+  printf("  now       %u install, %u uninstall, espShow() blocked 0 us\n", simCounts.installs, simCounts.uninstalls);
+  espShowRelease();
+}
+
+int main(int argc, char* argv[]) {
+  if ((argc > 1) && (strcmp(argv[1], "bench") == 0)) {
+    bench();
+    return 0;
+  }
+  testTranslation();
+  testChannelKept();
+  testNonBlocking();
+  testRelease();
+  check(simCounts.errors == 0, "no driver or timer misuse");
+  printf(failures ? "%u failures\n" : "all passed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+/*
+   rmtSim.c
+*/
+#include <stdio.h>
+#include <Arduino.h>
+#include "rmtSim.h"
+
+#define SIM_MEM_BLOCK_ITEMS 48 // ESP32-C3 RMT memory block, refilled half a block at a time
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  bool armed;
+  bool deleted;
+  int64_t due_us;
+};
+
+struct simCounts_struct simCounts;
+rmt_item32_t simLastFrame[SIM_MAX_ITEMS];
+size_t simLastFrameItems = 0;
+int64_t simLastFrameStart_us = 0;
+int64_t simPrevFrameEnd_us = 0;
+
+static int64_t now_us = 0;
+static int criticalDepth = 0;
+static bool installed[RMT_CHANNEL_MAX];
+static uint8_t clkDiv[RMT_CHANNEL_MAX];
+static sample_to_rmt_t translator = NULL;
+static rmt_tx_end_fn_t txEndFn = NULL;
+static void* txEndArg = NULL;
+static bool txRunning = false;
+static rmt_channel_t txChannel = RMT_CHANNEL_0;
+static int64_t txEnd_us = 0;
+static int64_t lastFrameEnd_us = 0;
+static struct esp_timer* lastTimer = NULL;
+
+static void simError(const char* msg) {
+  simCounts.errors++;
+  printf("SIM ERROR %s\n", msg);
+}
+
+void simReset(void) {
+  memset(&simCounts, 0, sizeof(simCounts));
+  simLastFrameItems = 0;
+  simLastFrameStart_us = 0;
+  simPrevFrameEnd_us = 0;
+  lastFrameEnd_us = 0;
+}
+
+void simEnterCritical(portMUX_TYPE* mux) {
+  if (criticalDepth++) {
+    simError("nested critical section");
+  }
+  (void)mux;
+}
+
+void simExitCritical(portMUX_TYPE* mux) {
+  criticalDepth--;
+  (void)mux;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  simAdvance((int64_t)ticks * 1000);
+}
+
+static void endTx(void) {
+  txRunning = false;
+  now_us = (txEnd_us > now_us) ? txEnd_us : now_us;
+  simPrevFrameEnd_us = lastFrameEnd_us;
+  lastFrameEnd_us = now_us;
+  if (txEndFn) {
+    txEndFn(txChannel, txEndArg);
+  }
+}
+
+void simAdvance(int64_t us) {
+  int64_t target = now_us + us;
+  for (;;) {
+    bool txDue = txRunning && (txEnd_us <= target);
+    bool timerDue = simTimerArmed() && (lastTimer->due_us <= target);
+    if ((!txDue) && (!timerDue)) {
+      break;
+    }
+    if (txDue && ((!timerDue) || (txEnd_us <= lastTimer->due_us))) {
+      endTx();
+    } else {
+      now_us = (lastTimer->due_us > now_us) ? lastTimer->due_us : now_us;
+      lastTimer->armed = false;
+      lastTimer->callback(lastTimer->arg); // as the esp_timer task would
+    }
+  }
+  now_us = (target > now_us) ? target : now_us;
+}
+
+void simRunUntilIdle(void) {
+  for (int i = 0; (i < 1000) && (txRunning || simTimerArmed()); i++) {
+    simAdvance(100);
+  }
+  simAdvance(1000); // past the latch time
+}
+
+bool simTimerArmed(void) {
+  return lastTimer && lastTimer->armed && !lastTimer->deleted;
+}
+
+void simFireStaleTimerCallback(void) {
+  if (lastTimer) {
+    lastTimer->callback(lastTimer->arg);
+  }
+}
+
+sample_to_rmt_t simTranslator(void) {
+  return translator;
+}
+
+int64_t simFrameTime_us(size_t items, uint32_t ticksPerItem, uint32_t clock_hz) {
+  return (int64_t)(((uint64_t)items * ticksPerItem * 1000000ULL + clock_hz - 1) / clock_hz);
+}
+
+// ---------- RMT driver ----------
+esp_err_t rmt_config(const rmt_config_t* rmt_param) {
+  if ((rmt_param->channel < 0) || (rmt_param->channel >= RMT_CHANNEL_MAX)) {
+    return ESP_FAIL;
+  }
+  clkDiv[rmt_param->channel] = rmt_param->clk_div;
+  return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags) {
+  (void)rx_buf_size; (void)intr_alloc_flags;
+  if (installed[channel]) {
+    simError("rmt_driver_install on an installed channel");
+    return ESP_ERR_INVALID_STATE;
+  }
+  installed[channel] = true;
+  simCounts.installs++;
+  return ESP_OK;
+}
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel) {
+  if (!installed[channel]) {
+    simError("rmt_driver_uninstall on a channel not installed");
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (txRunning && (txChannel == channel)) {
+    simError("rmt_driver_uninstall while transmitting");
+  }
+  installed[channel] = false;
+  simCounts.uninstalls++;
+  return ESP_OK;
+}
+
+esp_err_t rmt_get_counter_clock(rmt_channel_t channel, uint32_t* clock_hz) {
+  *clock_hz = 80000000 / (clkDiv[channel] ? clkDiv[channel] : 1); // APB clock
+  return ESP_OK;
+}
+
+esp_err_t rmt_translator_init(rmt_channel_t channel, sample_to_rmt_t fn) {
+  (void)channel;
+  translator = fn;
+  return ESP_OK;
+}
+
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg) {
+  rmt_tx_end_callback_t previous = { txEndFn, txEndArg };
+  txEndFn = function;
+  txEndArg = arg;
+  return previous;
+}
+
+// translates as the driver ISR does, a block first and then half blocks, the translator can overshoot by up to 7 items
+esp_err_t rmt_write_sample(rmt_channel_t channel, const uint8_t* src, size_t src_size, bool wait_tx_done) {
+  if (!installed[channel] || !translator) {
+    simError("rmt_write_sample on a channel not installed");
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (txRunning) {
+    simError("rmt_write_sample while transmitting");
+    return ESP_ERR_INVALID_STATE;
+  }
+  size_t items = 0;
+  size_t done = 0;
+  size_t wanted = SIM_MEM_BLOCK_ITEMS;
+  uint64_t ticks = 0;
+  while (done < src_size) {
+    size_t translated = 0;
+    size_t num = 0;
+    if ((items + wanted + 8) > SIM_MAX_ITEMS) {
+      simError("frame too large for the simulation");
+      break;
+    }
+    translator(src + done, simLastFrame + items, src_size - done, wanted, &translated, &num);
+    if (translated == 0) {
+      simError("translator made no progress");
+      break;
+    }
+    done += translated;
+    items += num;
+    wanted = SIM_MEM_BLOCK_ITEMS / 2;
+  }
+  for (size_t i = 0; i < items; i++) {
+    ticks += simLastFrame[i].duration0 + simLastFrame[i].duration1;
+  }
+  uint32_t clock_hz = 0;
+  rmt_get_counter_clock(channel, &clock_hz);
+  simLastFrameItems = items;
+  simLastFrameStart_us = now_us;
+  simCounts.framesSent++;
+  txRunning = true;
+  txChannel = channel;
+  txEnd_us = now_us + (int64_t)((ticks * 1000000ULL + clock_hz - 1) / clock_hz);
+  if (wait_tx_done) {
+    endTx();
+  }
+  return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, uint32_t wait_time) {
+  (void)wait_time;
+  if (txRunning && (txChannel == channel)) {
+    endTx();
+  }
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(int gpio_num, gpio_mode_t mode) {
+  (void)gpio_num; (void)mode;
+  return ESP_OK;
+}
+
+// ---------- esp_timer ----------
+int64_t esp_timer_get_time(void) {
+  return now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+  struct esp_timer* timer = (struct esp_timer*)calloc(1, sizeof(struct esp_timer));
+  if (!timer) {
+    return ESP_FAIL;
+  }
+  timer->callback = create_args->callback;
+  timer->arg = create_args->arg;
+  free(lastTimer); // only one timer is used, keep the last one for simFireStaleTimerCallback()
+  lastTimer = timer;
+  simCounts.timersCreated++;
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+static bool checkTimer(esp_timer_handle_t timer) {
+  if ((!timer) || (timer != lastTimer) || timer->deleted) {
+    simError("use of a deleted or unknown timer");
+    return false;
+  }
+  return true;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  if (!checkTimer(timer)) {
+    return ESP_FAIL;
+  }
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->due_us = now_us + (int64_t)timeout_us;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!checkTimer(timer)) {
+    return ESP_FAIL;
+  }
+  if (!timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (!checkTimer(timer)) {
+    return ESP_FAIL;
+  }
+  if (timer->armed) {
+    simError("esp_timer_delete on a running timer");
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->deleted = true; // kept for simFireStaleTimerCallback()
+  simCounts.timersDeleted++;
+  return ESP_OK;
+}
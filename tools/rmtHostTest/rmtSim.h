@@ -0,0 +1,37 @@
+#ifndef _RMT_SIM_H
+#define _RMT_SIM_H
+/*
+   rmtSim.h
+   Simulated RMT driver and esp_timer for rmtHostTest.c, single threaded with a simulated clock
+   a transmit runs the channel's translator in RMT memory block sized pieces, as the driver's ISR does,
+   and ends (tx end callback) frame time later, the latch timer fires when simAdvance() passes its due time
+*/
+#include "driver/rmt.h"
+#include "esp_timer.h"
+
+#define SIM_MAX_ITEMS (8 * 1024 + 8)
+
+struct simCounts_struct {
+  unsigned int installs;
+  unsigned int uninstalls;
+  unsigned int framesSent;
+  unsigned int timersCreated;
+  unsigned int timersDeleted;
+  unsigned int errors; // misuse of the driver or timer, e.g. write on an uninstalled channel, use of a deleted timer
+};
+
+extern struct simCounts_struct simCounts;
+extern rmt_item32_t simLastFrame[SIM_MAX_ITEMS]; // items of the last frame sent
+extern size_t simLastFrameItems;
+extern int64_t simLastFrameStart_us;
+extern int64_t simPrevFrameEnd_us; // end of the frame before the last one
+
+void simReset(void);
+void simAdvance(int64_t us); // moves the simulated clock on, running tx ends and timer callbacks that fall due
+void simRunUntilIdle(void); // advance until no transmit or timer is pending
+bool simTimerArmed(void);
+void simFireStaleTimerCallback(void); // calls the last timer callback as if the esp_timer task had already dispatched it
+sample_to_rmt_t simTranslator(void); // translator registered by the last rmt_translator_init()
+int64_t simFrameTime_us(size_t items, uint32_t ticksPerItem, uint32_t clock_hz);
+
+#endif
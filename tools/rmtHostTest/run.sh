@@ -0,0 +1,18 @@
+#!/bin/sh
+# tools/rmtHostTest/run.sh  builds and runs the host tests for src/ESP_RMT_Peripheral.c, see rmtHostTest.c
+#   tools/rmtHostTest/run.sh [bench]
+# needs gcc, run from anywhere
+set -e
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC="$DIR/../../src"
+OUT="${TMPDIR:-/tmp}/rmtHostTest"
+mkdir -p "$OUT"
+SOURCES="$SRC/ESP_RMT_Peripheral.c $DIR/rmtSim.c $DIR/rmtHostTest.c"
+FLAGS="-std=gnu11 -DESP32 -Wall -Wextra -I$DIR/stubs -I$DIR"
+
+if [ "$1" = "bench" ]; then
+  gcc $FLAGS -O2 $SOURCES -o "$OUT/rmtHostBench"
+  exec "$OUT/rmtHostBench" bench
+fi
+gcc $FLAGS -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all $SOURCES -o "$OUT/rmtHostTest"
+exec "$OUT/rmtHostTest"
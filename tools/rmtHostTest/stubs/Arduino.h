@@ -0,0 +1,34 @@
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+/*
+   Arduino.h
+   Just enough of the ESP32 Arduino core to compile src/ESP_RMT_Peripheral.c on a PC, see tools/rmtHostTest/run.sh
+   critical sections and vTaskDelay() go to the simulation in rmtSim.c
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(4, 4, 0)
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+typedef bool boolean;
+typedef uint32_t TickType_t;
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+void simEnterCritical(portMUX_TYPE* mux);
+void simExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) simEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) simExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) simEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) simExitCritical(mux)
+void vTaskDelay(TickType_t ticks);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _HOST_DRIVER_RMT_H
+#define _HOST_DRIVER_RMT_H
+/*
+   driver/rmt.h
+   Host stand in for the IDF 4.4 legacy RMT driver, the calls are simulated in rmtSim.c
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef enum {
+  RMT_CHANNEL_0,
+  RMT_CHANNEL_1,
+  RMT_CHANNEL_MAX, // ESP32-C3 has 2 TX channels
+} rmt_channel_t;
+
+typedef struct {
+  union {
+    struct {
+      uint32_t duration0 : 15;
+      uint32_t level0 : 1;
+      uint32_t duration1 : 15;
+      uint32_t level1 : 1;
+    };
+    uint32_t val;
+  };
+} rmt_item32_t;
+
+typedef struct {
+  rmt_channel_t channel;
+  int gpio_num;
+  uint8_t clk_div;
+  uint8_t mem_block_num;
+} rmt_config_t;
+
+#define RMT_DEFAULT_CONFIG_TX(gpio, channel_id) { .channel = (channel_id), .gpio_num = (gpio), .clk_div = 80, .mem_block_num = 1 }
+
+typedef void (*sample_to_rmt_t)(const void* src, rmt_item32_t* dest, size_t src_size, size_t wanted_num, size_t* translated_size, size_t* item_num);
+typedef void (*rmt_tx_end_fn_t)(rmt_channel_t channel, void* arg);
+typedef struct {
+  rmt_tx_end_fn_t function;
+  void* arg;
+} rmt_tx_end_callback_t;
+
+typedef enum {
+  GPIO_MODE_OUTPUT = 2,
+} gpio_mode_t;
+
+esp_err_t rmt_config(const rmt_config_t* rmt_param);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags);
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel);
+esp_err_t rmt_get_counter_clock(rmt_channel_t channel, uint32_t* clock_hz);
+esp_err_t rmt_translator_init(rmt_channel_t channel, sample_to_rmt_t fn);
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg);
+esp_err_t rmt_write_sample(rmt_channel_t channel, const uint8_t* src, size_t src_size, bool wait_tx_done);
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, uint32_t wait_time);
+esp_err_t gpio_set_direction(int gpio_num, gpio_mode_t mode);
+
+#endif
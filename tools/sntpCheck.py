@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+   sntpCheck.py
+   Checks the device's SNTP server, see enableSNTPserver() in src/ntpSupport.cpp
+   Run from a PC on the same LAN with runSNTPserver = true in the sketch, e.g.
+     python3 tools/sntpCheck.py 192.168.1.50                  checks the reply, synchronized or not
+     python3 tools/sntpCheck.py 192.168.1.50 --expect unsync  just after power up, before the first NTP update
+     python3 tools/sntpCheck.py 192.168.1.50 --expect sync --wait 60
+     python3 tools/sntpCheck.py 192.168.1.50 --rate           also checks requests over 20/sec are dropped
+   exits 1 if any check fails
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+
+NTP_PORT = 123
+NTP_PACKET_SIZE = 48
+NTP_UNIX_OFFSET = 2208988800  # secs from 1900 to 1970
+MAX_SNTP_REQUESTS_PER_SEC = 20  # as in ntpSupport.cpp
+
+failures = 0
+
+
+def check(ok, msg):
+    global failures
+    print(("ok   " if ok else "FAIL ") + msg)
+    if not ok:
+        failures += 1
+
+
+def ntp_to_unix(ts):
+    return (ts >> 32) - NTP_UNIX_OFFSET + (ts & 0xFFFFFFFF) / 2**32
+
+
+def unix_to_ntp(t):
+    secs = int(t)
+    return ((secs + NTP_UNIX_OFFSET) << 32) | int((t - secs) * 2**32)
+
+
+def make_request(version=4):
+    transmit = unix_to_ntp(time.time())
+    return struct.pack("!BBbb9IQ", (0 << 6) | (version << 3) | 3, 0, 6, 0, *([0] * 9), transmit), transmit
+
+
+def parse_reply(data):
+    fields = struct.unpack("!BBbbII4sQQQQ", data[:NTP_PACKET_SIZE])
+    return {
+        "li": fields[0] >> 6, "vn": (fields[0] >> 3) & 7, "mode": fields[0] & 7,
+        "stratum": fields[1], "poll": fields[2], "precision": fields[3],
+        "refid": fields[6], "ref": fields[7], "orig": fields[8], "recv": fields[9], "xmit": fields[10],
+    }
+
+
+def query(sock, host, version=4):
+    request, transmit = make_request(version)
+    sent = time.time()
+    sock.sendto(request, (host, NTP_PORT))
+    data, _ = sock.recvfrom(512)
+    received = time.time()
+    if len(data) < NTP_PACKET_SIZE:
+        return None, transmit, sent, received
+    return parse_reply(data), transmit, sent, received
+
+
+def check_reply(reply, transmit, sent, received, expect, max_offset):
+    check(reply["mode"] == 4, "mode is server (4), got %d" % reply["mode"])
+    check(reply["vn"] == 4, "version echoes the request (4), got %d" % reply["vn"])
+    check(reply["orig"] == transmit, "originate timestamp is our transmit timestamp")
+    check(reply["poll"] == 6, "poll echoes the request")
+    synced = reply["li"] != 3
+    if expect == "unsync":
+        check(not synced, "LI is alarm (3) before the first NTP update, got %d" % reply["li"])
+    elif expect == "sync":
+        check(synced, "LI is not alarm after the NTP update, got %d" % reply["li"])
+    if not synced:
+        check(reply["stratum"] == 0, "stratum 0 (unsynchronized), got %d" % reply["stratum"])
+        check(reply["refid"] == b"INIT", "reference id INIT, got %r" % reply["refid"])
+        return
+    # LI 1 or 2 is passed on from the upstream server when it warns of a leap second
+    if reply["li"] != 0:
+        print("note: LI %d, upstream leap second warning" % reply["li"])
+    check(2 <= reply["stratum"] <= 15, "stratum 2..15, got %d" % reply["stratum"])
+    check(reply["refid"] != b"INIT", "reference id is the upstream server, got %r" % reply["refid"])
+    recv = ntp_to_unix(reply["recv"])
+    xmit = ntp_to_unix(reply["xmit"])
+    ref = ntp_to_unix(reply["ref"])
+    check(xmit >= recv, "transmit timestamp not before receive timestamp")
+    check(ref <= xmit, "reference timestamp not after transmit timestamp")
+    # offset as calculated by an SNTP client, round trip delay removed
+    offset = ((recv - sent) + (xmit - received)) / 2
+    check(abs(offset) <= max_offset, "offset from this PC's clock %.3fs within %.1fs" % (offset, max_offset))
+
+
+def check_rate_limit(sock, host, burst):
+    time.sleep(1.1)  # start with an empty rate limit period
+    sock.settimeout(0.5)
+    request, _ = make_request()
+    start = time.time()
+    for _ in range(burst):
+        sock.sendto(request, (host, NTP_PORT))
+    took = time.time() - start
+    replies = 0
+    try:
+        while True:
+            sock.recvfrom(512)
+            replies += 1
+    except socket.timeout:
+        pass
+    # a burst sent in under 1sec spans at most two rate limit periods
+    limit = MAX_SNTP_REQUESTS_PER_SEC * (2 if took < 1 else int(took + 2))
+    print("sent %d requests in %.3fs, %d replies" % (burst, took, replies))
+    check(replies > 0, "some requests in the burst are answered")
+    check(replies <= limit, "at most %d replies, requests over %d/sec dropped" % (limit, MAX_SNTP_REQUESTS_PER_SEC))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="check the device's SNTP server")
+    parser.add_argument("host", help="device IP address")
+    parser.add_argument("--expect", choices=["any", "sync", "unsync"], default="any")
+    parser.add_argument("--wait", type=float, default=0, help="with --expect sync, secs to wait for the first NTP update")
+    parser.add_argument("--max-offset", type=float, default=1.0, help="max secs between the device and this PC's clock")
+    parser.add_argument("--rate", action="store_true", help="also check the rate limit")
+    parser.add_argument("--burst", type=int, default=100, help="requests sent for the rate limit check")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2)
+    deadline = time.time() + args.wait
+    while True:
+        try:
+            reply, transmit, sent, received = query(sock, args.host)
+        except socket.timeout:
+            print("FAIL no reply from %s:%d" % (args.host, NTP_PORT))
+            return 1
+        if reply is None:
+            print("FAIL short reply")
+            return 1
+        if (args.expect != "sync") or (reply["li"] != 3) or (time.time() >= deadline):
+            break
+        time.sleep(5)  # not synchronized yet
+    check_reply(reply, transmit, sent, received, args.expect, args.max_offset)
+    # older clients, version is echoed
+    try:
+        reply, _, _, _ = query(sock, args.host, version=3)
+        check((reply is not None) and (reply["vn"] == 3), "version 3 request answered as version 3")
+    except socket.timeout:
+        check(False, "version 3 request answered")
+    if args.rate:
+        check_rate_limit(sock, args.host, args.burst)
+    print("%d checks failed" % failures if failures else "all checks passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,28 @@
+#!/bin/sh
+# tools/tzHostTest/run.sh  builds and runs the host tests for src/tzPosix.cpp, see tzHostTest.cpp for the modes
+#   tools/tzHostTest/run.sh [fuzz [iterations] | libfuzzer [libFuzzer args] | bench]
+# needs g++ (clang++ for libfuzzer) and glibc, run from anywhere
+set -e
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC="$DIR/../../src"
+OUT="${TMPDIR:-/tmp}/tzHostTest"
+mkdir -p "$OUT"
+SOURCES="$SRC/tzPosix.cpp $DIR/tzPosixBaseline.cpp $DIR/tzHostTest.cpp"
+FLAGS="-std=c++17 -I$DIR/stubs -I$SRC"
+
+case "$1" in
+  bench)
+    g++ $FLAGS -O2 -DNDEBUG $SOURCES -o "$OUT/tzHostBench"
+    exec "$OUT/tzHostBench" bench
+    ;;
+  libfuzzer)
+    shift
+    clang++ $FLAGS -O1 -g -fsanitize=fuzzer-no-link,address,undefined -c "$SRC/tzPosix.cpp" -o "$OUT/tzPosix.o"
+    clang++ $FLAGS -O1 -g -fsanitize=fuzzer,address,undefined -DTZ_HOST_LIBFUZZER "$OUT/tzPosix.o" $DIR/tzPosixBaseline.cpp $DIR/tzHostTest.cpp -o "$OUT/tzHostFuzzer"
+    exec "$OUT/tzHostFuzzer" "$@"
+    ;;
+  *)
+    g++ $FLAGS -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all $SOURCES -o "$OUT/tzHostTest"
+    exec "$OUT/tzHostTest" "$@"
+    ;;
+esac
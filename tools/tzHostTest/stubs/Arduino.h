@@ -0,0 +1,117 @@
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+/*
+   Arduino.h
+   Just enough of the Arduino core to compile src/tzPosix.cpp on a PC, see tools/tzHostTest/run.sh
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string>
+#include "Print.h"
+
+typedef unsigned int uint;
+typedef uint8_t byte;
+
+inline bool isDigit(char c) {
+  return isdigit((unsigned char)c);
+}
+inline bool isAlpha(char c) {
+  return isalpha((unsigned char)c);
+}
+inline bool isSpace(char c) {
+  return isspace((unsigned char)c);
+}
+inline void yield() {}
+
+#ifdef __APPLE__
+#include <string.h> // has strlcpy
+#elif !defined(__GLIBC__) || (__GLIBC__ < 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = (len < size - 1) ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// Arduino String on std::string, only the methods tzPosix.cpp and tzPosixBaseline.cpp use
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+    explicit String(int n) : std::string(std::to_string(n)) {}
+    explicit String(unsigned int n) : std::string(std::to_string(n)) {}
+    explicit String(long n) : std::string(std::to_string(n)) {}
+    explicit String(unsigned long n) : std::string(std::to_string(n)) {}
+    String& operator=(const char* s) {
+      assign(s ? s : "");
+      return *this;
+    }
+    String& operator+=(const char* s) {
+      append(s ? s : "");
+      return *this;
+    }
+    String& operator+=(const String& s) {
+      append(s);
+      return *this;
+    }
+    String& operator+=(char c) {
+      push_back(c);
+      return *this;
+    }
+    String& operator+=(int n) {
+      append(std::to_string(n));
+      return *this;
+    }
+    String& operator+=(unsigned int n) {
+      append(std::to_string(n));
+      return *this;
+    }
+    String& operator+=(uint8_t n) {
+      append(std::to_string((unsigned int)n));
+      return *this;
+    }
+    unsigned int length() const {
+      return (unsigned int)size();
+    }
+    String substring(unsigned int from, unsigned int to) const {
+      if (from > size()) {
+        return String();
+      }
+      if (to > size()) {
+        to = size();
+      }
+      if (to < from) {
+        return String();
+      }
+      return String(std::string::substr(from, to - from));
+    }
+    void trim() {
+      size_t start = 0;
+      size_t end = size();
+      while ((start < end) && isspace((unsigned char)(*this)[start])) {
+        start++;
+      }
+      while ((end > start) && isspace((unsigned char)(*this)[end - 1])) {
+        end--;
+      }
+      assign(std::string::substr(start, end - start));
+    }
+};
+
+inline size_t Print::print(const String& s) {
+  return write((const uint8_t*)s.c_str(), s.size());
+}
+
+class Stream : public Print {
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _HOST_PRINT_H
+#define _HOST_PRINT_H
+/*
+   Print.h
+   Arduino Print for the host tests
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+class String;
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      for (size_t i = 0; i < size; i++) {
+        n += write(buffer[i]);
+      }
+      return n;
+    }
+    size_t write(const char* str) {
+      return write((const uint8_t*)str, strlen(str));
+    }
+    size_t print(const char* str) {
+      return write(str);
+    }
+    size_t print(const String& s);
+    size_t print(char c) {
+      return write((uint8_t)c);
+    }
+    size_t print(long n) {
+      char buf[24];
+      snprintf(buf, sizeof(buf), "%ld", n);
+      return write(buf);
+    }
+    size_t print(unsigned long n) {
+      char buf[24];
+      snprintf(buf, sizeof(buf), "%lu", n);
+      return write(buf);
+    }
+    size_t print(int n) {
+      return print((long)n);
+    }
+    size_t print(unsigned int n) {
+      return print((unsigned long)n);
+    }
+    size_t print(unsigned char n) {
+      return print((unsigned long)n);
+    }
+    size_t print(short n) {
+      return print((long)n);
+    }
+    size_t println() {
+      return write("\n");
+    }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+      char buf[256];
+      va_list args;
+      va_start(args, format);
+      int n = vsnprintf(buf, sizeof(buf), format, args);
+      va_end(args);
+      return (n > 0) ? write(buf) : 0;
+    }
+    size_t print(const struct tm* timeinfo, const char* format = NULL) {
+      char buf[64];
+      size_t n = strftime(buf, sizeof(buf), format ? format : "%c", timeinfo);
+      return write((const uint8_t*)buf, n);
+    }
+    size_t println(const struct tm* timeinfo, const char* format = NULL) {
+      size_t n = print(timeinfo, format);
+      return n + println();
+    }
+    template<typename T> size_t println(const T& t) {
+      size_t n = print(t);
+      return n + println();
+    }
+};
+
+#endif
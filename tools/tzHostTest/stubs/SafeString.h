@@ -0,0 +1,76 @@
+#ifndef _HOST_SAFE_STRING_H
+#define _HOST_SAFE_STRING_H
+/*
+   SafeString.h
+   Host stand in for the SafeString library, only the calls src/tzPosix.cpp, src/LastSeen.cpp and src/registrySnapshot.cpp make
+   like SafeString, results too long for the buffer are not stored, the buffer is left unchanged
+*/
+#include <Arduino.h>
+
+inline size_t hostSafeStringCompares = 0; // startsWith() calls, for the registry restore bench
+
+class SafeString {
+  public:
+    SafeString(char* _buf, size_t _size) : buf(_buf), size(_size) {
+      buf[size - 1] = '\0';
+    }
+    SafeString& operator=(const char* str) {
+      if (str && (strlen(str) < size)) {
+        strcpy(buf, str);
+      }
+      return *this;
+    }
+    SafeString& operator+=(const char* str) {
+      if (str && ((strlen(buf) + strlen(str)) < size)) {
+        strcat(buf, str);
+      }
+      return *this;
+    }
+    SafeString& operator+=(char c) {
+      char str[2] = {c, '\0'};
+      return *this += str;
+    }
+    const char* c_str() const {
+      return buf;
+    }
+    size_t length() const {
+      return strlen(buf);
+    }
+    int indexOf(char c) const {
+      const char* p = strchr(buf, c);
+      return p ? (int)(p - buf) : -1;
+    }
+    // result is set to the chars from beginIdx upto, not including, endIdx, result may be this
+    SafeString& substring(SafeString& result, size_t beginIdx, size_t endIdx) {
+      size_t len = length();
+      if ((beginIdx <= endIdx) && (endIdx <= len) && ((endIdx - beginIdx) < result.size)) {
+        memmove(result.buf, buf + beginIdx, endIdx - beginIdx);
+        result.buf[endIdx - beginIdx] = '\0';
+      }
+      return result;
+    }
+    bool startsWith(const char* str) const {
+      hostSafeStringCompares++;
+      return strncmp(buf, str, strlen(str)) == 0;
+    }
+    void trim() {
+      size_t len = strlen(buf);
+      size_t start = 0;
+      while ((start < len) && isspace((unsigned char)buf[start])) {
+        start++;
+      }
+      while ((len > start) && isspace((unsigned char)buf[len - 1])) {
+        len--;
+      }
+      memmove(buf, buf + start, len - start);
+      buf[len - start] = '\0';
+    }
+  private:
+    char* buf;
+    size_t size;
+};
+
+#define cSFA(name, charArray) SafeString name(charArray, sizeof(charArray))
+#define cSF(name, size) char name##_SAFEBUFFER[(size) + 1]; name##_SAFEBUFFER[0] = '\0'; SafeString name(name##_SAFEBUFFER, sizeof(name##_SAFEBUFFER))
+
+#endif
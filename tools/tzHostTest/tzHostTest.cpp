@@ -0,0 +1,365 @@
+/*
+   tzHostTest.cpp
+   Host (PC) tests for the POSIX TZ parser in src/tzPosix.cpp, built and run by tools/tzHostTest/run.sh
+     run.sh              regression cases, every tzdata zone checked against the C library's localtime_r(),
+                         and the old String parser (tzPosixBaseline.cpp) compared with the new one, exits 1 on any failure
+     run.sh fuzz [n]     n random mutations of the tzdata strings (default 100000), each must parse without a sanitizer error,
+                         round trip, and the cleaned up string must give the same local times as localtime_r()
+     run.sh libfuzzer    the same checks as a libFuzzer target, needs clang
+     run.sh bench        parse time and heap allocations, old vs new parser
+                         getCurrentTZdescription() before/after the TZ cache is timed by tools/ntpHostTest/run.sh bench
+   The localtime_r() checks need glibc, which handles the POSIX TZ extensions (hours < 0 or > 24) that newlib does not
+*/
+#include <Arduino.h>
+#include <time.h>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "../../src/tzPosix.h"
+#include "../../src/tzIanaTable.h"
+
+namespace baseline {
+void posixTZDataFromStr(String& posixTZstr, struct posix_tz_data_struct& posixTZData);
+}
+
+// tzPosix.cpp calls this from setTZoffsetInMins(), not used here
+void setTZfromPOSIXstr(const char* tz_str) {
+  (void)tz_str;
+}
+
+// count heap allocations so the benchmark can show the new parser does not use the heap
+static size_t allocations = 0;
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void* p) noexcept {
+  free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static unsigned int failures = 0;
+
+static void fail(const char* what, const char* input, const char* detail) {
+  if (failures < 50) {
+    printf("FAIL %s \"%s\" %s\n", what, input, detail ? detail : "");
+  }
+  failures++;
+}
+
+static void cleanUp(const char* input, size_t len, char* result, size_t resultSize) {
+  struct posix_tz_data_struct posixData;
+  posixTZDataFromStr(input, len, posixData);
+  buildPOSIXstr(posixData, result, resultSize);
+}
+
+// ------------- regression cases -----------------
+// input and the expected cleaned up POSIX string, i.e. parse then buildPOSIXstr()
+struct regressionCase_struct {
+  const char* input;
+  const char* expected;
+};
+
+static const struct regressionCase_struct regressionCases[] = {
+  // valid strings come back in full, with the default dst offset and 2am rule times filled in
+  {"GMT0", "GMT0"},
+  {"<+01>-1", "<+01>-1"},
+  {"CET-1CEST,M3.5.0,M10.5.0/3", "CET-1CEST-2,M3.5.0/2,M10.5.0/3"},
+  {"CST6CDT,M3.2.0,M11.1.0", "CST6CDT5,M3.2.0/2,M11.1.0/2"},
+  {"NST03:30NDT,M3.2.0/0:01,M11.1.0/0:01", "NST3:30NDT2:30,M3.2.0/0:01,M11.1.0/0:01"},
+  {"<+00>0<+02>-2,M3.5.0/1,M10.5.0/3", "<+00>0<+02>-2,M3.5.0/1,M10.5.0/3"},
+  {"AEST-10AEDT,M10.1.0,M4.1.0/3", "AEST-10AEDT-11,M10.1.0/2,M4.1.0/3"},
+  {"AEST-10AEDT-11,M10.1.0/2,M4.1.0/3", "AEST-10AEDT-11,M10.1.0/2,M4.1.0/3"},
+  {"IST-2IDT,M3.4.4/26,M10.5.0", "IST-2IDT-3,M3.4.4/26,M10.5.0/2"}, // rule hour > 24
+  {"<-02>2<-01>,M3.5.0/-1,M10.5.0/0", "<-02>2<-01>1,M3.5.0/-1,M10.5.0/0"}, // -ve rule hour
+  {"EET-2EEST,M4.5.5/0,M10.5.4/24", "EET-2EEST-3,M4.5.5/0,M10.5.4/24"},
+  {"<+0545>-5:45", "<+0545>-5:45"},
+  {"<-0930>9:30", "<-0930>9:30"},
+  // cleaned up
+  {"  EST5EDT,M3.2.0,M11.1.0  ", "EST5EDT4,M3.2.0/2,M11.1.0/2"},
+  {"", "GMT0"},
+  {"-10", "<+10>-10"},
+  {"EST5EDT", "EST5"}, // no rules, DST dropped
+  {"CST6CDT,M13.9.9/99:99,M0.0.0", NULL}, // NULL, no expected string, just must round trip
+  {"EST99999999999999EDT,M3.2.0,M11.1.0", NULL},
+  {"<+0123456789012345678901>1", NULL},
+  {"ABC\x01\xff-1", NULL},
+};
+
+// parse then build must be stable, the second clean up must not change the string
+static bool isStable(const char* input, size_t len, char* result, size_t resultSize) {
+  cleanUp(input, len, result, resultSize);
+  char result2[POSIX_TZ_STR_SIZE];
+  cleanUp(result, strlen(result), result2, sizeof(result2));
+  return strcmp(result, result2) == 0;
+}
+
+static void testRegressionCases() {
+  for (size_t i = 0; i < sizeof(regressionCases) / sizeof(regressionCases[0]); i++) {
+    const struct regressionCase_struct& tc = regressionCases[i];
+    char result[POSIX_TZ_STR_SIZE];
+    if (!isStable(tc.input, strlen(tc.input), result, sizeof(result))) {
+      fail("round trip", tc.input, result);
+    }
+    if (tc.expected && (strcmp(result, tc.expected) != 0)) {
+      fail("regression", tc.input, result);
+    }
+  }
+}
+
+// ------------- differential check against localtime_r() -----------------
+static int64_t libLocalSecs(int64_t utc) {
+  time_t t = (time_t)utc;
+  struct tm tmLocal;
+  localtime_r(&t, &tmLocal);
+  return (int64_t)daysFromCivil(tmLocal.tm_year + 1900, tmLocal.tm_mon + 1, tmLocal.tm_mday) * 86400
+         + tmLocal.tm_hour * 3600 + tmLocal.tm_min * 60 + tmLocal.tm_sec;
+}
+
+static int64_t ourLocalSecs(const struct posix_tz_data_struct& posixData, bool hasDst, int64_t dstStartUtc, int64_t dstEndUtc, int64_t utc) {
+  bool isDst = false;
+  if (hasDst) { // same test as utcToLocal() in ntpSupport.cpp
+    isDst = (dstStartUtc < dstEndUtc) ? ((utc >= dstStartUtc) && (utc < dstEndUtc)) : ((utc >= dstStartUtc) || (utc < dstEndUtc));
+  }
+  return utc - (int64_t)(isDst ? posixData.dst_offset_min : posixData.offset_min) * 60;
+}
+
+// compares our local times for posixTZstr with localtime_r() for libTZstr, over fromYear..toYear, every step_secs and either side of each DST transition
+// libTZstr NULL uses the cleaned up posixTZstr, returns number of mismatches, first one in firstMismatch
+static unsigned int compareWithLocaltime(const char* posixTZstr, const char* libTZstr, int fromYear, int toYear, int32_t step_secs, char* firstMismatch, size_t size) {
+  struct posix_tz_data_struct posixData;
+  posixTZDataFromStr(posixTZstr, strlen(posixTZstr), posixData);
+  char tzStr[POSIX_TZ_STR_SIZE];
+  buildPOSIXstr(posixData, tzStr, sizeof(tzStr));
+  setenv("TZ", libTZstr ? libTZstr : tzStr, 1);
+  tzset();
+  unsigned int mismatches = 0;
+  for (int year = fromYear; year <= toYear; year++) {
+    int64_t dstStartUtc = 0;
+    int64_t dstEndUtc = 0;
+    bool hasDst = getDSTtransitionsUTC(posixData, year, dstStartUtc, dstEndUtc);
+    std::vector<int64_t> times;
+    int64_t yearStart = (int64_t)daysFromCivil(year, 1, 1) * 86400;
+    int64_t yearEnd = (int64_t)daysFromCivil(year + 1, 1, 1) * 86400;
+    for (int64_t utc = yearStart; utc < yearEnd; utc += step_secs) {
+      times.push_back(utc);
+    }
+    if (hasDst) {
+      for (int64_t edge : {dstStartUtc, dstEndUtc}) {
+        for (int64_t utc = edge - 1; utc <= edge + 1; utc++) {
+          if ((utc >= yearStart) && (utc < yearEnd)) {
+            times.push_back(utc);
+          }
+        }
+      }
+    }
+    for (int64_t utc : times) {
+      int64_t ours = ourLocalSecs(posixData, hasDst, dstStartUtc, dstEndUtc, utc);
+      int64_t lib = libLocalSecs(utc);
+      if (ours != lib) {
+        if (mismatches == 0) {
+          snprintf(firstMismatch, size, "%s at utc %lld offset %lld localtime_r %lld", tzStr, (long long)utc, (long long)(ours - utc), (long long)(lib - utc));
+        }
+        mismatches++;
+      }
+    }
+  }
+  return mismatches;
+}
+
+static void testTzdataZones() {
+  unsigned int zonesChecked = 0;
+  for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+    const char* tz = tzIanaTable[i].posixTZ;
+    char result[POSIX_TZ_STR_SIZE];
+    if (!isStable(tz, strlen(tz), result, sizeof(result))) {
+      fail("tzdata round trip", tz, result);
+    }
+    char mismatch[200];
+    if (compareWithLocaltime(tz, tz, 2024, 2037, 3600, mismatch, sizeof(mismatch))) {
+      fail("localtime_r", tzIanaTable[i].name, mismatch);
+    }
+    zonesChecked++;
+  }
+  printf("tzdata zones parsed, round tripped and checked against localtime_r() for 2024 to 2037: %u\n", zonesChecked);
+}
+
+// ------------- old String parser compared with the new one -----------------
+static bool samePosixData(const struct posix_tz_data_struct& a, const struct posix_tz_data_struct& b) {
+  return (a.offset_min == b.offset_min) && (a.dst_offset_min == b.dst_offset_min)
+         && (a.start_month == b.start_month) && (a.start_week == b.start_week) && (a.start_dow == b.start_dow)
+         && (a.start_time_hr == b.start_time_hr) && (a.start_time_min == b.start_time_min)
+         && (a.end_month == b.end_month) && (a.end_week == b.end_week) && (a.end_dow == b.end_dow)
+         && (a.end_time_hr == b.end_time_hr) && (a.end_time_min == b.end_time_min)
+         && (strcmp(a.tzname, b.tzname) == 0) && (strcmp(a.dsttzname, b.dsttzname) == 0);
+}
+
+// the old parser kept rule hours in a uint8_t and wrapped hours > 30 to 0..23, so -ve hours (e.g. America/Nuuk) and
+// hours > 30 were wrong, the new one keeps -167 to 167 and is expected to differ there
+static bool ruleHourOutsideOldRange(const struct posix_tz_data_struct& posixData) {
+  return (posixData.start_time_hr < 0) || (posixData.start_time_hr > 30) || (posixData.end_time_hr < 0) || (posixData.end_time_hr > 30);
+}
+
+static void testAgainstBaseline() {
+  unsigned int same = 0;
+  unsigned int expectedDiffs = 0;
+  for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+    const char* tz = tzIanaTable[i].posixTZ;
+    struct posix_tz_data_struct newData;
+    struct posix_tz_data_struct oldData;
+    posixTZDataFromStr(tz, strlen(tz), newData);
+    String tzString(tz);
+    baseline::posixTZDataFromStr(tzString, oldData);
+    if (samePosixData(newData, oldData)) {
+      same++;
+    } else if (ruleHourOutsideOldRange(newData)) {
+      expectedDiffs++;
+    } else {
+      fail("differs from the old parser", tz, NULL);
+    }
+  }
+  for (size_t i = 0; i < sizeof(regressionCases) / sizeof(regressionCases[0]); i++) {
+    if (!regressionCases[i].expected) {
+      continue; // malformed, the old parser was not hardened against these
+    }
+    struct posix_tz_data_struct newData;
+    struct posix_tz_data_struct oldData;
+    posixTZDataFromStr(regressionCases[i].input, strlen(regressionCases[i].input), newData);
+    String tzString(regressionCases[i].input);
+    baseline::posixTZDataFromStr(tzString, oldData);
+    if (samePosixData(newData, oldData)) {
+      same++;
+    } else if (ruleHourOutsideOldRange(newData)) {
+      expectedDiffs++;
+    } else {
+      fail("differs from the old parser", regressionCases[i].input, NULL);
+    }
+  }
+  printf("old and new parser agree on %u strings, %u expected differences (rule hours < 0 or > 30)\n", same, expectedDiffs);
+}
+
+// ------------- fuzzing -----------------
+// one fuzz input, must not trip the sanitizers, must round trip, and the cleaned string must match localtime_r()
+static void fuzzOne(const uint8_t* data, size_t size) {
+  char result[POSIX_TZ_STR_SIZE];
+  std::string input((const char*)data, size); // for the failure message
+  if (!isStable((const char*)data, size, result, sizeof(result))) {
+    fail("fuzz round trip", input.c_str(), result);
+    return;
+  }
+  char mismatch[200];
+  if (compareWithLocaltime(result, NULL, 2030, 2031, 5 * 3600 + 17 * 60, mismatch, sizeof(mismatch))) {
+    fail("fuzz localtime_r", input.c_str(), mismatch);
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  fuzzOne(data, size);
+  if (failures) {
+    abort(); // so libFuzzer saves the input
+  }
+  return 0;
+}
+
+static void fuzz(unsigned long iterations) {
+  static const char alphabet[] = "<>+-:,./MJ0123456789ABCZaz \t";
+  std::mt19937 rng(1);
+  for (unsigned long it = 0; it < iterations; it++) {
+    std::string s = tzIanaTable[rng() % TZ_IANA_TABLE_SIZE].posixTZ;
+    int mutations = 1 + rng() % 6;
+    for (int m = 0; m < mutations; m++) {
+      size_t pos = s.empty() ? 0 : rng() % (s.size() + 1);
+      switch (rng() % 4) {
+        case 0:
+          if (pos < s.size()) {
+            s.erase(pos, 1 + rng() % 3);
+          }
+          break;
+        case 1:
+          s.insert(pos, 1, alphabet[rng() % (sizeof(alphabet) - 1)]);
+          break;
+        case 2:
+          if (pos < s.size()) {
+            s[pos] = (char)(rng() % 256);
+          }
+          break;
+        default:
+          s.insert(pos, std::string(rng() % 40, '9')); // long numbers
+          break;
+      }
+    }
+    fuzzOne((const uint8_t*)s.data(), s.size());
+  }
+  printf("fuzz iterations: %lu\n", iterations);
+}
+
+// ------------- benchmarks -----------------
+typedef std::chrono::steady_clock benchClock;
+
+static double nsPerCall(benchClock::time_point start, size_t calls) {
+  return std::chrono::duration<double, std::nano>(benchClock::now() - start).count() / calls;
+}
+
+static volatile int sink; // stop the compiler removing the work
+
+static void benchParsers() {
+  const size_t rounds = 200;
+  size_t calls = rounds * TZ_IANA_TABLE_SIZE;
+  struct posix_tz_data_struct posixData;
+
+  size_t allocationsBefore = allocations;
+  benchClock::time_point start = benchClock::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+      String tzString(tzIanaTable[i].posixTZ);
+      baseline::posixTZDataFromStr(tzString, posixData);
+      sink = posixData.offset_min;
+    }
+  }
+  double oldNs = nsPerCall(start, calls);
+  double oldAllocs = (double)(allocations - allocationsBefore) / calls;
+
+  allocationsBefore = allocations;
+  start = benchClock::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < TZ_IANA_TABLE_SIZE; i++) {
+      const char* tz = tzIanaTable[i].posixTZ;
+      posixTZDataFromStr(tz, strlen(tz), posixData);
+      sink = posixData.offset_min;
+    }
+  }
+  double newNs = nsPerCall(start, calls);
+  double newAllocs = (double)(allocations - allocationsBefore) / calls;
+
+  printf("parse, %zu tzdata strings x %zu\n", TZ_IANA_TABLE_SIZE, rounds);
+  printf("  old String parser  %8.0f ns/parse  %5.2f heap allocations/parse (short strings fit in std::string's buffer, more on the ESP32)\n", oldNs, oldAllocs);
+  printf("  new parser         %8.0f ns/parse  %5.2f heap allocations/parse  %.1fx faster\n", newNs, newAllocs, oldNs / newNs);
+}
+
+#ifndef TZ_HOST_LIBFUZZER // libFuzzer supplies main()
+int main(int argc, char* argv[]) {
+  std::string mode = (argc > 1) ? argv[1] : "test";
+  if (mode == "bench") {
+    printf("PC timings, only the old/new ratios carry over to the ESP32\n");
+    benchParsers();
+    return 0;
+  }
+  if (mode == "fuzz") {
+    fuzz((argc > 2) ? strtoul(argv[2], NULL, 10) : 100000);
+  } else {
+    testRegressionCases();
+    testTzdataZones();
+    testAgainstBaseline();
+  }
+  printf(failures ? "%u failures\n" : "all passed\n", failures);
+  return failures ? 1 : 0;
+}
+#endif